@@ -0,0 +1,263 @@
+// bench_chunker.c - 分块与哈希吞吐量基准
+//
+// 生成可复现的随机数据与低熵数据，依次测量各分块算法与哈希后端，
+// 每个测量结果输出一行 JSON，便于脚本比较不同版本的性能。
+//
+// 用法: bench_chunker [-n <MB>] [-r <repeat>] [-s <avg_size>]
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <openssl/evp.h>
+#include "../fastcdc.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+#define DEFAULT_BUFFER_MB 64
+#define DEFAULT_REPEAT 3
+#define DIST_BUCKETS 30
+
+typedef struct {
+    const char *name;
+    unsigned char *data;
+    size_t size;
+} BenchBuffer;
+
+typedef struct {
+    double seconds;
+    uint64_t cycles;
+} BenchTime;
+
+static uint64_t read_cycles(void) {
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t xorshift64(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// 均匀随机数据
+static void fill_random(unsigned char *p, size_t n, uint64_t seed) {
+    uint64_t state = seed;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t v = xorshift64(&state);
+        memcpy(p + i, &v, 8);
+    }
+    for (; i < n; i++) {
+        p[i] = (unsigned char)xorshift64(&state);
+    }
+}
+
+// 低熵数据：小字母表上的随机长度游程，类似日志/稀疏文件
+static void fill_low_entropy(unsigned char *p, size_t n, uint64_t seed) {
+    static const unsigned char alphabet[] = " \n0123eatx";
+    uint64_t state = seed;
+    size_t i = 0;
+    while (i < n) {
+        uint64_t r = xorshift64(&state);
+        unsigned char c = alphabet[r % (sizeof(alphabet) - 1)];
+        size_t run = 1 + (r >> 32) % 64;
+        if (run > n - i) run = n - i;
+        memset(p + i, c, run);
+        i += run;
+    }
+}
+
+static int log2_bucket(int size) {
+    int b = 0;
+    while (size > 1 && b < DIST_BUCKETS - 1) {
+        size >>= 1;
+        b++;
+    }
+    return b;
+}
+
+static void print_dist(void) {
+    printf("\"chunk_dist\":[");
+    for (int i = 0; i < DIST_BUCKETS; i++) {
+        printf("%s%d", i ? "," : "", chunk_dist[i]);
+    }
+    printf("]");
+}
+
+static void print_rates(const BenchBuffer *buf, BenchTime t, long chunks) {
+    printf("\"gbps\":%.3f,\"chunks_per_sec\":%.0f,", buf->size / t.seconds / 1e9, chunks / t.seconds);
+    if (t.cycles) {
+        printf("\"cycles_per_byte\":%.3f,", (double)t.cycles / buf->size);
+    } else {
+        printf("\"cycles_per_byte\":null,");
+    }
+}
+
+// 对整个缓冲区分块，chunk_dist 按 log2(块长) 统计，sizes 非空时记录块长
+static long run_chunker(const BenchBuffer *buf, int *sizes, long max_chunks) {
+    memset(chunk_dist, 0, sizeof(chunk_dist));
+    size_t offset = 0;
+    long count = 0;
+    uint64_t sink = 0;
+    while (offset < buf->size) {
+        uint64_t feature = 0, weakhash = 0;
+        size_t left = buf->size - offset;
+        int n = left > (size_t)MaxSize ? (int)MaxSize : (int)left;
+        int len = chunking(buf->data + offset, n, &feature, &weakhash);
+        if (len <= 0) break;
+        if (sizes && count < max_chunks) sizes[count] = len;
+        chunk_dist[log2_bucket(len)]++;
+        sink ^= weakhash;
+        offset += len;
+        count++;
+    }
+    // 防止编译器把指纹计算优化掉
+    if (sink == 1) fprintf(stderr, " ");
+    return count;
+}
+
+static void bench_chunkers(const BenchBuffer *buf, int repeat) {
+    for (int algo = ORIGIN_CDC; algo <= NORMALIZED_2Bytes; algo++) {
+        fastCDC_select(algo);
+        BenchTime best = {0, 0};
+        long chunks = 0;
+        for (int r = 0; r < repeat; r++) {
+            double t0 = now_seconds();
+            uint64_t c0 = read_cycles();
+            chunks = run_chunker(buf, NULL, 0);
+            uint64_t c1 = read_cycles();
+            double t1 = now_seconds();
+            if (r == 0 || t1 - t0 < best.seconds) {
+                best.seconds = t1 - t0;
+                best.cycles = c1 - c0;
+            }
+        }
+        printf("{\"bench\":\"chunking\",\"algorithm\":\"%s\",\"data\":\"%s\",\"bytes\":%zu,"
+               "\"avg_size\":%u,\"chunks\":%ld,\"mean_chunk\":%.0f,",
+               fastCDC_algorithm_name(algo), buf->name, buf->size, AvgSize, chunks,
+               chunks ? (double)buf->size / chunks : 0.0);
+        print_rates(buf, best, chunks);
+        print_dist();
+        printf("}\n");
+    }
+}
+
+static void bench_hashes(const BenchBuffer *buf, int repeat) {
+    fastCDC_select(NORMALIZED_CDC);
+    long max_chunks = buf->size / MinSize + 1;
+    int *sizes = malloc(max_chunks * sizeof(int));
+    if (!sizes) {
+        perror("malloc");
+        return;
+    }
+    long chunks = run_chunker(buf, sizes, max_chunks);
+
+    const struct {
+        const char *name;
+        const EVP_MD *(*md)(void);
+    } backends[] = {
+        {"sha1", EVP_sha1},
+        {"md5", EVP_md5},
+        {"sha256", EVP_sha256},
+        {"blake2s256", EVP_blake2s256},
+    };
+
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+        const EVP_MD *md = backends[b].md();
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        BenchTime best = {0, 0};
+        int ok = 1;
+        for (int r = 0; r < repeat && ok; r++) {
+            double t0 = now_seconds();
+            uint64_t c0 = read_cycles();
+            size_t offset = 0;
+            for (long i = 0; i < chunks; i++) {
+                if (!EVP_Digest(buf->data + offset, sizes[i], digest, NULL, md, NULL)) {
+                    ok = 0;
+                    break;
+                }
+                offset += sizes[i];
+            }
+            uint64_t c1 = read_cycles();
+            double t1 = now_seconds();
+            if (r == 0 || t1 - t0 < best.seconds) {
+                best.seconds = t1 - t0;
+                best.cycles = c1 - c0;
+            }
+        }
+        if (!ok) {
+            fprintf(stderr, "hash backend %s unavailable\n", backends[b].name);
+            continue;
+        }
+        printf("{\"bench\":\"hash\",\"hash\":\"%s\",\"data\":\"%s\",\"bytes\":%zu,"
+               "\"avg_size\":%u,\"chunks\":%ld,",
+               backends[b].name, buf->name, buf->size, AvgSize, chunks);
+        print_rates(buf, best, chunks);
+        printf("\"digest_len\":%d}\n", EVP_MD_size(md));
+    }
+    free(sizes);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n <MB>] [-r <repeat>] [-s <avg_size>]\n", prog);
+    fprintf(stderr, "  -n  buffer size in MB (default %d)\n", DEFAULT_BUFFER_MB);
+    fprintf(stderr, "  -r  repetitions, the fastest run is reported (default %d)\n", DEFAULT_REPEAT);
+    fprintf(stderr, "  -s  average chunk size, power of two in [4096, 1048576] (default %d)\n",
+            FASTCDC_DEFAULT_AVG_SIZE);
+}
+
+int main(int argc, char *argv[]) {
+    size_t mb = DEFAULT_BUFFER_MB;
+    int repeat = DEFAULT_REPEAT;
+    unsigned long avg_size = FASTCDC_DEFAULT_AVG_SIZE;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:s:h")) != -1) {
+        switch (opt) {
+        case 'n': mb = strtoul(optarg, NULL, 10); break;
+        case 'r': repeat = atoi(optarg); break;
+        case 's': avg_size = strtoul(optarg, NULL, 10); break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (mb == 0 || repeat <= 0 || fastCDC_set_avg_size((uint32_t)avg_size) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    fastCDC_init();
+
+    size_t size = mb * 1024 * 1024;
+    BenchBuffer buffers[2] = {
+        {"random", malloc(size), size},
+        {"low_entropy", malloc(size), size},
+    };
+    if (!buffers[0].data || !buffers[1].data) {
+        perror("malloc");
+        return 1;
+    }
+    fill_random(buffers[0].data, size, 0x9e3779b97f4a7c15ULL);
+    fill_low_entropy(buffers[1].data, size, 0x2545f4914f6cdd1dULL);
+
+    for (int i = 0; i < 2; i++) {
+        bench_chunkers(&buffers[i], repeat);
+        bench_hashes(&buffers[i], repeat);
+        free(buffers[i].data);
+    }
+    return 0;
+}
@@ -0,0 +1,280 @@
+# loadgen.py - 去重集群端到端压测
+#
+# 在本机回环地址上启动若干组服务端（每组 server1~server4，默认一组），
+# 并发运行多个合成客户端：每个客户端先上传一个随机文件，之后每轮按
+# modify.py 的方式随机删除/插入若干处再上传，统计吞吐量、会话延迟分位数
+# 以及每逻辑字节的网络传输字节数。所有数据由 --seed 决定，结果可复现。
+#
+# 用法（在仓库根目录先 make）:
+#   python3 bench/loadgen.py --clients 4 --sessions 5 --file-size 8M
+#   python3 bench/loadgen.py --clusters 2 --clients 8 --json
+#
+# 服务端每个连接、每个逻辑流一个线程，同一组服务端上的客户端会话并发执行，
+# 压测的正是这种并发下的吞吐量与延迟；客户端按编号轮流分配到各组。
+
+import argparse
+import json
+import os
+import random
+import re
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+REPO_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SERVERS_PER_CLUSTER = 4
+WIRE_RE = re.compile(r"Wire bytes: sent (\d+), received (\d+)")
+TIMING_RE = re.compile(r"^Timing: (\{.*\})$", re.M)
+
+
+def parse_size(text):
+    units = {"k": 1024, "m": 1024 ** 2, "g": 1024 ** 3}
+    text = text.strip().lower()
+    if text and text[-1] in units:
+        return int(float(text[:-1]) * units[text[-1]])
+    return int(text)
+
+
+def percentile(values, pct):
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    idx = min(len(ordered) - 1, max(0, int(round(pct / 100.0 * len(ordered) + 0.5)) - 1))
+    return ordered[idx]
+
+
+def wait_for_port(port, timeout):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        try:
+            with socket.create_connection(("127.0.0.1", port), timeout=0.2):
+                return True
+        except OSError:
+            time.sleep(0.05)
+    return False
+
+
+def mutate(data, rng, edits_per_mb):
+    """与 modify.py 相同的编辑模式：删除 100 字节、插入 200 个随机可打印字符，比例 1:2"""
+    data = bytearray(data)
+    edits = max(1, int(round(edits_per_mb * len(data) / (1024 * 1024))))
+    deletes = edits // 3
+    for _ in range(deletes):
+        if len(data) <= 100:
+            break
+        pos = rng.randint(0, len(data) - 100)
+        del data[pos:pos + 100]
+    for _ in range(edits - deletes):
+        pos = rng.randint(0, len(data))
+        data[pos:pos] = bytes(rng.randint(32, 126) for _ in range(200))
+    return bytes(data)
+
+
+class Cluster:
+    def __init__(self, index, root, base_port):
+        self.index = index
+        self.dir = os.path.join(root, "cluster%d" % index)
+        self.ports = [base_port + index * SERVERS_PER_CLUSTER + k for k in range(SERVERS_PER_CLUSTER)]
+        self.procs = []
+
+    def start(self):
+        for k, port in enumerate(self.ports):
+            sid = k + 1
+            workdir = os.path.join(self.dir, "server%d" % sid)
+            os.makedirs(workdir, exist_ok=True)
+            log = open(os.path.join(workdir, "server.log"), "wb")
+            proc = subprocess.Popen([os.path.join(REPO_DIR, "server"), "-i", str(sid), str(port)],
+                                    cwd=workdir, stdout=log, stderr=subprocess.STDOUT)
+            self.procs.append((proc, log))
+        for port in self.ports:
+            if not wait_for_port(port, 10):
+                raise RuntimeError("server on port %d did not start" % port)
+
+    def stop(self):
+        for proc, log in self.procs:
+            proc.terminate()
+        for proc, log in self.procs:
+            try:
+                proc.wait(timeout=5)
+            except subprocess.TimeoutExpired:
+                proc.kill()
+            log.close()
+
+
+class Client(threading.Thread):
+    def __init__(self, index, cluster, root, args):
+        super().__init__(name="client%d" % index)
+        self.index = index
+        self.cluster = cluster
+        self.dir = os.path.join(root, "client%d" % index)
+        self.args = args
+        self.rng = random.Random(args.seed * 1000003 + index)
+        self.results = []
+        self.error = None
+
+    def write_config(self):
+        os.makedirs(self.dir, exist_ok=True)
+        with open(os.path.join(self.dir, "client.conf"), "w") as f:
+            for k, port in enumerate(self.cluster.ports):
+                f.write("server%d_ip=127.0.0.1\n" % (k + 1))
+                f.write("server%d_port=%d\n" % (k + 1, port))
+            f.write("chunking=%s\n" % self.args.algorithm)
+            f.write("avg_size=%d\n" % self.args.avg_size)
+
+    def run_session(self, session, data):
+        name = "file%d.bin" % self.index
+        with open(os.path.join(self.dir, name), "wb") as f:
+            f.write(data)
+        start = time.perf_counter()
+        proc = subprocess.run([os.path.join(REPO_DIR, "client"), name], cwd=self.dir,
+                              stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+        latency = time.perf_counter() - start
+        output = proc.stdout.decode("utf-8", "replace")
+        with open(os.path.join(self.dir, "session%d.log" % session), "w") as f:
+            f.write(output)
+        wire = WIRE_RE.search(output)
+        if proc.returncode != 0 or not wire:
+            raise RuntimeError("client%d session %d failed (exit %d), see %s"
+                               % (self.index, session, proc.returncode, self.dir))
+        timing = TIMING_RE.search(output)
+        self.results.append({
+            "client": self.index,
+            "session": session,
+            "phase": "initial" if session == 0 else "incremental",
+            "bytes": len(data),
+            "latency": latency,
+            "wire_sent": int(wire.group(1)),
+            "wire_received": int(wire.group(2)),
+            "phase_seconds": json.loads(timing.group(1))["seconds"] if timing else {},
+        })
+
+    def run(self):
+        try:
+            self.write_config()
+            data = self.rng.randbytes(self.args.file_size)
+            for session in range(self.args.sessions):
+                if session > 0:
+                    data = mutate(data, self.rng, self.args.edits_per_mb)
+                self.run_session(session, data)
+        except Exception as e:  # 记录后由主线程汇总
+            self.error = e
+
+
+def summarize(results, wall):
+    summary = {}
+    for phase in ("all", "initial", "incremental"):
+        rows = [r for r in results if phase == "all" or r["phase"] == phase]
+        if not rows:
+            continue
+        logical = sum(r["bytes"] for r in rows)
+        sent = sum(r["wire_sent"] for r in rows)
+        received = sum(r["wire_received"] for r in rows)
+        latencies = [r["latency"] for r in rows]
+        summary[phase] = {
+            "sessions": len(rows),
+            "logical_bytes": logical,
+            "wire_sent": sent,
+            "wire_received": received,
+            "wire_per_logical_byte": (sent + received) / logical if logical else 0.0,
+            "latency_p50": percentile(latencies, 50),
+            "latency_p99": percentile(latencies, 99),
+            "latency_max": max(latencies),
+            "phase_seconds_mean": {name: sum(r["phase_seconds"].get(name, 0.0) for r in rows) / len(rows)
+                                   for name in rows[0]["phase_seconds"]},
+        }
+    logical = sum(r["bytes"] for r in results)
+    summary["all"]["wall_seconds"] = wall
+    summary["all"]["throughput_mb_per_sec"] = logical / wall / (1024 * 1024) if wall else 0.0
+    summary["all"]["sessions_per_sec"] = len(results) / wall if wall else 0.0
+    return summary
+
+
+def print_summary(summary, args):
+    print("Load test: %d clients x %d sessions, %d clusters, file size %d bytes, %.1f edits/MB"
+          % (args.clients, args.sessions, args.clusters, args.file_size, args.edits_per_mb))
+    overall = summary["all"]
+    print("  wall time:        %.3f s" % overall["wall_seconds"])
+    print("  throughput:       %.2f MB/s logical, %.2f sessions/s"
+          % (overall["throughput_mb_per_sec"], overall["sessions_per_sec"]))
+    for phase in ("all", "initial", "incremental"):
+        if phase not in summary:
+            continue
+        s = summary[phase]
+        print("  [%s] sessions=%d p50=%.3fs p99=%.3fs max=%.3fs wire/logical=%.4f (sent %d, received %d)"
+              % (phase, s["sessions"], s["latency_p50"], s["latency_p99"], s["latency_max"],
+                 s["wire_per_logical_byte"], s["wire_sent"], s["wire_received"]))
+        if s["phase_seconds_mean"]:
+            print("    client phases (mean s): %s"
+                  % " ".join("%s=%.4f" % kv for kv in s["phase_seconds_mean"].items()))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="End-to-end load test for the dedup cluster")
+    parser.add_argument("--clients", type=int, default=4, help="concurrent synthetic clients")
+    parser.add_argument("--clusters", type=int, default=1,
+                        help="server groups of 4 to launch; clients are spread over them and run concurrently")
+    parser.add_argument("--sessions", type=int, default=5, help="uploads per client, the first is the initial upload")
+    parser.add_argument("--file-size", type=parse_size, default=parse_size("4M"), help="file size, K/M/G suffixes allowed")
+    parser.add_argument("--edits-per-mb", type=float, default=30.0,
+                        help="insert/delete edits per MB between sessions (modify.py does 30 per file)")
+    parser.add_argument("--algorithm", default="normalized", help="client chunking algorithm")
+    parser.add_argument("--avg-size", type=parse_size, default=8192, help="client average chunk size")
+    parser.add_argument("--base-port", type=int, default=19000)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--workdir", help="keep server/client directories here instead of a temp dir")
+    parser.add_argument("--json", action="store_true", help="print the summary as JSON")
+    args = parser.parse_args()
+
+    if args.clients <= 0 or args.sessions <= 0 or args.file_size <= 0:
+        parser.error("clients, sessions and file size must be positive")
+    if args.clusters <= 0:
+        parser.error("clusters must be positive")
+    args.clusters = min(args.clusters, args.clients)
+    for binary in ["client", "server"]:
+        if not os.access(os.path.join(REPO_DIR, binary), os.X_OK):
+            sys.exit("missing %s, run make in %s first" % (binary, REPO_DIR))
+
+    root = args.workdir or tempfile.mkdtemp(prefix="dedup-loadgen-")
+    os.makedirs(root, exist_ok=True)
+    clusters = [Cluster(i, root, args.base_port) for i in range(args.clusters)]
+    clients = [Client(i, clusters[i % args.clusters], root, args) for i in range(args.clients)]
+
+    try:
+        for cluster in clusters:
+            cluster.start()
+        start = time.perf_counter()
+        for client in clients:
+            client.start()
+        for client in clients:
+            client.join()
+        wall = time.perf_counter() - start
+    finally:
+        for cluster in clusters:
+            cluster.stop()
+
+    errors = [c.error for c in clients if c.error]
+    results = [r for c in clients for r in c.results]
+    if errors:
+        for e in errors:
+            print("error: %s" % e, file=sys.stderr)
+    if not results:
+        sys.exit(1)
+
+    summary = summarize(results, wall)
+    if args.json:
+        print(json.dumps({"config": {k: v for k, v in vars(args).items() if k != "json"},
+                          "summary": summary, "sessions": results}, indent=2))
+    else:
+        print_summary(summary, args)
+
+    if not args.workdir:
+        shutil.rmtree(root, ignore_errors=True)
+    sys.exit(1 if errors else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,174 @@
+// bufpool.c - 服务端块缓冲区池
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "bufpool.h"
+
+typedef struct {
+    void *head;                   // 空闲缓冲区链表，链接指针存放在缓冲区开头
+    int count;
+} FreeList;
+
+// 全局仓库与统计由 g_lock 保护
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static FreeList g_depot[BUFPOOL_CLASSES];
+static int g_huge_pages;
+static BufPoolStats g_stats;
+
+static __thread FreeList t_cache[BUFPOOL_CLASSES];
+static __thread int t_registered;
+static pthread_key_t g_thread_key;
+static pthread_once_t g_key_once = PTHREAD_ONCE_INIT;
+
+static size_t class_size(int c) {
+    return (size_t)BUFPOOL_MIN_SIZE << c;
+}
+
+static int size_class(size_t size) {
+    for (int c = 0; c < BUFPOOL_CLASSES; c++) {
+        if (size <= class_size(c)) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+static void list_push(FreeList *list, void *buf) {
+    *(void **)buf = list->head;
+    list->head = buf;
+    list->count++;
+}
+
+static void *list_pop(FreeList *list) {
+    void *buf = list->head;
+    if (buf) {
+        list->head = *(void **)buf;
+        list->count--;
+    }
+    return buf;
+}
+
+static void list_move(FreeList *from, FreeList *to, int n) {
+    while (n-- > 0 && from->head) {
+        list_push(to, list_pop(from));
+    }
+}
+
+// 线程退出时把缓存的缓冲区交回仓库
+static void thread_cache_flush(void *unused) {
+    (void)unused;
+    pthread_mutex_lock(&g_lock);
+    for (int c = 0; c < BUFPOOL_CLASSES; c++) {
+        list_move(&t_cache[c], &g_depot[c], t_cache[c].count);
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+static void make_thread_key(void) {
+    pthread_key_create(&g_thread_key, thread_cache_flush);
+}
+
+static void thread_register(void) {
+    if (!t_registered) {
+        pthread_once(&g_key_once, make_thread_key);
+        pthread_setspecific(g_thread_key, &t_registered);
+        t_registered = 1;
+    }
+}
+
+// 分配一个 slab，优先使用大页；调用时持有 g_lock
+static unsigned char *slab_alloc(void) {
+    void *slab = MAP_FAILED;
+    if (g_huge_pages) {
+        slab = mmap(NULL, BUFPOOL_SLAB_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (slab != MAP_FAILED) {
+            g_stats.huge_slabs++;
+        } else {
+            // 预留的大页已用完，之后不再尝试
+            g_huge_pages = 0;
+        }
+    }
+    if (slab == MAP_FAILED) {
+        slab = mmap(NULL, BUFPOOL_SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (slab == MAP_FAILED) {
+        return NULL;
+    }
+    g_stats.slabs++;
+    g_stats.slab_bytes += BUFPOOL_SLAB_SIZE;
+    return slab;
+}
+
+// 把一个新 slab 切分成 c 档的缓冲区放入仓库；调用时持有 g_lock
+static void depot_grow(int c) {
+    unsigned char *slab = slab_alloc();
+    if (!slab) {
+        return;
+    }
+    for (size_t off = 0; off + class_size(c) <= BUFPOOL_SLAB_SIZE; off += class_size(c)) {
+        list_push(&g_depot[c], slab + off);
+    }
+}
+
+int bufpool_init(int huge_pages) {
+    pthread_mutex_lock(&g_lock);
+    g_huge_pages = huge_pages;
+    if (g_huge_pages) {
+        // 先为最大一档申请一个 slab，确认大页是否可用
+        depot_grow(BUFPOOL_CLASSES - 1);
+    }
+    int huge = g_huge_pages;
+    pthread_mutex_unlock(&g_lock);
+    return huge;
+}
+
+void *bufpool_get(size_t size) {
+    int c = size_class(size);
+    if (c < 0) {
+        pthread_mutex_lock(&g_lock);
+        g_stats.oversized++;
+        pthread_mutex_unlock(&g_lock);
+        return malloc(size);
+    }
+
+    thread_register();
+    FreeList *cache = &t_cache[c];
+    if (!cache->head) {
+        pthread_mutex_lock(&g_lock);
+        if (!g_depot[c].head) {
+            depot_grow(c);
+        }
+        list_move(&g_depot[c], cache, BUFPOOL_THREAD_CACHE / 2);
+        pthread_mutex_unlock(&g_lock);
+    }
+    return list_pop(cache);
+}
+
+void bufpool_put(void *buf, size_t size) {
+    if (!buf) {
+        return;
+    }
+    int c = size_class(size);
+    if (c < 0) {
+        free(buf);
+        return;
+    }
+
+    thread_register();
+    FreeList *cache = &t_cache[c];
+    list_push(cache, buf);
+    if (cache->count > BUFPOOL_THREAD_CACHE) {
+        pthread_mutex_lock(&g_lock);
+        list_move(cache, &g_depot[c], BUFPOOL_THREAD_CACHE / 2);
+        pthread_mutex_unlock(&g_lock);
+    }
+}
+
+void bufpool_stats(BufPoolStats *stats) {
+    pthread_mutex_lock(&g_lock);
+    *stats = g_stats;
+    pthread_mutex_unlock(&g_lock);
+}
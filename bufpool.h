@@ -0,0 +1,36 @@
+#pragma once
+/**
+ * 服务端块缓冲区池
+ *
+ * 接收上传块用的缓冲区按大小分为 8/16/32/64KB 四档，从池中取用、用完归还，不再每块 malloc/free。
+ * 每个线程有自己的空闲缓冲区缓存，取还都不加锁；缓存超过 BUFPOOL_THREAD_CACHE 个时把一半交回
+ * 全局仓库，线程退出时全部交回，供其他连接线程和后续会话复用。
+ * 缓冲区从 BUFPOOL_SLAB_SIZE 的 slab 中切分，slab 可使用大页，申请失败时退回普通页；
+ * slab 不归还系统，池占用的内存等于并发使用量的峰值。超过 BUFPOOL_MAX_SIZE 的块直接 malloc。
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BUFPOOL_CLASSES 4
+#define BUFPOOL_MIN_SIZE (8 * 1024)         // 最小一档，之后每档翻倍
+#define BUFPOOL_MAX_SIZE (BUFPOOL_MIN_SIZE << (BUFPOOL_CLASSES - 1))
+#define BUFPOOL_SLAB_SIZE (2 * 1024 * 1024) // 与大页大小一致
+#define BUFPOOL_THREAD_CACHE 32             // 每个线程每档最多缓存的空闲缓冲区数
+
+typedef struct {
+    uint64_t slabs;
+    uint64_t huge_slabs;
+    uint64_t slab_bytes;
+    uint64_t oversized;           // 超过最大档、直接 malloc 的次数
+} BufPoolStats;
+
+// 可选：huge_pages 非 0 时 slab 优先使用大页。返回 1 表示大页可用，0 表示使用普通页
+int bufpool_init(int huge_pages);
+
+// 取一个至少 size 字节的缓冲区，失败返回 NULL
+void *bufpool_get(size_t size);
+// 归还缓冲区，size 须与取用时相同
+void bufpool_put(void *buf, size_t size);
+
+void bufpool_stats(BufPoolStats *stats);
@@ -0,0 +1,444 @@
+// dedup_analyze.c - 目录树去重率分析
+// 用法:
+//   ./dedup_analyze [-j threads] [-a algos] [-s sizes] [-b base_path] [-J] <path> [path ...]
+// 说明:
+//   遍历给定的文件/目录（递归），使用与客户端相同的 fastcdc.o 分块，按 SHA1 统计唯一块，
+//   对每个 (分块算法, 平均块长) 组合输出总数据量、唯一数据量、去重率、块长分布与索引内存估算。
+//   指定 -b 时先导入 base_path 作为上一个快照，再统计目标数据中可复用 base 的比例。
+//   -a 逗号分隔的算法名（origin,rolling2,normalized,normalized2），默认 normalized
+//   -s 逗号分隔的平均块长（4096~1048576 的 2 的幂），默认 8192
+//   -j 并行线程数，默认为在线 CPU 数；-J 每个组合额外输出一行 JSON
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <openssl/sha.h>
+
+#include "../fastcdc.h"
+
+#define MAX_CONFIGS 32
+#define SHARD_COUNT 256
+#define DIST_BUCKETS 30
+// 索引内存估算：每个唯一块 FastFp(8) + SHA1(20) + 位置(8)，按 0.7 装载因子；布隆过滤器每块 4 字节
+#define INDEX_ENTRY_BYTES 36
+#define INDEX_LOAD_FACTOR 0.7
+#define FILTER_BYTES_PER_CHUNK 4
+
+#define FLAG_BASE 1
+#define FLAG_TARGET 2
+
+// ------------------ 文件列表 ------------------
+typedef struct {
+    char **paths;
+    int count;
+    int cap;
+} FileList;
+
+static int file_list_add(FileList *fl, const char *path) {
+    if (fl->count >= fl->cap) {
+        int cap = fl->cap ? fl->cap * 2 : 256;
+        char **p = realloc(fl->paths, cap * sizeof(char *));
+        if (!p) return -1;
+        fl->paths = p;
+        fl->cap = cap;
+    }
+    fl->paths[fl->count] = strdup(path);
+    return fl->paths[fl->count++] ? 0 : -1;
+}
+
+static void file_list_free(FileList *fl) {
+    for (int i = 0; i < fl->count; i++) free(fl->paths[i]);
+    free(fl->paths);
+    memset(fl, 0, sizeof(*fl));
+}
+
+// 递归收集普通文件，不跟随符号链接
+static void collect_files(const char *path, FileList *fl) {
+    struct stat st;
+    if (lstat(path, &st) != 0) {
+        fprintf(stderr, "[警告] 无法访问: %s\n", path);
+        return;
+    }
+    if (S_ISREG(st.st_mode)) {
+        if (file_list_add(fl, path) != 0) fprintf(stderr, "[警告] 内存不足，跳过: %s\n", path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) return;
+
+    DIR *d = opendir(path);
+    if (!d) {
+        fprintf(stderr, "[警告] 无法打开目录: %s\n", path);
+        return;
+    }
+    struct dirent *entry;
+    char child[4096];
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        collect_files(child, fl);
+    }
+    closedir(d);
+}
+
+// ------------------ 唯一块表（按 SHA1 首字节分片，每片一把锁） ------------------
+typedef struct {
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    uint32_t size;
+    uint8_t flags;
+    uint8_t used;
+} ChunkEntry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    ChunkEntry *slots;
+    uint32_t cap;
+    uint32_t count;
+} Shard;
+
+static Shard shards[SHARD_COUNT];
+
+static void shards_init(void) {
+    for (int i = 0; i < SHARD_COUNT; i++) {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        shards[i].slots = NULL;
+        shards[i].cap = shards[i].count = 0;
+    }
+}
+
+static void shards_reset(void) {
+    for (int i = 0; i < SHARD_COUNT; i++) {
+        free(shards[i].slots);
+        shards[i].slots = NULL;
+        shards[i].cap = shards[i].count = 0;
+    }
+}
+
+static uint32_t sha1_slot_hash(const unsigned char *sha1) {
+    uint32_t h;
+    memcpy(&h, sha1 + 4, sizeof(h));
+    return h;
+}
+
+static ChunkEntry *shard_find_slot(ChunkEntry *slots, uint32_t cap, const unsigned char *sha1) {
+    uint32_t s = sha1_slot_hash(sha1) & (cap - 1);
+    while (slots[s].used && memcmp(slots[s].sha1, sha1, SHA_DIGEST_LENGTH) != 0) {
+        s = (s + 1) & (cap - 1);
+    }
+    return &slots[s];
+}
+
+static int shard_grow(Shard *sh) {
+    uint32_t cap = sh->cap ? sh->cap * 2 : 1024;
+    ChunkEntry *slots = calloc(cap, sizeof(ChunkEntry));
+    if (!slots) return -1;
+    for (uint32_t i = 0; i < sh->cap; i++) {
+        if (sh->slots[i].used) *shard_find_slot(slots, cap, sh->slots[i].sha1) = sh->slots[i];
+    }
+    free(sh->slots);
+    sh->slots = slots;
+    sh->cap = cap;
+    return 0;
+}
+
+// 插入块并打上 flag，返回插入前的 flags（0 表示新块），失败返回 -1
+static int chunk_table_add(const unsigned char *sha1, uint32_t size, uint8_t flag) {
+    Shard *sh = &shards[sha1[0]];
+    pthread_mutex_lock(&sh->lock);
+    if ((sh->count + 1) * 10 > sh->cap * 7 && shard_grow(sh) != 0) {
+        pthread_mutex_unlock(&sh->lock);
+        return -1;
+    }
+    ChunkEntry *e = shard_find_slot(sh->slots, sh->cap, sha1);
+    int old = e->used ? e->flags : 0;
+    if (!e->used) {
+        memcpy(e->sha1, sha1, SHA_DIGEST_LENGTH);
+        e->size = size;
+        e->used = 1;
+        sh->count++;
+    }
+    e->flags |= flag;
+    pthread_mutex_unlock(&sh->lock);
+    return old;
+}
+
+// ------------------ 统计 ------------------
+typedef struct {
+    long long files;
+    long long bytes;
+    long long chunks;
+    long long unique_chunks;     // 本阶段首次出现的块
+    long long unique_bytes;
+    long long base_reused_bytes; // 目标数据中已存在于 base 的字节
+    long long dist[DIST_BUCKETS];
+} Stats;
+
+static void stats_merge(Stats *dst, const Stats *src) {
+    dst->files += src->files;
+    dst->bytes += src->bytes;
+    dst->chunks += src->chunks;
+    dst->unique_chunks += src->unique_chunks;
+    dst->unique_bytes += src->unique_bytes;
+    dst->base_reused_bytes += src->base_reused_bytes;
+    for (int i = 0; i < DIST_BUCKETS; i++) dst->dist[i] += src->dist[i];
+}
+
+static int log2_bucket(int size) {
+    int b = 0;
+    while (size > 1 && b < DIST_BUCKETS - 1) { size >>= 1; b++; }
+    return b;
+}
+
+// ------------------ 并行分块 ------------------
+// 分块参数（MinSize/MaxSize/掩码/chunking 指针）在启动线程前设置好，线程只读
+typedef struct {
+    const FileList *files;
+    uint8_t flag;
+    int next;                    // 下一个待处理文件下标
+    pthread_mutex_t lock;
+    int error;
+} WorkQueue;
+
+typedef struct {
+    WorkQueue *queue;
+    Stats stats;
+} Worker;
+
+static int chunk_one_file(const char *path, uint8_t flag, Stats *st) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "[警告] 无法读取: %s\n", path);
+        return 0;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || sb.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    size_t size = (size_t)sb.st_size;
+    unsigned char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "[警告] 无法映射: %s\n", path);
+        return 0;
+    }
+    posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+
+    st->files++;
+    st->bytes += size;
+    size_t offset = 0;
+    int ret = 0;
+    while (offset < size) {
+        uint64_t feature = 0, weakhash = 0;
+        size_t left = size - offset;
+        int n = left > MaxSize ? (int)MaxSize : (int)left;
+        int len = chunking(data + offset, n, &feature, &weakhash);
+        if (len <= 0) break;
+
+        unsigned char sha1[SHA_DIGEST_LENGTH];
+        SHA1(data + offset, len, sha1);
+        int old = chunk_table_add(sha1, (uint32_t)len, flag);
+        if (old < 0) {
+            ret = -1;
+            break;
+        }
+        if (!(old & flag)) {
+            st->unique_chunks++;
+            st->unique_bytes += len;
+        }
+        if (flag == FLAG_TARGET && (old & FLAG_BASE)) {
+            st->base_reused_bytes += len;
+        }
+        st->chunks++;
+        st->dist[log2_bucket(len)]++;
+        offset += len;
+    }
+    munmap(data, size);
+    return ret;
+}
+
+static void *worker_main(void *arg) {
+    Worker *w = (Worker *)arg;
+    WorkQueue *q = w->queue;
+    for (;;) {
+        pthread_mutex_lock(&q->lock);
+        int idx = q->error ? q->files->count : q->next++;
+        pthread_mutex_unlock(&q->lock);
+        if (idx >= q->files->count) break;
+        if (chunk_one_file(q->files->paths[idx], q->flag, &w->stats) != 0) {
+            pthread_mutex_lock(&q->lock);
+            q->error = 1;
+            pthread_mutex_unlock(&q->lock);
+        }
+    }
+    return NULL;
+}
+
+static int run_parallel(const FileList *files, uint8_t flag, int threads, Stats *out) {
+    WorkQueue q;
+    memset(&q, 0, sizeof(q));
+    q.files = files;
+    q.flag = flag;
+    pthread_mutex_init(&q.lock, NULL);
+
+    Worker *workers = calloc(threads, sizeof(Worker));
+    pthread_t *tids = calloc(threads, sizeof(pthread_t));
+    if (!workers || !tids) {
+        free(workers); free(tids);
+        return -1;
+    }
+    int started = 0;
+    for (int i = 0; i < threads; i++) {
+        workers[i].queue = &q;
+        if (pthread_create(&tids[i], NULL, worker_main, &workers[i]) != 0) break;
+        started++;
+    }
+    if (started == 0) worker_main(&workers[0]);
+    for (int i = 0; i < started; i++) pthread_join(tids[i], NULL);
+    for (int i = 0; i < (started ? started : 1); i++) stats_merge(out, &workers[i].stats);
+
+    pthread_mutex_destroy(&q.lock);
+    free(workers); free(tids);
+    return q.error ? -1 : 0;
+}
+
+// ------------------ 输出 ------------------
+static void print_report(const char *algo, uint32_t avg, const Stats *base, const Stats *target,
+                         int have_base, double seconds, int json) {
+    long long unique_total = (have_base ? base->unique_chunks : 0) + target->unique_chunks;
+    double index_bytes = unique_total * INDEX_ENTRY_BYTES / INDEX_LOAD_FACTOR;
+    double filter_bytes = (double)unique_total * FILTER_BYTES_PER_CHUNK;
+    double ratio = target->unique_bytes > 0 ? (double)target->bytes / target->unique_bytes : 0.0;
+    double savings = target->bytes > 0 ? 100.0 * (target->bytes - target->unique_bytes) / target->bytes : 0.0;
+
+    printf("---------- 算法: %s, 平均块长: %u ----------\n", algo, avg);
+    printf("  文件数: %lld, 总数据量: %lld bytes, 分块数: %lld, 平均块长: %.0f bytes\n",
+           target->files, target->bytes, target->chunks,
+           target->chunks ? (double)target->bytes / target->chunks : 0.0);
+    printf("  唯一块数: %lld, 唯一数据量: %lld bytes\n", target->unique_chunks, target->unique_bytes);
+    printf("  去重率: %.3f : 1, 节省: %.2f%%\n", ratio, savings);
+    if (have_base) {
+        printf("  base 快照: %lld bytes, 唯一 %lld bytes；目标数据可复用 base: %lld bytes (%.2f%%)\n",
+               base->bytes, base->unique_bytes, target->base_reused_bytes,
+               target->bytes ? 100.0 * target->base_reused_bytes / target->bytes : 0.0);
+    }
+    printf("  索引内存估算: %.1f MB (布隆过滤器 %.1f MB)，唯一块总数 %lld\n",
+           index_bytes / (1024 * 1024), filter_bytes / (1024 * 1024), unique_total);
+    printf("  块长分布 (log2):");
+    for (int i = 0; i < DIST_BUCKETS; i++) {
+        if (target->dist[i]) printf(" [2^%d]=%lld", i, target->dist[i]);
+    }
+    printf("\n  耗时: %.3f s (%.1f MB/s)\n", seconds,
+           seconds > 0 ? (target->bytes + (have_base ? base->bytes : 0)) / seconds / (1024 * 1024) : 0.0);
+
+    if (json) {
+        printf("{\"algorithm\":\"%s\",\"avg_size\":%u,\"files\":%lld,\"bytes\":%lld,\"chunks\":%lld,"
+               "\"unique_chunks\":%lld,\"unique_bytes\":%lld,\"dedup_ratio\":%.4f,",
+               algo, avg, target->files, target->bytes, target->chunks,
+               target->unique_chunks, target->unique_bytes, ratio);
+        if (have_base) {
+            printf("\"base_bytes\":%lld,\"base_unique_bytes\":%lld,\"base_reused_bytes\":%lld,",
+                   base->bytes, base->unique_bytes, target->base_reused_bytes);
+        }
+        printf("\"index_bytes_est\":%.0f,\"filter_bytes_est\":%.0f,\"seconds\":%.3f,\"chunk_dist\":[",
+               index_bytes, filter_bytes, seconds);
+        for (int i = 0; i < DIST_BUCKETS; i++) printf("%s%lld", i ? "," : "", target->dist[i]);
+        printf("]}\n");
+    }
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-j threads] [-a algos] [-s sizes] [-b base_path] [-J] <path> [path ...]\n", prog);
+    fprintf(stderr, "  -a  comma separated: origin,rolling2,normalized,normalized2 (default normalized)\n");
+    fprintf(stderr, "  -s  comma separated average chunk sizes, powers of two in [4096, 1048576] (default 8192)\n");
+    fprintf(stderr, "  -b  previous snapshot; reports how much of <path> can reuse it\n");
+    fprintf(stderr, "  -J  also print one JSON line per configuration\n");
+}
+
+int main(int argc, char *argv[]) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char *algo_arg = "normalized", *size_arg = "8192", *base_path = NULL;
+    int json = 0, opt;
+    while ((opt = getopt(argc, argv, "j:a:s:b:Jh")) != -1) {
+        switch (opt) {
+        case 'j': threads = atoi(optarg); break;
+        case 'a': algo_arg = optarg; break;
+        case 's': size_arg = optarg; break;
+        case 'b': base_path = optarg; break;
+        case 'J': json = 1; break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (threads < 1) threads = 1;
+
+    int algos[MAX_CONFIGS], nalgos = 0;
+    uint32_t sizes[MAX_CONFIGS];
+    int nsizes = 0;
+    char buf[512];
+    snprintf(buf, sizeof(buf), "%s", algo_arg);
+    for (char *tok = strtok(buf, ","); tok && nalgos < MAX_CONFIGS; tok = strtok(NULL, ",")) {
+        int a = fastCDC_parse_algorithm(tok);
+        if (a < 0) { fprintf(stderr, "[错误] 未知分块算法: %s\n", tok); return 1; }
+        algos[nalgos++] = a;
+    }
+    snprintf(buf, sizeof(buf), "%s", size_arg);
+    for (char *tok = strtok(buf, ","); tok && nsizes < MAX_CONFIGS; tok = strtok(NULL, ",")) {
+        unsigned long s = strtoul(tok, NULL, 10);
+        if (fastCDC_set_avg_size((uint32_t)s) != 0) { fprintf(stderr, "[错误] 非法平均块长: %s\n", tok); return 1; }
+        sizes[nsizes++] = (uint32_t)s;
+    }
+
+    FileList target = {0}, base = {0};
+    for (int i = optind; i < argc; i++) collect_files(argv[i], &target);
+    if (base_path) collect_files(base_path, &base);
+    printf("========== 去重率分析 ==========\n");
+    printf("目标: %d 个文件%s%s，线程数: %d\n", target.count,
+           base_path ? "，base: " : "", base_path ? base_path : "", threads);
+
+    shards_init();
+    int ret = 0;
+    for (int a = 0; a < nalgos && ret == 0; a++) {
+        for (int s = 0; s < nsizes && ret == 0; s++) {
+            fastCDC_set_avg_size(sizes[s]);
+            fastCDC_init();
+            fastCDC_select(algos[a]);
+
+            Stats base_stats, target_stats;
+            memset(&base_stats, 0, sizeof(base_stats));
+            memset(&target_stats, 0, sizeof(target_stats));
+            double t0 = now_seconds();
+            if ((base_path && run_parallel(&base, FLAG_BASE, threads, &base_stats) != 0) ||
+                run_parallel(&target, FLAG_TARGET, threads, &target_stats) != 0) {
+                fprintf(stderr, "[错误] 内存不足\n");
+                ret = 1;
+            } else {
+                print_report(fastCDC_algorithm_name(algos[a]), sizes[s], &base_stats, &target_stats,
+                             base_path != NULL, now_seconds() - t0, json);
+            }
+            shards_reset();
+        }
+    }
+    printf("================================\n");
+
+    file_list_free(&target);
+    file_list_free(&base);
+    return ret;
+}
@@ -12,71 +12,14 @@
 #include <stdint.h>
 #include <sys/stat.h>
 #include <openssl/sha.h>
-#include <openssl/md5.h>
 
-// 引入与客户端一致的 FastCDC 头（位于上级目录 test/fastcdc.h）
+// 与客户端共用 FastCDC 实现（链接上级目录的 fastcdc.o）
 #include "../fastcdc.h"
 
 #ifndef MAX
 #define MAX(a,b) ((a)>(b)?(a):(b))
 #endif
 
-// ------------------ 来自客户端的 FastCDC 初始化与分块实现 ------------------
-void fastCDC_init(void) {
-    unsigned char md5_digest[16];
-    uint8_t seed[SeedLength];
-    for (int i = 0; i < SymbolCount; i++) {
-        for (int j = 0; j < SeedLength; j++) seed[j] = i;
-        g_global_matrix[i] = 0;
-        MD5(seed, SeedLength, md5_digest);
-        memcpy(&(g_global_matrix[i]), md5_digest, 4);
-        g_global_matrix_left[i] = g_global_matrix[i] << 1;
-    }
-    for (int i = 0; i < SymbolCount; i++) {
-        LEARv2[i] = GEARv2[i] << 1;
-    }
-    MinSize = 8192 / 4;
-    MaxSize = 8192 * 4;
-    Mask_15 = 0xf9070353;
-    Mask_11 = 0xd9000353;
-    Mask_11_64 = 0x0000d90003530000ULL;
-    Mask_15_64 = 0x0000f90703530000ULL;
-    MinSize_divide_by_2 = MinSize / 2;
-}
-
-int normalized_chunking_64(unsigned char *p, int n, uint64_t *feature, uint64_t *weakhash) {
-    uint64_t fingerprint = 0;
-    int originalMinSize = MinSize;
-    MinSize = 6 * 1024;
-    int i = MinSize, Mid = 8 * 1024;
-
-    if (n <= MinSize) {
-        for (int j = 0; j < n; j++) fingerprint = (fingerprint << 1) + (GEARv2[p[j]]);
-        MinSize = originalMinSize;
-        *weakhash = fingerprint;
-        return n;
-    }
-
-    if (n > MaxSize) n = MaxSize; else if (n < Mid) Mid = n;
-
-    while (i < Mid) {
-        fingerprint = (fingerprint << 1) + (GEARv2[p[i]]);
-        if ((!(fingerprint & FING_GEAR_32KB_64))) {
-            MinSize = originalMinSize; *weakhash = fingerprint; return i;
-        }
-        i++;
-    }
-    while (i < n) {
-        fingerprint = (fingerprint << 1) + (GEARv2[p[i]]);
-        if ((!(fingerprint & FING_GEAR_02KB_64))) {
-            MinSize = originalMinSize; *weakhash = fingerprint; return i;
-        }
-        i++;
-    }
-    MinSize = originalMinSize; *weakhash = fingerprint; return n;
-}
-// -------------------------------------------------------------------------
-
 static void sha1_of(const unsigned char *data, size_t len, unsigned char out[SHA_DIGEST_LENGTH]) {
     SHA1(data, len, out);
 }
@@ -111,17 +54,18 @@ static void free_chunks(ChunkList *cl) {
 
 static int chunk_file_fastcdc(const unsigned char *data, size_t size, ChunkList *out) {
     fastCDC_init();
-    int (*chunking)(unsigned char*, int, uint64_t*, uint64_t*) = normalized_chunking_64;
 
     int maxchunks = (int)(size / MinSize) + 2;
     int *boundary = (int *)malloc(sizeof(int) * maxchunks);
     uint64_t *weak = (uint64_t *)malloc(sizeof(uint64_t) * maxchunks);
     if (!boundary || !weak) { free(boundary); free(weak); return -1; }
 
-    int cnt = 0; int offset = 0; int end = (int)size;
-    while (offset < end) {
+    // 偏移用 size_t，每次最多交给分块函数 MaxSize 字节，支持超过 2GB 的输入
+    int cnt = 0; size_t offset = 0;
+    while (offset < size) {
         uint64_t feature = 0, w = 0;
-        int clen = chunking((unsigned char*)data + offset, end - offset, &feature, &w);
+        size_t left = size - offset;
+        int clen = chunking((unsigned char*)data + offset, left > MaxSize ? (int)MaxSize : (int)left, &feature, &w);
         if (clen <= 0) break;
         if (cnt >= maxchunks) break;
         boundary[cnt] = clen; weak[cnt] = w; cnt++; offset += clen;
@@ -131,7 +75,7 @@ static int chunk_file_fastcdc(const unsigned char *data, size_t size, ChunkList
     if (!sha1s) { free(boundary); free(weak); return -1; }
 
     // 计算每块 SHA1
-    int off = 0;
+    size_t off = 0;
     for (int i = 0; i < cnt; i++) {
         sha1_of((const unsigned char*)data + off, boundary[i], sha1s + i*SHA_DIGEST_LENGTH);
         off += boundary[i];
@@ -144,11 +88,15 @@ static int chunk_file_fastcdc(const unsigned char *data, size_t size, ChunkList
     return 0;
 }
 
-// 简单哈希表（链地址）用于把 old 的 weak -> 列表索引映射
-typedef struct WeakNode { int idx; struct WeakNode *next; } WeakNode;
+// 扁平开放寻址表：old 的 weak -> 块下标。weak 内联在槽位中，SHA1 仍在 ChunkList 的平行数组里；
+// 整个索引一次分配，探测时顺序访问相邻槽位
+typedef struct {
+    uint64_t weak;
+    int32_t idx;        // 块下标 + 1，0 表示空槽（calloc 即为全空）
+} WeakSlot;
 
 typedef struct {
-    WeakNode **buckets; // 大小为 cap
+    WeakSlot *slots;    // 大小为 cap
     int cap;
 } WeakIndex;
 
@@ -160,27 +108,23 @@ static uint32_t hash64to32(uint64_t x) {
 
 static int weak_index_build(const ChunkList *oldc, WeakIndex *wx) {
     int cap = 1;
-    while (cap < oldc->count * 2) cap <<= 1; // 简单取 >=2x 的 2 的幂
+    while (cap < oldc->count * 2) cap <<= 1; // 装载因子不超过 0.5
     if (cap < 8) cap = 8;
     wx->cap = cap;
-    wx->buckets = (WeakNode**)calloc(cap, sizeof(WeakNode*));
-    if (!wx->buckets) return -1;
+    wx->slots = (WeakSlot*)calloc(cap, sizeof(WeakSlot));
+    if (!wx->slots) return -1;
     for (int i = 0; i < oldc->count; i++) {
         uint32_t h = hash64to32(oldc->weak[i]) & (cap - 1);
-        WeakNode *node = (WeakNode*)malloc(sizeof(WeakNode));
-        if (!node) return -1;
-        node->idx = i; node->next = wx->buckets[h]; wx->buckets[h] = node;
+        while (wx->slots[h].idx) h = (h + 1) & (cap - 1);
+        wx->slots[h].weak = oldc->weak[i];
+        wx->slots[h].idx = i + 1;
     }
     return 0;
 }
 
 static void weak_index_free(WeakIndex *wx) {
-    if (!wx || !wx->buckets) return;
-    for (int i = 0; i < wx->cap; i++) {
-        WeakNode *p = wx->buckets[i];
-        while (p) { WeakNode *n = p->next; free(p); p = n; }
-    }
-    free(wx->buckets); wx->buckets = NULL; wx->cap = 0;
+    if (!wx) return;
+    free(wx->slots); wx->slots = NULL; wx->cap = 0;
 }
 
 static int sha1_equal(const unsigned char *a, const unsigned char *b) {
@@ -220,18 +164,14 @@ int main(int argc, char *argv[]) {
     for (int i = 0; i < newc.count; i++) {
         if (oldc.count == 0) break;
         uint64_t w = newc.weak[i];
-        uint32_t h = hash64to32(w) & (wx.cap - 1);
-        WeakNode *p = wx.buckets[h];
-        while (p) {
-            int oi = p->idx;
-            if (oldc.weak[oi] == w) {
-                if (sha1_equal(newc.sha1 + i*SHA_DIGEST_LENGTH, oldc.sha1 + oi*SHA_DIGEST_LENGTH)) {
-                    matched_bytes += newc.sizes[i];
-                    matched_blocks += 1;
-                    break; // 新文件的该块已匹配，转向下一个新块
-                }
+        const unsigned char *sha1 = newc.sha1 + i*SHA_DIGEST_LENGTH;
+        for (uint32_t h = hash64to32(w) & (wx.cap - 1); wx.slots[h].idx; h = (h + 1) & (wx.cap - 1)) {
+            int oi = wx.slots[h].idx - 1;
+            if (wx.slots[h].weak == w && sha1_equal(sha1, oldc.sha1 + oi*SHA_DIGEST_LENGTH)) {
+                matched_bytes += newc.sizes[i];
+                matched_blocks += 1;
+                break; // 新文件的该块已匹配，转向下一个新块
             }
-            p = p->next;
         }
     }
 
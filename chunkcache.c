@@ -0,0 +1,244 @@
+// chunkcache.c - 服务端热点块读缓存
+#include <stdlib.h>
+#include <string.h>
+#include "chunkcache.h"
+
+#define CHUNKCACHE_MIN_BUCKETS 256
+#define CHUNKCACHE_MIN_SLOTS 64
+
+static uint64_t chunkcache_hash(const ChunkId *id) {
+    uint64_t h;
+    memcpy(&h, id->sha1, sizeof(h));
+    h ^= id->fastfp;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static ChunkCacheShard *chunkcache_shard(ChunkCache *cache, uint64_t hash) {
+    // 桶下标用低位，分片用高位，两者互不相关
+    return &cache->shards[(hash >> 32) % CHUNKCACHE_SHARDS];
+}
+
+static int chunk_id_equal(const ChunkId *a, const ChunkId *b) {
+    return a->fastfp == b->fastfp && memcmp(a->sha1, b->sha1, SHA_DIGEST_LENGTH) == 0;
+}
+
+static int shard_find(ChunkCacheShard *s, const ChunkId *id, uint64_t hash) {
+    for (int i = s->buckets[hash & s->bucket_mask]; i >= 0; i = s->slots[i].next) {
+        if (chunk_id_equal(&s->slots[i].id, id)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// 从哈希链摘下槽位并放回空槽链表
+static void shard_release(ChunkCacheShard *s, int idx) {
+    ChunkCacheSlot *slot = &s->slots[idx];
+    int *link = &s->buckets[chunkcache_hash(&slot->id) & s->bucket_mask];
+    while (*link != idx) {
+        link = &s->slots[*link].next;
+    }
+    *link = slot->next;
+
+    free(slot->data);
+    slot->data = NULL;
+    s->bytes -= slot->size;
+    s->entries--;
+    slot->next = s->free_head;
+    s->free_head = idx;
+}
+
+// 条目数超过桶数时桶数翻倍
+static void shard_grow_buckets(ChunkCacheShard *s) {
+    int count = (s->bucket_mask + 1) * 2;
+    int *buckets = malloc(count * sizeof(int));
+    if (!buckets) {
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        buckets[i] = -1;
+    }
+    for (int i = 0; i < s->slot_count; i++) {
+        if (s->slots[i].data) {
+            int b = chunkcache_hash(&s->slots[i].id) & (count - 1);
+            s->slots[i].next = buckets[b];
+            buckets[b] = i;
+        }
+    }
+    free(s->buckets);
+    s->buckets = buckets;
+    s->bucket_mask = count - 1;
+}
+
+static int shard_alloc_slot(ChunkCacheShard *s) {
+    if (s->free_head >= 0) {
+        int idx = s->free_head;
+        s->free_head = s->slots[idx].next;
+        return idx;
+    }
+    if (s->slot_count == s->slot_cap) {
+        int cap = s->slot_cap ? s->slot_cap * 2 : CHUNKCACHE_MIN_SLOTS;
+        ChunkCacheSlot *slots = realloc(s->slots, cap * sizeof(ChunkCacheSlot));
+        if (!slots) {
+            return -1;
+        }
+        s->slots = slots;
+        s->slot_cap = cap;
+    }
+    return s->slot_count++;
+}
+
+int chunkcache_init(ChunkCache *cache, size_t capacity) {
+    memset(cache, 0, sizeof(*cache));
+    cache->capacity = capacity;
+    for (int i = 0; i < CHUNKCACHE_SHARDS; i++) {
+        ChunkCacheShard *s = &cache->shards[i];
+        pthread_mutex_init(&s->lock, NULL);
+        s->capacity = capacity / CHUNKCACHE_SHARDS;
+        s->free_head = -1;
+        s->buckets = malloc(CHUNKCACHE_MIN_BUCKETS * sizeof(int));
+        if (!s->buckets) {
+            chunkcache_free(cache);
+            return -1;
+        }
+        for (int b = 0; b < CHUNKCACHE_MIN_BUCKETS; b++) {
+            s->buckets[b] = -1;
+        }
+        s->bucket_mask = CHUNKCACHE_MIN_BUCKETS - 1;
+    }
+    return 0;
+}
+
+void chunkcache_free(ChunkCache *cache) {
+    for (int i = 0; i < CHUNKCACHE_SHARDS; i++) {
+        ChunkCacheShard *s = &cache->shards[i];
+        for (int k = 0; k < s->slot_count; k++) {
+            free(s->slots[k].data);
+        }
+        free(s->slots);
+        free(s->buckets);
+        pthread_mutex_destroy(&s->lock);
+    }
+    memset(cache, 0, sizeof(*cache));
+}
+
+unsigned char *chunkcache_get(ChunkCache *cache, const ChunkId *id, long *size) {
+    uint64_t hash = chunkcache_hash(id);
+    ChunkCacheShard *s = chunkcache_shard(cache, hash);
+    unsigned char *copy = NULL;
+    *size = 0;
+    if (!s->buckets) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    int idx = shard_find(s, id, hash);
+    if (idx >= 0) {
+        ChunkCacheSlot *slot = &s->slots[idx];
+        slot->referenced = 1;
+        copy = malloc(slot->size);
+        if (copy) {
+            memcpy(copy, slot->data, slot->size);
+            *size = slot->size;
+        }
+        s->hits++;
+    } else {
+        s->misses++;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return copy;
+}
+
+void chunkcache_put(ChunkCache *cache, const ChunkId *id, const unsigned char *data, long size) {
+    uint64_t hash = chunkcache_hash(id);
+    ChunkCacheShard *s = chunkcache_shard(cache, hash);
+    if (!s->buckets || size <= 0 || (size_t)size > s->capacity) {
+        return;
+    }
+    unsigned char *copy = malloc(size);
+    if (!copy) {
+        return;
+    }
+    memcpy(copy, data, size);
+
+    pthread_mutex_lock(&s->lock);
+    if (shard_find(s, id, hash) >= 0) {
+        pthread_mutex_unlock(&s->lock);
+        free(copy);
+        return;
+    }
+
+    // CLOCK：访问位为 1 的块清零后跳过，为 0 的块淘汰
+    while (s->bytes + size > s->capacity && s->entries > 0) {
+        if (s->hand >= s->slot_count) {
+            s->hand = 0;
+        }
+        ChunkCacheSlot *slot = &s->slots[s->hand];
+        if (slot->data) {
+            if (slot->referenced) {
+                slot->referenced = 0;
+            } else {
+                shard_release(s, s->hand);
+                s->evictions++;
+            }
+        }
+        s->hand++;
+    }
+
+    int idx = shard_alloc_slot(s);
+    if (idx < 0) {
+        pthread_mutex_unlock(&s->lock);
+        free(copy);
+        return;
+    }
+    // 新块访问位为 0：只读一次的块（如整文件恢复）先于反复访问的热点块被淘汰
+    ChunkCacheSlot *slot = &s->slots[idx];
+    slot->id = *id;
+    slot->data = copy;
+    slot->size = size;
+    slot->referenced = 0;
+    int b = hash & s->bucket_mask;
+    slot->next = s->buckets[b];
+    s->buckets[b] = idx;
+    s->entries++;
+    s->bytes += size;
+    if (s->entries > s->bucket_mask + 1) {
+        shard_grow_buckets(s);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+void chunkcache_remove(ChunkCache *cache, const ChunkId *id) {
+    uint64_t hash = chunkcache_hash(id);
+    ChunkCacheShard *s = chunkcache_shard(cache, hash);
+    if (!s->buckets) {
+        return;
+    }
+    pthread_mutex_lock(&s->lock);
+    int idx = shard_find(s, id, hash);
+    if (idx >= 0) {
+        shard_release(s, idx);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+void chunkcache_stats(ChunkCache *cache, ChunkCacheStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->capacity = cache->capacity;
+    for (int i = 0; i < CHUNKCACHE_SHARDS; i++) {
+        ChunkCacheShard *s = &cache->shards[i];
+        if (!s->buckets) {
+            continue;
+        }
+        pthread_mutex_lock(&s->lock);
+        stats->hits += s->hits;
+        stats->misses += s->misses;
+        stats->evictions += s->evictions;
+        stats->entries += s->entries;
+        stats->bytes += s->bytes;
+        pthread_mutex_unlock(&s->lock);
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+/**
+ * 服务端热点块读缓存
+ *
+ * 按块 ID（FastFp + SHA1）缓存块内容，按 FastFp 分片，每个分片独立加锁，
+ * 以 CLOCK 算法近似 LRU 淘汰，总内存不超过初始化时给定的字节数。
+ * 恢复读取等流量反复访问的热点块直接从内存返回，不再读盘。
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "chunkstore.h"
+
+#define CHUNKCACHE_SHARDS 16
+
+typedef struct {
+    ChunkId id;
+    unsigned char *data;          // NULL 表示空槽
+    long size;
+    int referenced;               // CLOCK 访问位
+    int next;                     // 哈希链中的下一个槽位，-1 结束
+} ChunkCacheSlot;
+
+typedef struct {
+    pthread_mutex_t lock;
+    ChunkCacheSlot *slots;
+    int slot_count;               // 已使用过的槽位数（含空槽）
+    int slot_cap;
+    int free_head;                // 空槽链表（复用 next 字段）
+    int *buckets;                 // 哈希桶，存槽位下标，-1 为空
+    int bucket_mask;
+    int entries;
+    int hand;                     // CLOCK 指针
+    size_t bytes;
+    size_t capacity;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} ChunkCacheShard;
+
+typedef struct {
+    ChunkCacheShard shards[CHUNKCACHE_SHARDS];
+    size_t capacity;
+} ChunkCache;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t entries;
+    size_t bytes;
+    size_t capacity;
+} ChunkCacheStats;
+
+// capacity 为全部分片合计的最大缓存字节数，为 0 时禁用缓存
+int chunkcache_init(ChunkCache *cache, size_t capacity);
+void chunkcache_free(ChunkCache *cache);
+
+// 命中时返回块内容的 malloc 副本（调用者释放），未命中返回 NULL
+unsigned char *chunkcache_get(ChunkCache *cache, const ChunkId *id, long *size);
+// 加入缓存，必要时淘汰旧块；超过单个分片容量的块不缓存
+void chunkcache_put(ChunkCache *cache, const ChunkId *id, const unsigned char *data, long size);
+// 块被删除时从缓存中移除
+void chunkcache_remove(ChunkCache *cache, const ChunkId *id);
+
+void chunkcache_stats(ChunkCache *cache, ChunkCacheStats *stats);
@@ -0,0 +1,657 @@
+// chunkstore.c - 服务端块存储
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+#include "chunkstore.h"
+#include "packstore.h"
+
+static void sha1_to_hex(const unsigned char *sha1, char *hex) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < SHA_DIGEST_LENGTH; i++) {
+        hex[i * 2] = digits[sha1[i] >> 4];
+        hex[i * 2 + 1] = digits[sha1[i] & 0xf];
+    }
+    hex[SHA_DIGEST_LENGTH * 2] = '\0';
+}
+
+static int hex_to_sha1(const char *hex, unsigned char *sha1) {
+    for (int i = 0; i < SHA_DIGEST_LENGTH * 2; i++) {
+        char c = hex[i];
+        int v;
+        if (c >= '0' && c <= '9') v = c - '0';
+        else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+        else return -1;
+        if (i % 2 == 0) sha1[i / 2] = v << 4;
+        else sha1[i / 2] |= v;
+    }
+    return 0;
+}
+
+static void chunkstore_name(const char *dir, const ChunkId *id, const char *suffix, char *out, size_t out_len) {
+    char hex[SHA_DIGEST_LENGTH * 2 + 1];
+    sha1_to_hex(id->sha1, hex);
+    snprintf(out, out_len, "%s/%016lx-%s%s", dir, id->fastfp, hex, suffix);
+}
+
+void chunkstore_path(const char *dir, const ChunkId *id, char *out, size_t out_len) {
+    chunkstore_name(dir, id, ".chunk", out, out_len);
+}
+
+static void chunkstore_tmp_path(const char *dir, const ChunkId *id, unsigned long seq, char *out, size_t out_len) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%lu.tmp", seq);
+    chunkstore_name(dir, id, suffix, out, out_len);
+}
+
+static int chunk_id_compare(const void *a, const void *b) {
+    const ChunkId *x = a, *y = b;
+    if (x->fastfp != y->fastfp) return x->fastfp < y->fastfp ? -1 : 1;
+    return memcmp(x->sha1, y->sha1, SHA_DIGEST_LENGTH);
+}
+
+// 批序号在进程内递增，启动时残留的临时文件已被清理，不会与之重名
+static unsigned long g_batch_seq = 0;
+
+static int inflight_add(ChunkInflight *inflight, const ChunkId *id, unsigned long seq) {
+    if (inflight->count == inflight->cap) {
+        int cap = inflight->cap ? inflight->cap * 2 : CHUNKSTORE_BATCH;
+        ChunkInflightEntry *entries = realloc(inflight->entries, cap * sizeof(ChunkInflightEntry));
+        if (!entries) {
+            return -1;
+        }
+        inflight->entries = entries;
+        inflight->cap = cap;
+    }
+    ChunkInflightEntry *e = &inflight->entries[inflight->count++];
+    e->id = *id;
+    e->seq = seq;
+    e->committing = 0;
+    return 0;
+}
+
+static ChunkInflightEntry *inflight_find(ChunkInflight *inflight, const ChunkId *id, unsigned long seq) {
+    for (int i = 0; i < inflight->count; i++) {
+        ChunkInflightEntry *e = &inflight->entries[i];
+        if (e->seq == seq && chunk_id_compare(&e->id, id) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void inflight_remove(ChunkInflight *inflight, const ChunkId *id, unsigned long seq) {
+    ChunkInflightEntry *e = inflight ? inflight_find(inflight, id, seq) : NULL;
+    if (e) {
+        *e = inflight->entries[--inflight->count];
+    }
+}
+
+// 其他批正在提交该块（临时文件已写完）
+static int inflight_committing(const ChunkInflight *inflight, const ChunkId *id) {
+    for (int i = 0; inflight && i < inflight->count; i++) {
+        const ChunkInflightEntry *e = &inflight->entries[i];
+        if (e->committing && chunk_id_compare(&e->id, id) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int chunkstore_parse_name(const char *name, ChunkId *id) {
+    // <16 位十六进制 fastfp>-<40 位十六进制 sha1>.chunk
+    if (strlen(name) != 16 + 1 + SHA_DIGEST_LENGTH * 2 + 6 || name[16] != '-' ||
+        strcmp(name + 17 + SHA_DIGEST_LENGTH * 2, ".chunk") != 0) {
+        return 0;
+    }
+    uint64_t fastfp = 0;
+    for (int i = 0; i < 16; i++) {
+        char c = name[i];
+        if (c >= '0' && c <= '9') fastfp = (fastfp << 4) | (uint64_t)(c - '0');
+        else if (c >= 'a' && c <= 'f') fastfp = (fastfp << 4) | (uint64_t)(c - 'a' + 10);
+        else return 0;
+    }
+    id->fastfp = fastfp;
+    return hex_to_sha1(name + 17, id->sha1) == 0;
+}
+
+unsigned char *chunkstore_read(const char *dir, const PackStore *packs, const ChunkId *id, long *size) {
+    char chunk_path[512];
+    chunkstore_path(dir, id, chunk_path, sizeof(chunk_path));
+
+    *size = 0;
+    FILE *file = fopen(chunk_path, "rb");
+    if (!file) {
+        return packs ? packstore_read(packs, id, size) : NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (len <= 0) {
+        fclose(file);
+        return NULL;
+    }
+
+    unsigned char *data = malloc(len);
+    if (!data) {
+        fclose(file);
+        return NULL;
+    }
+    if (fread(data, 1, len, file) != (size_t)len) {
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+
+    *size = len;
+    return data;
+}
+
+int chunkstore_contains(const char *dir, const PackStore *packs, const ChunkId *id) {
+    char chunk_path[512];
+    chunkstore_path(dir, id, chunk_path, sizeof(chunk_path));
+    struct stat st;
+    if (stat(chunk_path, &st) == 0) {
+        return 1;
+    }
+    const PackEntry *e = packs ? packstore_lookup(packs, id) : NULL;
+    return e && e->pack != PACKSTORE_PENDING && !e->syncing;
+}
+
+int chunkstore_remove(const char *dir, PackStore *packs, const ChunkId *id) {
+    char chunk_path[512];
+    chunkstore_path(dir, id, chunk_path, sizeof(chunk_path));
+    if (remove(chunk_path) == 0) {
+        return 0;
+    }
+    if (errno != ENOENT) {
+        return -1;
+    }
+    return packs ? packstore_remove(packs, id) : 1;
+}
+
+int chunkstore_recover(const char *dir) {
+    int removed = 0;
+    DIR *d = opendir(dir);
+    if (!d) {
+        return 0;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len > 4 && strcmp(entry->d_name + len - 4, ".tmp") == 0) {
+            char path[512];
+            snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+            if (remove(path) == 0) {
+                removed++;
+            }
+        }
+    }
+    closedir(d);
+    return removed;
+}
+
+int chunkstore_migrate(const char *dir) {
+    int migrated = 0;
+    DIR *d = opendir(dir);
+    if (!d) {
+        return 0;
+    }
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    if (!ctx) {
+        closedir(d);
+        return 0;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        ChunkId id;
+        char legacy[32];
+        // 旧格式：<16 位十六进制 fastfp>.chunk
+        if (strlen(entry->d_name) != 16 + 6 ||
+            sscanf(entry->d_name, "%016lx.chunk", &id.fastfp) != 1) {
+            continue;
+        }
+        snprintf(legacy, sizeof(legacy), "%016lx.chunk", id.fastfp);
+        if (strcmp(legacy, entry->d_name) != 0) {
+            continue;
+        }
+
+        char old_path[512], new_path[512];
+        snprintf(old_path, sizeof(old_path), "%s/%s", dir, entry->d_name);
+        int fd = open(old_path, O_RDONLY);
+        if (fd < 0) {
+            continue;
+        }
+        EVP_DigestInit_ex(ctx, EVP_sha1(), NULL);
+        unsigned char buf[65536];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            EVP_DigestUpdate(ctx, buf, n);
+        }
+        close(fd);
+        if (n < 0) {
+            continue;
+        }
+        EVP_DigestFinal_ex(ctx, id.sha1, NULL);
+
+        chunkstore_path(dir, &id, new_path, sizeof(new_path));
+        if (rename(old_path, new_path) == 0) {
+            migrated++;
+        }
+    }
+    EVP_MD_CTX_free(ctx);
+    closedir(d);
+    return migrated;
+}
+
+ChunkId *chunkstore_list(const char *dir, const PackStore *packs, int *count) {
+    int cap = 1024;
+    if (packs && packs->live_count >= cap) {
+        cap = packs->live_count * 2;
+    }
+    ChunkId *ids = malloc(cap * sizeof(ChunkId));
+    *count = 0;
+    if (!ids) {
+        return NULL;
+    }
+
+    // pack 中的块先放入数组，容量已预留
+    if (packs) {
+        *count = packstore_list(packs, ids);
+    }
+
+    DIR *d = opendir(dir);
+    if (!d) {
+        qsort(ids, *count, sizeof(ChunkId), chunk_id_compare);
+        return ids;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        ChunkId id;
+        if (chunkstore_parse_name(entry->d_name, &id)) {
+            if (*count >= cap) {
+                ChunkId *temp = realloc(ids, cap * 2 * sizeof(ChunkId));
+                if (!temp) {
+                    closedir(d);
+                    free(ids);
+                    *count = 0;
+                    return NULL;
+                }
+                ids = temp;
+                cap *= 2;
+            }
+            ids[(*count)++] = id;
+        }
+    }
+    closedir(d);
+    qsort(ids, *count, sizeof(ChunkId), chunk_id_compare);
+    return ids;
+}
+
+const ChunkId *chunkstore_find(const ChunkId *ids, int count, uint64_t fastfp) {
+    int lo = 0, hi = count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (ids[mid].fastfp < fastfp) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo < count && ids[lo].fastfp == fastfp) ? &ids[lo] : NULL;
+}
+
+static int chunkstore_filter_rebuild(const char *dir, const PackStore *packs, FpFilter *filter, uint64_t min_expected) {
+    int count = 0;
+    ChunkId *ids = chunkstore_list(dir, packs, &count);
+    if (!ids) {
+        return -1;
+    }
+
+    uint64_t expected = (uint64_t)count > min_expected ? (uint64_t)count : min_expected;
+    if (fpfilter_init(filter, expected) != 0) {
+        free(ids);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        fpfilter_add(filter, ids[i].fastfp);
+    }
+    free(ids);
+    return 0;
+}
+
+int chunkstore_filter_open(const char *dir, const PackStore *packs, FpFilter *filter) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, CHUNKSTORE_FILTER_FILE);
+
+    if (fpfilter_load(filter, path) == 0) {
+        int count = 0;
+        ChunkId *ids = chunkstore_list(dir, packs, &count);
+        int consistent = ids && (uint64_t)count == filter->count;
+        free(ids);
+        if (consistent) {
+            return 0;
+        }
+        fpfilter_free(filter);
+    }
+
+    if (chunkstore_filter_rebuild(dir, packs, filter, 0) != 0) {
+        return -1;
+    }
+    return fpfilter_save(filter, path);
+}
+
+int chunkstore_filter_sync(const char *dir, const PackStore *packs, FpFilter *filter) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, CHUNKSTORE_FILTER_FILE);
+
+    if (filter->count > fpfilter_capacity(filter)) {
+        FpFilter grown;
+        if (chunkstore_filter_rebuild(dir, packs, &grown, fpfilter_capacity(filter) * 2) != 0) {
+            return -1;
+        }
+        fpfilter_free(filter);
+        *filter = grown;
+    }
+    if (!filter->dirty) {
+        return 0;
+    }
+    return fpfilter_save(filter, path);
+}
+
+int chunkstore_batch_open(ChunkBatch *batch, const char *dir, FpFilter *filter, PackStore *packs,
+                          ChunkInflight *inflight, StoreIo *io) {
+    memset(batch, 0, sizeof(*batch));
+    batch->dir = dir;
+    batch->seq = __atomic_add_fetch(&g_batch_seq, 1, __ATOMIC_RELAXED);
+    batch->filter = filter;
+    batch->packs = packs;
+    batch->inflight = inflight;
+    batch->io = io;
+    batch->dir_fd = open(dir, O_RDONLY | O_DIRECTORY);
+    return batch->dir_fd >= 0 ? 0 : -1;
+}
+
+int chunkstore_write(ChunkBatch *batch, const ChunkId *id, const unsigned char *data, int size) {
+    // 同一批内重复的块只写一次
+    for (int i = 0; i < batch->pending_count; i++) {
+        if (chunk_id_compare(&batch->pending[i], id) == 0) {
+            return 0;
+        }
+    }
+    if (batch->pending_count >= CHUNKSTORE_BATCH && chunkstore_commit(batch) != 0) {
+        return -1;
+    }
+
+    // 已有单独块文件的不再重复保存
+    char tmp_path[512], chunk_path[512];
+    chunkstore_path(batch->dir, id, chunk_path, sizeof(chunk_path));
+    if (access(chunk_path, F_OK) == 0) {
+        return 0;
+    }
+
+    // 小块追加到 pack
+    if (batch->packs && size <= batch->packs->max_object) {
+        if (batch->packed_count == batch->packed_cap) {
+            int cap = batch->packed_cap ? batch->packed_cap * 2 : CHUNKSTORE_BATCH;
+            ChunkId *packed = realloc(batch->packed, cap * sizeof(ChunkId));
+            if (!packed) {
+                return -1;
+            }
+            batch->packed = packed;
+            batch->packed_cap = cap;
+        }
+        if (packstore_add(batch->packs, id, data, size) != 0) {
+            return -1;
+        }
+        batch->packed[batch->packed_count++] = *id;
+        return 0;
+    }
+
+    // 另一批已写完同一块、正在提交：不再写入，提交前等它完成并确认块文件存在。
+    // 另一批尚未开始提交时各自写自己的临时文件，先提交的 rename，后提交的删除临时文件
+    if (inflight_committing(batch->inflight, id)) {
+        if (batch->waiting_count == batch->waiting_cap) {
+            int cap = batch->waiting_cap ? batch->waiting_cap * 2 : CHUNKSTORE_BATCH;
+            ChunkId *waiting = realloc(batch->waiting, cap * sizeof(ChunkId));
+            if (!waiting) {
+                return -1;
+            }
+            batch->waiting = waiting;
+            batch->waiting_cap = cap;
+        }
+        batch->waiting[batch->waiting_count++] = *id;
+        return 0;
+    }
+
+    if (batch->inflight && inflight_add(batch->inflight, id, batch->seq) != 0) {
+        return -1;
+    }
+    chunkstore_tmp_path(batch->dir, id, batch->seq, tmp_path, sizeof(tmp_path));
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        inflight_remove(batch->inflight, id, batch->seq);
+        return -1;
+    }
+
+    // 异步写入：数据交给写入队列后立即返回，文件由队列关闭，提交前统一等待
+    if (batch->io) {
+        if (storeio_write(batch->io, fd, data, size, 0, &batch->io_error) != 0) {
+            close(fd);
+            remove(tmp_path);
+            inflight_remove(batch->inflight, id, batch->seq);
+            return -1;
+        }
+        batch->pending[batch->pending_count++] = *id;
+        return 0;
+    }
+
+    int written = 0;
+    while (written < size) {
+        ssize_t n = write(fd, data + written, size - written);
+        if (n <= 0) {
+            close(fd);
+            remove(tmp_path);
+            inflight_remove(batch->inflight, id, batch->seq);
+            return -1;
+        }
+        written += n;
+    }
+    if (close(fd) != 0) {
+        remove(tmp_path);
+        inflight_remove(batch->inflight, id, batch->seq);
+        return -1;
+    }
+
+    batch->pending[batch->pending_count++] = *id;
+    return 0;
+}
+
+int chunkstore_batch_full(const ChunkBatch *batch) {
+    return batch->pending_count >= CHUNKSTORE_BATCH ||
+           (batch->packs && batch->packs->buf_len >= PACKSTORE_FLUSH_BYTES);
+}
+
+int chunkstore_commit_ready(const ChunkBatch *batch) {
+    for (int i = 0; i < batch->packed_count; i++) {
+        const PackEntry *e = packstore_lookup(batch->packs, &batch->packed[i]);
+        if (e && e->syncing) {
+            return 0;
+        }
+    }
+    for (int i = 0; i < batch->waiting_count; i++) {
+        if (inflight_committing(batch->inflight, &batch->waiting[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int chunkstore_commit_begin(ChunkBatch *batch, ChunkCommit *commit) {
+    memset(commit, 0, sizeof(*commit));
+    commit->dir = batch->dir;
+    commit->dir_fd = batch->dir_fd;
+    commit->seq = batch->seq;
+    commit->filter = batch->filter;
+    commit->packs = batch->packs;
+    commit->inflight = batch->inflight;
+    commit->waiting = batch->waiting;
+    commit->waiting_count = batch->waiting_count;
+    batch->waiting = NULL;
+    batch->waiting_count = 0;
+    batch->waiting_cap = 0;
+    commit->pack.pack_fd = -1;
+    commit->pack.index_fd = -1;
+    if (batch->packs && (batch->packs->pending_count > 0 || batch->packed_count > 0)) {
+        commit->pack_status = packstore_flush_begin(batch->packs, &commit->pack);
+    }
+    commit->packed = batch->packed;
+    commit->packed_count = batch->packed_count;
+    batch->packed = NULL;
+    batch->packed_count = 0;
+    batch->packed_cap = 0;
+    if (batch->pending_count > 0) {
+        if (batch->io) {
+            storeio_wait(batch->io);
+        }
+        commit->status = batch->io_error;
+        batch->io_error = 0;
+        memcpy(commit->ids, batch->pending, batch->pending_count * sizeof(ChunkId));
+        commit->count = batch->pending_count;
+        // 临时文件已写完，其他批遇到相同的块时不再写入
+        for (int i = 0; batch->inflight && i < commit->count; i++) {
+            ChunkInflightEntry *e = inflight_find(batch->inflight, &commit->ids[i], batch->seq);
+            if (e) e->committing = 1;
+        }
+        batch->pending_count = 0;
+        batch->commits++;
+    }
+    return commit->status != 0 ? commit->status : commit->pack_status;
+}
+
+int chunkstore_commit_sync(ChunkCommit *commit) {
+    char tmp_path[512];
+    // 整批共享一次 syncfs；不支持时退回逐个 fsync
+    if (commit->count > 0 && commit->status == 0 && syncfs(commit->dir_fd) != 0) {
+        for (int i = 0; i < commit->count; i++) {
+            chunkstore_tmp_path(commit->dir, &commit->ids[i], commit->seq, tmp_path, sizeof(tmp_path));
+            int fd = open(tmp_path, O_RDONLY);
+            if (fd < 0 || fsync(fd) != 0) commit->status = -1;
+            if (fd >= 0) close(fd);
+        }
+    }
+    if (commit->pack_status == 0 && packstore_flush_sync(&commit->pack) != 0) {
+        commit->pack_status = -1;
+    }
+    return commit->status != 0 ? commit->status : commit->pack_status;
+}
+
+int chunkstore_commit_finish(ChunkCommit *commit) {
+    if (commit->packs &&
+        packstore_flush_finish(commit->packs, &commit->pack, commit->pack_status == 0, commit->filter) != 0) {
+        commit->pack_status = -1;
+    }
+    // 本批的小块可能由其他批的提交写出，逐个确认已记入索引
+    for (int i = 0; i < commit->packed_count; i++) {
+        const PackEntry *e = packstore_lookup(commit->packs, &commit->packed[i]);
+        if (!e || e->pack == PACKSTORE_PENDING || e->syncing) {
+            commit->pack_status = -1;
+        }
+    }
+    free(commit->packed);
+    commit->packed = NULL;
+    commit->packed_count = 0;
+
+    char tmp_path[512], chunk_path[512];
+    for (int i = 0; i < commit->count; i++) {
+        chunkstore_tmp_path(commit->dir, &commit->ids[i], commit->seq, tmp_path, sizeof(tmp_path));
+        chunkstore_path(commit->dir, &commit->ids[i], chunk_path, sizeof(chunk_path));
+        if (commit->status != 0) {
+            remove(tmp_path);
+        } else if (access(chunk_path, F_OK) == 0) {
+            // 并发的另一批先提交了相同的块，不覆盖已发布的块文件
+            remove(tmp_path);
+        } else if (rename(tmp_path, chunk_path) != 0) {
+            remove(tmp_path);
+            commit->status = -1;
+        } else if (commit->filter) {
+            fpfilter_add(commit->filter, commit->ids[i].fastfp);
+        }
+        inflight_remove(commit->inflight, &commit->ids[i], commit->seq);
+    }
+    // 本批跳过的块由其他批提交，确认块文件已发布
+    for (int i = 0; i < commit->waiting_count; i++) {
+        chunkstore_path(commit->dir, &commit->waiting[i], chunk_path, sizeof(chunk_path));
+        if (access(chunk_path, F_OK) != 0) {
+            commit->status = -1;
+        }
+    }
+    free(commit->waiting);
+    commit->waiting = NULL;
+    commit->waiting_count = 0;
+    return commit->status != 0 ? commit->status : commit->pack_status;
+}
+
+int chunkstore_commit_end(ChunkCommit *commit) {
+    // 持久化目录项
+    if (commit->count > 0 && fsync(commit->dir_fd) != 0) {
+        commit->status = -1;
+    }
+    if (packstore_flush_end(&commit->pack) != 0) {
+        commit->pack_status = -1;
+    }
+    return commit->status != 0 ? commit->status : commit->pack_status;
+}
+
+int chunkstore_commit(ChunkBatch *batch) {
+    ChunkCommit commit;
+    chunkstore_commit_begin(batch, &commit);
+    chunkstore_commit_sync(&commit);
+    chunkstore_commit_finish(&commit);
+    return chunkstore_commit_end(&commit);
+}
+
+int chunkstore_batch_close(ChunkBatch *batch) {
+    int ret = 0;
+    if (batch->io && batch->pending_count > 0) {
+        storeio_wait(batch->io);
+    }
+    for (int i = 0; i < batch->pending_count; i++) {
+        char tmp_path[512];
+        chunkstore_tmp_path(batch->dir, &batch->pending[i], batch->seq, tmp_path, sizeof(tmp_path));
+        remove(tmp_path);
+        inflight_remove(batch->inflight, &batch->pending[i], batch->seq);
+        ret = -1;
+    }
+    batch->pending_count = 0;
+    if (batch->waiting_count > 0) {
+        ret = -1;
+    }
+    free(batch->waiting);
+    batch->waiting = NULL;
+    batch->waiting_count = 0;
+    batch->waiting_cap = 0;
+    if (batch->packed_count > 0) {
+        ret = -1;
+    }
+    free(batch->packed);
+    batch->packed = NULL;
+    batch->packed_count = 0;
+    batch->packed_cap = 0;
+    if (batch->dir_fd >= 0) {
+        close(batch->dir_fd);
+        batch->dir_fd = -1;
+    }
+    return ret;
+}
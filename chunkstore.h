@@ -0,0 +1,150 @@
+#pragma once
+/**
+ * 服务端块存储接口
+ *
+ * 每个块以 "<fastfp>-<sha1>.chunk" 的形式保存在存储目录下：块由 SHA1 唯一确定，
+ * FastFp 只作为文件名前缀上的快速索引，FastFp 相同而内容不同的块可以共存。
+ * 写入先落到 "<fastfp>-<sha1>.<批序号>.tmp"（每个批各自的临时文件，并发上传同一块的批互不覆盖），
+ * 批量提交时一次 syncfs 后再统一 rename，崩溃后不会留下残缺的 .chunk 文件，残留的 .tmp 在启动时清理。
+ * 块文件已存在，或另一批正在提交同一块时不再重复写入（见 ChunkInflight）。
+ * 提交可以分步执行（chunkstore_commit_begin 等），syncfs/fsync 的两步不访问共享状态，
+ * 服务端在这两步释放存储锁，其他连接的读写不必等待磁盘同步。
+ * 已存储块的 FastFp 同时记录在计数布隆过滤器中，随存储目录一起持久化。
+ * 传入 PackStore 时，不超过其 max_object 的小块打包存储（见 packstore.h），
+ * 读取、删除和列举同时覆盖单独的块文件与 pack 中的块。
+ * 传入 StoreIo 时临时文件的写入交给异步写入队列（见 storeio.h），提交时等待全部完成。
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <openssl/sha.h>
+#include "fpfilter.h"
+#include "storeio.h"
+
+// 每批最多累积的块数，达到后自动提交
+#define CHUNKSTORE_BATCH 64
+#define CHUNKSTORE_FILTER_FILE "fastfp.filter"
+
+typedef struct PackStore PackStore;
+
+// 一次在途的 pack flush（packstore_flush_begin 填写，见 packstore.h）
+typedef struct {
+    struct PackPending *pending;         // 取走的待写条目
+    int pending_count;
+    uint32_t pack;                       // 写入的 pack 编号
+    int pack_fd;                         // 写入的 pack，sync 时 fsync
+    int index_fd;                        // 索引日志的独立描述符，end 时 fsync
+    int new_pack;                        // 新建的 pack 文件，sync 时同步目录
+    char dir[256];
+} PackFlush;
+
+typedef struct {
+    uint64_t fastfp;
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+} ChunkId;
+
+typedef struct {
+    ChunkId id;
+    unsigned long seq;                   // 所在的批
+    int committing;                      // 批已开始提交，临时文件已写完
+} ChunkInflightEntry;
+
+// 所有批已写入临时文件、尚未 rename 的块文件，由所有批共享，调用者在存储锁下使用
+typedef struct {
+    ChunkInflightEntry *entries;
+    int count;
+    int cap;
+} ChunkInflight;
+
+typedef struct {
+    const char *dir;
+    int dir_fd;
+    unsigned long seq;                   // 批序号，区分各批的临时文件
+    FpFilter *filter;                    // 提交成功的新块加入过滤器，可为 NULL
+    PackStore *packs;                    // 小块打包存储，可为 NULL
+    ChunkInflight *inflight;             // 在途的块文件，可为 NULL（不与其他批协调）
+    StoreIo *io;                         // 异步写入队列，为 NULL 时同步写入
+    int io_error;                        // 本批有异步写入失败
+    ChunkId pending[CHUNKSTORE_BATCH];   // 已写入临时文件、尚未提交的块
+    int pending_count;
+    ChunkId *waiting;                    // 另一批正在提交、本批未写入的块
+    int waiting_count;
+    int waiting_cap;
+    ChunkId *packed;                     // 放入 pack 待写缓冲、尚未确认持久化的块
+    int packed_count;
+    int packed_cap;
+    long commits;                        // 已执行的批量提交次数
+} ChunkBatch;
+
+// 一次分步提交，begin 取走批中待提交的块后，批可以继续写入
+typedef struct {
+    const char *dir;
+    int dir_fd;                          // 批的目录描述符，批在 end 之后才能关闭
+    unsigned long seq;
+    FpFilter *filter;
+    PackStore *packs;
+    ChunkInflight *inflight;
+    ChunkId ids[CHUNKSTORE_BATCH];       // 待 rename 的块
+    int count;
+    ChunkId *waiting;                    // finish 时确认已由其他批提交的块
+    int waiting_count;
+    ChunkId *packed;                     // finish 时确认已持久化的 pack 中的块
+    int packed_count;
+    PackFlush pack;
+    int status;                          // 块文件部分的结果，-1 表示已失败
+    int pack_status;                     // pack 部分的结果
+} ChunkCommit;
+
+// 生成块文件路径
+void chunkstore_path(const char *dir, const ChunkId *id, char *out, size_t out_len);
+// 解析块文件名，是块文件返回 1
+int chunkstore_parse_name(const char *name, ChunkId *id);
+
+// 读取整个块，返回 malloc 的缓冲区（调用者释放），块不存在或读取失败返回 NULL
+unsigned char *chunkstore_read(const char *dir, const PackStore *packs, const ChunkId *id, long *size);
+
+// 块已持久化时返回 1（单独的块文件，或 pack 中已落盘的块），与 chunkstore_list 的结果一致
+int chunkstore_contains(const char *dir, const PackStore *packs, const ChunkId *id);
+
+// 删除单个块，成功返回 0，块不存在返回 1，其他错误返回 -1
+int chunkstore_remove(const char *dir, PackStore *packs, const ChunkId *id);
+
+// 删除上次崩溃遗留的临时文件，返回删除个数
+int chunkstore_recover(const char *dir);
+// 把旧格式 "<fastfp>.chunk" 的块按内容 SHA1 重命名为新格式，返回迁移个数
+int chunkstore_migrate(const char *dir);
+
+// 列出目录中所有块（含 pack 中的块），按 FastFp 排序，返回 malloc 的数组（调用者释放）
+ChunkId *chunkstore_list(const char *dir, const PackStore *packs, int *count);
+// 在 chunkstore_list 的结果中二分查找 FastFp，返回第一个匹配的块，没有返回 NULL
+const ChunkId *chunkstore_find(const ChunkId *ids, int count, uint64_t fastfp);
+
+// 加载持久化的过滤器，缺失或与目录中的块数不一致时按目录重建
+int chunkstore_filter_open(const char *dir, const PackStore *packs, FpFilter *filter);
+// 保存过滤器；元素数超过容量时先按目录重建为更大的过滤器
+int chunkstore_filter_sync(const char *dir, const PackStore *packs, FpFilter *filter);
+
+// 批量写入：open 后 write 多次，chunkstore_batch_full 为真时提交，最后提交剩余的块再 close
+int chunkstore_batch_open(ChunkBatch *batch, const char *dir, FpFilter *filter, PackStore *packs,
+                          ChunkInflight *inflight, StoreIo *io);
+// 批已满时先自动提交（整个提交在调用者的锁内完成，分步提交的调用者应先检查 chunkstore_batch_full）
+int chunkstore_write(ChunkBatch *batch, const ChunkId *id, const unsigned char *data, int size);
+// 待提交的块达到 CHUNKSTORE_BATCH，或共享的 pack 待写缓冲达到 PACKSTORE_FLUSH_BYTES 时返回 1
+int chunkstore_batch_full(const ChunkBatch *batch);
+// 依次执行下面四步提交，整个过程需要独占存储
+int chunkstore_commit(ChunkBatch *batch);
+// pack 待写缓冲由所有批共享，本批的小块可能已被其他批的提交取走、正在 fsync；本批跳过的块文件
+// 也可能仍在其他批的提交中。这时返回 0，调用者应等那次提交 finish 之后再 begin，否则返回 1
+int chunkstore_commit_ready(const ChunkBatch *batch);
+// 分步提交，每步返回到目前为止的结果（0 或 -1），无论之前是否失败都要执行完四步：
+//   begin  （访问共享状态）等待写入队列，取走待提交的块，pack 待写缓冲写入 pack 文件
+//   sync   （不访问共享状态）syncfs，不支持时逐个 fsync 临时文件与 pack
+//   finish （访问共享状态）rename 临时文件（块文件已由其他批提交时删除临时文件）、追加 pack 索引记录，
+//          新块加入过滤器
+//   end    （不访问共享状态）fsync 目录与 pack 索引，返回最终结果
+int chunkstore_commit_begin(ChunkBatch *batch, ChunkCommit *commit);
+int chunkstore_commit_sync(ChunkCommit *commit);
+int chunkstore_commit_finish(ChunkCommit *commit);
+int chunkstore_commit_end(ChunkCommit *commit);
+// 关闭批（访问共享状态）；仍未提交的块视为失败，删除其临时文件并返回 -1
+int chunkstore_batch_close(ChunkBatch *batch);
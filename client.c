@@ -1,4 +1,5 @@
 // client.c - 客户端代码
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,6 +12,10 @@
 #include <openssl/md5.h>
 #include <time.h>
 #include <errno.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <signal.h>
 
 #define DEFAULT_SERVER_PORT 8082
 #define DEFAULT_SERVER_PORT1 8081
@@ -20,18 +25,22 @@
 #define SERVER3_ID 3
 #define SERVER4_ID 4
 #define NUM_SERVERS 4
+#define RECIPE_DIR "./recipes"
+#define RANGE_CACHE_SLOTS 16
+#define FPCACHE_FILE "./fpcache.db"
+#define BATCH_MAX_FILES 256                 // 批量模式每组最多文件数
+#define BATCH_MAX_BYTES (64 * 1024 * 1024)  // 批量模式每组数据量上限
+#define BATCH_DEFAULT_THREADS 4
+#define BATCH_MAX_THREADS 64
+#define POOL_MAX_CONNECTIONS 16             // 连接池中不同服务器地址的上限
 
 #include "fastcdc.h"
-
-typedef struct {
-    uint64_t fastfp;
-    int server_id;  // 服务器ID (1 或 2)
-} FastFpData;
-
-typedef struct {
-    FastFpData *fastfps;
-    int count;
-} FastFpList;
+#include "recipe.h"
+#include "fpfilter.h"
+#include "fpcache.h"
+#include "dedup_proto.h"
+#include "mux.h"
+#include "dlog.h"
 
 // FastCDC 实现在 fastcdc.c 中
 
@@ -42,6 +51,22 @@ void calculate_sha1(const unsigned char *data, size_t len, unsigned char *sha1_h
     SHA1(data, len, sha1_hash);
 }
 
+// 本进程在所有连接上收发的字节数，用于统计网络开销；各服务器的会话并发执行，计数用原子加
+static long long g_wire_sent = 0, g_wire_received = 0;
+// 当前线程通信的服务器（0-based，-1 表示不按服务器统计）及与每个服务器收发的字节数
+static __thread int g_wire_server = -1;
+static long long g_server_sent[NUM_SERVERS], g_server_received[NUM_SERVERS];
+
+static void count_wire_sent(int bytes) {
+    __atomic_fetch_add(&g_wire_sent, bytes, __ATOMIC_RELAXED);
+    if (g_wire_server >= 0) __atomic_fetch_add(&g_server_sent[g_wire_server], bytes, __ATOMIC_RELAXED);
+}
+
+static void count_wire_received(int bytes) {
+    __atomic_fetch_add(&g_wire_received, bytes, __ATOMIC_RELAXED);
+    if (g_wire_server >= 0) __atomic_fetch_add(&g_server_received[g_wire_server], bytes, __ATOMIC_RELAXED);
+}
+
 // 确保所有数据都发送完成
 int send_all(int socket, const void *buffer, size_t length) {
     const char *buf = (const char *)buffer;
@@ -53,6 +78,7 @@ int send_all(int socket, const void *buffer, size_t length) {
             return result;
         }
         sent += result;
+        count_wire_sent(result);
     }
     return sent;
 }
@@ -74,6 +100,7 @@ int recv_all(int socket, void *buffer, size_t length) {
             return -1;
         }
         received += result;
+        count_wire_received(result);
     }
     return received;
 }
@@ -118,30 +145,139 @@ int connect_to_server(const char* ip, int port) {
     return sock;
 }
 
-// 发送文件数据到服务器
-void send_file_data(int sock, const char* filename) {
+// 连接池：每个服务器一条以 CMD_MUX 开始的长连接，会话和命令各占其上的一个逻辑流，
+// 同一进程中的多次会话（配对模式、批量备份、恢复读取）不再重复建立 TCP 连接
+typedef struct {
+    char ip[64];
+    int port;
+    MuxConn *conn;
+} PooledConnection;
+
+static PooledConnection g_pool[POOL_MAX_CONNECTIONS];
+static int g_pool_count = 0;
+static pthread_mutex_t g_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// 在到服务器的长连接上新开一个逻辑流，返回值与 connect_to_server 一样当作 socket 使用，用完 close
+int open_server_stream(const char* ip, int port) {
+    pthread_mutex_lock(&g_pool_lock);
+    PooledConnection *pc = NULL;
+    for (int i = 0; i < g_pool_count; i++) {
+        if (g_pool[i].port == port && strcmp(g_pool[i].ip, ip) == 0) {
+            pc = &g_pool[i];
+            break;
+        }
+    }
+    if (!pc && g_pool_count < POOL_MAX_CONNECTIONS) {
+        pc = &g_pool[g_pool_count++];
+        snprintf(pc->ip, sizeof(pc->ip), "%s", ip);
+        pc->port = port;
+        pc->conn = NULL;
+    }
+    if (!pc) {
+        // 地址过多时退回独立连接
+        pthread_mutex_unlock(&g_pool_lock);
+        return connect_to_server(ip, port);
+    }
+
+    int fd = pc->conn ? mux_stream(pc->conn) : -1;
+    if (fd < 0) {
+        // 首次使用或连接已断开（如服务器重启），重新建立
+        if (pc->conn) {
+            mux_close(pc->conn);
+            pc->conn = NULL;
+        }
+        int sock = connect_to_server(ip, port);
+        if (sock >= 0) {
+            pc->conn = mux_open(sock);
+            if (!pc->conn) {
+                printf("Failed to open multiplexed connection to %s:%d\n", ip, port);
+                close(sock);
+            }
+        }
+        fd = pc->conn ? mux_stream(pc->conn) : -1;
+    }
+    pthread_mutex_unlock(&g_pool_lock);
+    return fd;
+}
+
+// 进程退出时关闭连接池中的所有连接
+void close_server_connections(void) {
+    pthread_mutex_lock(&g_pool_lock);
+    for (int i = 0; i < g_pool_count; i++) {
+        if (g_pool[i].conn) {
+            mux_close(g_pool[i].conn);
+        }
+    }
+    g_pool_count = 0;
+    pthread_mutex_unlock(&g_pool_lock);
+}
+
+// 读取整个本地文件，返回 malloc 的缓冲区（调用者释放）
+static unsigned char *read_local_file(const char *filename, size_t *size) {
+    FILE* local_file = fopen(filename, "rb");
+    if (!local_file) {
+        perror("Cannot open local file");
+        return NULL;
+    }
+    
+    unsigned char *fileCache = malloc(MAX_CACHE_SIZE);
+    if (!fileCache) {
+        perror("Memory allocation failed");
+        fclose(local_file);
+        return NULL;
+    }
+    
+    *size = fread(fileCache, 1, MAX_CACHE_SIZE, local_file);
+    fclose(local_file);
+    
+    if (*size == 0) {
+        printf("File is empty\n");
+        free(fileCache);
+        return NULL;
+    }
+    return fileCache;
+}
+
+// 会话文件名，也是服务端清单的键：当前目录加上文件名。配方按当前目录下的文件名保存，
+// 清单因此与配方一一对应，在不同目录中运行的客户端上传同名文件时互不覆盖
+static void session_name_for(const char *filename, char *out, size_t out_len) {
+    char cwd[DEDUP_MAX_NAME];
+    if (filename[0] == '/' || !getcwd(cwd, sizeof(cwd))) {
+        snprintf(out, out_len, "%s", filename);
+    } else {
+        snprintf(out, out_len, "%s/%s", cwd, filename);
+    }
+}
+
+// 发送文件数据到服务器；with_content 为 0 时只发送文件名和长度为 0 的内容
+void send_file_data(int sock, const char* filename, int with_content) {
     FILE* file = fopen(filename, "rb");
     if (!file) {
         perror("Cannot open file");
         return;
     }
     
-    int name_len = strlen(filename);
+    char name[DEDUP_MAX_NAME + 1];
+    session_name_for(filename, name, sizeof(name));
+    int name_len = strlen(name);
     if (send_all(sock, &name_len, sizeof(int)) <= 0) {
         printf("Failed to send filename length\n");
         fclose(file);
         return;
     }
-    if (send_all(sock, filename, name_len) <= 0) {
+    if (send_all(sock, name, name_len) <= 0) {
         printf("Failed to send filename\n");
         fclose(file);
         return;
     }
     
     // 先计算文件大小
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    long file_size = 0;
+    if (with_content) {
+        fseek(file, 0, SEEK_END);
+        file_size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+    }
     
     // 发送文件大小
     if (send_all(sock, &file_size, sizeof(long)) <= 0) {
@@ -154,7 +290,7 @@ void send_file_data(int sock, const char* filename) {
     unsigned char buffer[4096];
     size_t bytes_read;
     long total_sent = 0;
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    while (total_sent < file_size && (bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
         if (send_all(sock, buffer, bytes_read) <= 0) {
             printf("Failed to send file content\n");
             break;
@@ -165,40 +301,20 @@ void send_file_data(int sock, const char* filename) {
     fclose(file);
 }
 
-// 接收服务器的FastFp列表
-FastFpList receive_fastfp_list(int sock) {
-    FastFpList result = {NULL, 0};
-    
-    // 接收列表大小
-    if (recv_all(sock, &result.count, sizeof(int)) <= 0) {
-        printf("Failed to receive FastFp list size\n");
-        return result;
-    }
-    
-    if (result.count > 0) {
-        result.fastfps = malloc(result.count * sizeof(FastFpData));
-        if (result.fastfps) {
-            if (recv_all(sock, result.fastfps, result.count * sizeof(FastFpData)) <= 0) {
-                printf("Failed to receive FastFp list\n");
-                free(result.fastfps);
-                result.fastfps = NULL;
-                result.count = 0;
-            }
-        }
-    }
-    
-    return result;
-}
-
-// 发送匹配成功的FastFp列表
-void send_matching_fastfps(int sock, FastFpData *matching_fastfps, int count) {
+// 发送候选块列表：每条 { FastFp, SHA1 }，服务端逐条精确查找
+void send_candidate_chunks(int sock, const int *candidates, int count,
+                           const uint64_t *local_fastfps, const unsigned char *chunk_sha1) {
     if (send_all(sock, &count, sizeof(int)) <= 0) {
-        printf("Failed to send matching count\n");
+        printf("Failed to send candidate count\n");
         return;
     }
-    if (count > 0) {
-        if (send_all(sock, matching_fastfps, count * sizeof(FastFpData)) <= 0) {
-            printf("Failed to send matching FastFps\n");
+    unsigned char record[DEDUP_CHUNK_RECORD_SIZE];
+    for (int i = 0; i < count; i++) {
+        memcpy(record, &local_fastfps[candidates[i]], sizeof(uint64_t));
+        memcpy(record + sizeof(uint64_t), chunk_sha1 + (size_t)candidates[i] * SHA_DIGEST_LENGTH, SHA_DIGEST_LENGTH);
+        if (send_all(sock, record, sizeof(record)) <= 0) {
+            printf("Failed to send candidate chunks\n");
+            return;
         }
     }
 }
@@ -225,131 +341,111 @@ int receive_sha1_hashes(int sock, unsigned char *sha1_hashes, int chunk_count) {
             return -1;
         }
         total_received += result;
+        count_wire_received(result);
     }
     
     return 0;
 }
 
-// 发送新块到服务器
-void send_new_chunks(int server_sock, unsigned char *fileCache, 
-                     int *boundary, uint64_t *local_fastfps, int chunk_num, FastFpData *upload_fastfps, 
-                     int upload_count) {
+// 发送新块到服务器，每块附带 SHA1 供服务端校验；服务端全部接受返回 0，否则返回 -1
+int send_new_chunks(int server_sock, const unsigned char *fileCache, const int *boundary, const size_t *offsets,
+                    const uint64_t *local_fastfps, const unsigned char *chunk_sha1,
+                    const int *uploads, int upload_count) {
     if (send_all(server_sock, &upload_count, sizeof(int)) <= 0) {
         printf("Failed to send upload count\n");
-        return;
+        return -1;
     }
     
     printf("Sending %d chunks to server\n", upload_count);
     
     for (int i = 0; i < upload_count; i++) {
-        uint64_t fastfp = upload_fastfps[i].fastfp;
-        
-        // 在本地FastFp数组中找到对应索引（应在所有块中查找）
-        int chunk_idx = -1;
-        for (int j = 0; j < chunk_num; j++) {
-            if (local_fastfps[j] == fastfp) {
-                chunk_idx = j;
-                break;
-            }
-        }
-        
-        if (chunk_idx == -1) {
-            printf("Warning: could not locate chunk for FastFp 0x%016lx in local list\n", fastfp);
-            continue;
-        }
-        
-        int calc_offset = 0;
-        for (int j = 0; j < chunk_idx; j++) {
-            calc_offset += boundary[j];
-        }
-        
-        if (send_all(server_sock, &fastfp, sizeof(uint64_t)) <= 0) {
+        int chunk_idx = uploads[i];
+        uint64_t fastfp = local_fastfps[chunk_idx];
+        if (send_all(server_sock, &fastfp, sizeof(uint64_t)) <= 0 ||
+            send_all(server_sock, chunk_sha1 + (size_t)chunk_idx * SHA_DIGEST_LENGTH, SHA_DIGEST_LENGTH) <= 0) {
             printf("Failed to send FastFp to server\n");
-            return;
+            return -1;
         }
         
         if (send_all(server_sock, &boundary[chunk_idx], sizeof(int)) <= 0) {
             printf("Failed to send chunk size to server\n");
-            return;
+            return -1;
         }
         
-        if (send_all(server_sock, fileCache + calc_offset, boundary[chunk_idx]) <= 0) {
+        if (send_all(server_sock, fileCache + offsets[chunk_idx], boundary[chunk_idx]) <= 0) {
             printf("Failed to send chunk data to server\n");
-            return;
+            return -1;
         }
         
-        printf("Sent chunk (FastFp: 0x%016lx, size: %d) to server\n", 
-               fastfp, boundary[chunk_idx]);
+        dlog_debug("Sent chunk (FastFp: 0x%016lx, size: %d) to server\n",
+                   fastfp, boundary[chunk_idx]);
+    }
+    
+    // 服务端回复 SHA1 校验未通过的块数，出错时为 -1
+    int status = 0;
+    if (recv_all(server_sock, &status, sizeof(int)) <= 0) {
+        printf("Failed to receive upload status\n");
+        return -1;
+    }
+    if (status != 0) {
+        printf("Server rejected upload (status %d)\n", status);
+        return -1;
     }
+    return 0;
 }
 
-// 通用工具函数，抽象重复逻辑
-static int send_current_fastfp_list_to_server(int sock, const uint64_t *local_fastfps, int chunk_num) {
-    if (send_all(sock, &chunk_num, sizeof(int)) <= 0) {
+// 请求服务器的 FastFp 布隆过滤器；失败时 bits 为 NULL，匹配时按“可能存在”处理
+static int receive_server_filter(int sock, FpFilterBits *out) {
+    out->bits = NULL;
+    int cmd = CMD_GET_FILTER;
+    if (send_all(sock, &cmd, sizeof(int)) <= 0 ||
+        recv_all(sock, &out->log2_size, sizeof(uint32_t)) <= 0 ||
+        out->log2_size < FPFILTER_MIN_LOG2 || out->log2_size > 31) {
         return -1;
     }
-    if (chunk_num > 0) {
-        if (send_all(sock, local_fastfps, chunk_num * sizeof(uint64_t)) <= 0) {
-            return -1;
-        }
+    out->bits = malloc(fpfilter_bits_bytes(out->log2_size));
+    if (!out->bits) return -1;
+    if (recv_all(sock, out->bits, fpfilter_bits_bytes(out->log2_size)) <= 0) {
+        fpfilter_bits_free(out);
+        return -1;
     }
     return 0;
 }
 
-static void find_matches_for_server(const FastFpList *remote, const uint64_t *local_fastfps,
-                                    int chunk_num, FastFpData *out_matches, int *out_count) {
+// 只查询归属于该服务器、且其布隆过滤器判定可能存在的块；过滤器不可用时查询全部归属块
+static void find_candidates_for_server(const FpFilterBits *filter, const uint64_t *local_fastfps,
+                                       const int *owner, int server_idx, int chunk_num,
+                                       int *out_candidates, int *out_count) {
     int cnt = 0;
     for (int i = 0; i < chunk_num; i++) {
-        uint64_t current_fastfp = local_fastfps[i];
-        for (int j = 0; j < remote->count; j++) {
-            if (remote->fastfps[j].fastfp == current_fastfp) {
-                out_matches[cnt].fastfp = current_fastfp;
-                out_matches[cnt].server_id = remote->fastfps[j].server_id;
-                cnt++;
-                break;
-            }
-        }
+        if (owner[i] != server_idx) continue;
+        if (filter->bits && !fpfilter_bits_maybe_contains(filter, local_fastfps[i])) continue;
+        out_candidates[cnt++] = i;
     }
     *out_count = cnt;
 }
 
-static int receive_and_verify_sha1_for_server(int sock,
-                                              const FastFpData *matching_fastfps, int match_count,
-                                              const unsigned char *fileCache,
-                                              const int *boundary, int chunk_num,
-                                              const uint64_t *local_fastfps,
+// 服务端对每个候选块回复其 SHA1（不存在时为全 0），与本地 SHA1 一致的块标记为已验证
+static int receive_and_verify_sha1_for_server(int sock, const int *candidates, int candidate_count,
+                                              const unsigned char *chunk_sha1,
                                               int *verified_out, // size chunk_num, 0/1
                                               int *actual_matches_out) {
     *actual_matches_out = 0;
-    if (match_count <= 0) return 0;
+    if (candidate_count <= 0) return 0;
 
-    unsigned char *sha1_hashes = (unsigned char *)malloc(match_count * SHA_DIGEST_LENGTH);
+    unsigned char *sha1_hashes = (unsigned char *)malloc(candidate_count * SHA_DIGEST_LENGTH);
     if (!sha1_hashes) return -1;
 
-    if (receive_sha1_hashes(sock, sha1_hashes, match_count) != 0) {
+    if (receive_sha1_hashes(sock, sha1_hashes, candidate_count) != 0) {
         free(sha1_hashes);
         // 接收失败，不标记验证，通过上层逻辑重新上传
         return -1;
     }
 
-    for (int i = 0; i < match_count; i++) {
-        uint64_t fastfp = matching_fastfps[i].fastfp;
-        int chunk_idx = -1;
-        int offset = 0;
-        for (int j = 0; j < chunk_num; j++) {
-            if (local_fastfps[j] == fastfp) { chunk_idx = j; break; }
-            offset += boundary[j];
-        }
-        if (chunk_idx < 0) continue;
-
-        unsigned char local_sha1[SHA_DIGEST_LENGTH];
-        calculate_sha1(fileCache + offset, boundary[chunk_idx], local_sha1);
-
-        int match = 1;
-        for (int k = 0; k < SHA_DIGEST_LENGTH; k++) {
-            if (sha1_hashes[i * SHA_DIGEST_LENGTH + k] != local_sha1[k]) { match = 0; break; }
-        }
-        if (match) {
+    for (int i = 0; i < candidate_count; i++) {
+        int chunk_idx = candidates[i];
+        const unsigned char *local_sha1 = chunk_sha1 + (size_t)chunk_idx * SHA_DIGEST_LENGTH;
+        if (memcmp(sha1_hashes + i * SHA_DIGEST_LENGTH, local_sha1, SHA_DIGEST_LENGTH) == 0) {
             verified_out[chunk_idx] = 1;
             (*actual_matches_out)++;
         }
@@ -359,214 +455,549 @@ static int receive_and_verify_sha1_for_server(int sock,
     return 0;
 }
 
-// 客户端主逻辑
-int process_file_on_client(const char* filename, const char* server1_ip, int server1_port, 
-                          const char* server2_ip, int server2_port,
-                          const char* server3_ip, int server3_port,
-                          const char* server4_ip, int server4_port) {
-    printf("Starting distributed FastCDC client for file: %s\n", filename);
-    
-    // 连接到四个服务器
-    int server1_sock = connect_to_server(server1_ip, server1_port);
-    int server2_sock = connect_to_server(server2_ip, server2_port);
-    int server3_sock = connect_to_server(server3_ip, server3_port);
-    int server4_sock = connect_to_server(server4_ip, server4_port);
-    
-    if (server1_sock < 0 || server2_sock < 0 || server3_sock < 0 || server4_sock < 0) {
-        printf("Failed to connect to one or more servers\n");
-        if (server1_sock >= 0) close(server1_sock);
-        if (server2_sock >= 0) close(server2_sock);
-        if (server3_sock >= 0) close(server3_sock);
-        if (server4_sock >= 0) close(server4_sock);
-        return -1;
+// 由文件名生成配方路径（路径分隔符替换为 '_'）
+static void recipe_path_for(const char *filename, char *out, size_t out_len) {
+    char name[256];
+    snprintf(name, sizeof(name), "%s", filename);
+    for (char *c = name; *c; c++) {
+        if (*c == '/') *c = '_';
     }
-    
-    printf("Connected to all 4 servers successfully\n");
-    int socks[NUM_SERVERS] = {server1_sock, server2_sock, server3_sock, server4_sock};
-    
-    for (int s = 0; s < NUM_SERVERS; ++s) {
-        set_socket_timeout(socks[s], 60);
+    snprintf(out, out_len, "%s/%s.recipe", RECIPE_DIR, name);
+}
+
+// 保存文件配方：已验证的块记录其所在服务器，新块记录其归属服务器
+static int save_file_recipe(const char *filename, size_t fileSize, const int *boundary,
+                            const uint64_t *local_fastfps, const unsigned char *chunk_sha1,
+                            const int *owner, int chunk_num, int *const *verified) {
+    Recipe recipe;
+    recipe.file_size = fileSize;
+    recipe.count = chunk_num;
+    recipe.entries = calloc(chunk_num > 0 ? chunk_num : 1, sizeof(RecipeEntry));
+    if (!recipe.entries) return -1;
+
+    uint64_t offset = 0;
+    for (int i = 0; i < chunk_num; i++) {
+        RecipeEntry *e = &recipe.entries[i];
+        e->offset = offset;
+        e->fastfp = local_fastfps[i];
+        e->size = boundary[i];
+        e->server_id = owner[i] + 1;
+        for (int s = 0; s < NUM_SERVERS; ++s) {
+            if (verified[s] && verified[s][i]) { e->server_id = s + 1; break; }
+        }
+        memcpy(e->sha1, chunk_sha1 + i * SHA_DIGEST_LENGTH, SHA_DIGEST_LENGTH);
+        offset += boundary[i];
     }
-    
-    // 向四个服务器发送文件信息
-    printf("Sending file info to servers...\n");
+
+    char path[512];
+    recipe_path_for(filename, path, sizeof(path));
+    mkdir(RECIPE_DIR, 0755);
+    int ret = recipe_save(path, &recipe);
+    if (ret == 0) {
+        printf("Saved recipe to %s (%d chunks)\n", path, chunk_num);
+    }
+    free(recipe.entries);
+    return ret;
+}
+
+// ------------------ 会话计时 ------------------
+// 每次去重会话按阶段计时，并统计与每个服务器的收发字节和块数，会话结束时输出一行 JSON
+
+typedef enum {
+    PHASE_CONNECT,            // 打开会话流
+    PHASE_EXCHANGE,           // 布隆过滤器与文件信息
+    PHASE_READ,               // 读取本地文件
+    PHASE_CHUNK,              // 分块（增量分块时含复用块的 SHA1）
+    PHASE_SHA1,               // 计算块 SHA1
+    PHASE_MATCH,              // 按过滤器挑选候选块
+    PHASE_VERIFY,             // 发送候选块并校验服务器返回的 SHA1
+    PHASE_UPLOAD,             // 上传新块并等待结果
+    PHASE_FINALIZE,           // 更新指纹缓存、保存配方
+    SESSION_PHASES
+} SessionPhase;
+
+static const char *g_phase_names[SESSION_PHASES] = {
+    "connect", "exchange", "read", "chunk", "sha1", "match", "verify", "upload", "finalize"
+};
+
+typedef struct {
+    double session_start;
+    double phase_start;
+    double seconds[SESSION_PHASES];
+    long long sent[NUM_SERVERS];          // 会话开始时的 g_server_sent，结束时换算为增量
+    long long received[NUM_SERVERS];
+    int matched[NUM_SERVERS];
+    int verified[NUM_SERVERS];
+    int uploaded[NUM_SERVERS];
+    long uploaded_bytes[NUM_SERVERS];
+} SessionTiming;
+
+static FILE *g_timing_file = NULL;        // -t 指定时追加写入每次会话的 JSON 行
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void timing_begin(SessionTiming *t) {
+    memset(t, 0, sizeof(*t));
+    t->session_start = t->phase_start = monotonic_seconds();
     for (int s = 0; s < NUM_SERVERS; ++s) {
-        send_file_data(socks[s], filename);
+        t->sent[s] = __atomic_load_n(&g_server_sent[s], __ATOMIC_RELAXED);
+        t->received[s] = __atomic_load_n(&g_server_received[s], __ATOMIC_RELAXED);
+    }
+}
+
+// 结束一个阶段：把上次标记以来的耗时记入 phase
+static void timing_phase(SessionTiming *t, SessionPhase phase) {
+    double now = monotonic_seconds();
+    t->seconds[phase] += now - t->phase_start;
+    t->phase_start = now;
+}
+
+// 合并并发执行的各服务器会话的阶段耗时：每个阶段取各服务器中最长的一个
+static void timing_merge(SessionTiming *t, const SessionTiming *parts[], int count) {
+    for (int p = 0; p < SESSION_PHASES; ++p) {
+        double longest = 0;
+        for (int i = 0; i < count; ++i) {
+            if (parts[i]->seconds[p] > longest) longest = parts[i]->seconds[p];
+        }
+        t->seconds[p] += longest;
+    }
+    t->phase_start = monotonic_seconds();
+}
+
+static void json_write_string(FILE *out, const char *str) {
+    fputc('"', out);
+    for (const unsigned char *c = (const unsigned char *)str; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            fputc(*c, out);
+        }
     }
+    fputc('"', out);
+}
+
+// 输出会话的计时结果：标准输出打印一行 "Timing: {...}"，指定了 -t 时同时追加到文件
+static void timing_report(SessionTiming *t, const char *filename, size_t file_size, int chunk_num,
+                          int cached, int ok) {
+    char *line = NULL;
+    size_t line_len = 0;
+    FILE *out = open_memstream(&line, &line_len);
+    if (!out) return;
     
-    // 接收四个服务器的FastFp列表（统一循环）
-    printf("Receiving FastFp lists from servers...\n");
-    FastFpList server_fastfps[NUM_SERVERS];
+    fprintf(out, "{\"time\":%ld,\"file\":", (long)time(NULL));
+    json_write_string(out, filename);
+    fprintf(out, ",\"bytes\":%zu,\"chunks\":%d,\"avg_size\":%u,\"cached\":%s,\"ok\":%s,\"seconds\":{",
+            file_size, chunk_num, AvgSize, cached ? "true" : "false", ok ? "true" : "false");
+    for (int p = 0; p < SESSION_PHASES; ++p) {
+        fprintf(out, "\"%s\":%.6f,", g_phase_names[p], t->seconds[p]);
+    }
+    fprintf(out, "\"total\":%.6f},\"servers\":[", monotonic_seconds() - t->session_start);
     for (int s = 0; s < NUM_SERVERS; ++s) {
-        server_fastfps[s] = receive_fastfp_list(socks[s]);
-        printf("Server%d: %d entries\n", s+1, server_fastfps[s].count);
+        fprintf(out, "%s{\"server\":%d,\"sent\":%lld,\"received\":%lld,\"matched\":%d,\"verified\":%d,"
+                "\"uploaded\":%d,\"uploaded_bytes\":%ld}", s > 0 ? "," : "", s + 1,
+                __atomic_load_n(&g_server_sent[s], __ATOMIC_RELAXED) - t->sent[s],
+                __atomic_load_n(&g_server_received[s], __ATOMIC_RELAXED) - t->received[s],
+                t->matched[s], t->verified[s], t->uploaded[s], t->uploaded_bytes[s]);
     }
+    fprintf(out, "]}");
+    fclose(out);
     
-    // 读取本地文件进行分块
-    FILE* local_file = fopen(filename, "rb");
-    if (!local_file) {
-        perror("Cannot open local file");
-        for (int s = 0; s < NUM_SERVERS; ++s) close(socks[s]);
-        for (int s = 0; s < NUM_SERVERS; ++s) {
-            if (server_fastfps[s].fastfps) free(server_fastfps[s].fastfps);
+    printf("Timing: %s\n", line);
+    if (g_timing_file) {
+        fprintf(g_timing_file, "%s\n", line);
+        fflush(g_timing_file);
+    }
+    free(line);
+}
+
+// 本次会话涉及的文件数据，各服务器的会话并发只读；文件内容按需读取一次
+typedef struct {
+    const char *filename;
+    int cached;                      // 命中指纹缓存：不发送文件内容，也不取过滤器
+    int chunk_num;
+    const int *boundary;
+    const size_t *offsets;           // 每块在文件中的偏移
+    const uint64_t *fastfps;
+    const unsigned char *sha1;
+    const int *owner;
+    size_t file_size;
+    pthread_mutex_t data_lock;       // 保护 data 与 read_failed
+    unsigned char *data;             // 复用指纹缓存时为 NULL，确实需要上传才读入
+    int read_failed;
+} SessionFile;
+
+// 与一个服务器的会话：该服务器是文件中某些块的归属服务器时查询并上传这些块；
+// 只在上次的配方中出现时发送一个空会话，替换掉该文件在该服务器上的旧清单。
+// 各服务器的会话在各自的线程中进行，共用到该服务器的长连接
+typedef struct {
+    int server;                      // 0-based
+    const char *ip;
+    int port;
+    SessionFile *file;
+    int owned;                       // 归属该服务器的块数
+    FpFilterBits filter;
+    int *candidates;                 // 过滤器判定可能存在的归属块（块下标）
+    int candidate_count;
+    int *verified;                   // 每块是否已在该服务器上确认（chunk_num 项）
+    int verified_count;
+    int *uploads;                    // 需要上传的块下标
+    int upload_count;
+    long uploaded_bytes;
+    int failed;
+    int completed;                   // 服务端已用本次的块替换该文件的清单
+    SessionTiming timing;            // 本服务器会话的阶段耗时
+    pthread_t thread;
+} ServerSession;
+
+// 需要上传时才读取文件内容，读取失败或文件大小已变化返回 NULL
+static const unsigned char *session_file_data(SessionFile *file, SessionTiming *timing) {
+    pthread_mutex_lock(&file->data_lock);
+    if (!file->data && !file->read_failed) {
+        size_t readSize = 0;
+        file->data = read_local_file(file->filename, &readSize);
+        if (!file->data || readSize != file->file_size) {
+            printf("Failed to reload %s for upload\n", file->filename);
+            free(file->data);
+            file->data = NULL;
+            file->read_failed = 1;
         }
-        return -1;
+        timing_phase(timing, PHASE_READ);
+    }
+    const unsigned char *data = file->data;
+    pthread_mutex_unlock(&file->data_lock);
+    return data;
+}
+
+// 在服务器 ss->server 上完成一次会话：过滤器、文件信息、候选块查询与上传。失败时 ss->failed 置 1
+static void run_server_session(ServerSession *ss) {
+    SessionFile *file = ss->file;
+    SessionTiming *timing = &ss->timing;
+    memset(timing, 0, sizeof(*timing));
+    timing->session_start = timing->phase_start = monotonic_seconds();
+    int s = ss->server;
+    int sock = open_server_stream(ss->ip, ss->port);
+    if (sock < 0) {
+        printf("Server%d: cannot open session stream\n", s+1);
+        ss->failed = 1;
+        return;
     }
+    set_socket_timeout(sock, 60);
+    timing_phase(timing, PHASE_CONNECT);
     
-    unsigned char *fileCache = malloc(MAX_CACHE_SIZE);
-    if (!fileCache) {
-        perror("Memory allocation failed");
-        fclose(local_file);
-        for (int s = 0; s < NUM_SERVERS; ++s) close(socks[s]);
-        for (int s = 0; s < NUM_SERVERS; ++s) {
-            if (server_fastfps[s].fastfps) free(server_fastfps[s].fastfps);
-        }
-        return -1;
+    g_wire_server = s;
+    // 只有归属块才需要过滤器。命中指纹缓存的文件上次已经备份过，块基本都在服务器上，
+    // 过滤器几乎筛不掉候选，此时不下载过滤器，直接精确查询全部归属块
+    if (ss->owned > 0 && !file->cached && receive_server_filter(sock, &ss->filter) != 0) {
+        printf("Server%d: filter unavailable, querying all owned chunks\n", s+1);
     }
+    send_file_data(sock, file->filename, !file->cached);
+    timing_phase(timing, PHASE_EXCHANGE);
     
-    size_t fileSize = fread(fileCache, 1, MAX_CACHE_SIZE, local_file);
-    fclose(local_file);
+    find_candidates_for_server(&ss->filter, file->fastfps, file->owner, s, file->chunk_num,
+                               ss->candidates, &ss->candidate_count);
+    printf("Server%d: %d owned chunks, %d candidates\n", s+1, ss->owned, ss->candidate_count);
+    timing_phase(timing, PHASE_MATCH);
     
-    if (fileSize == 0) {
-        printf("File is empty\n");
-        free(fileCache);
-        for (int s = 0; s < NUM_SERVERS; ++s) close(socks[s]);
-        for (int s = 0; s < NUM_SERVERS; ++s) {
-            if (server_fastfps[s].fastfps) free(server_fastfps[s].fastfps);
+    // SHA1 回复接收失败时候选块一律按未验证处理，随后照常上传；流已断开时上传失败，整个会话失败
+    send_candidate_chunks(sock, ss->candidates, ss->candidate_count, file->fastfps, file->sha1);
+    if (receive_and_verify_sha1_for_server(sock, ss->candidates, ss->candidate_count, file->sha1,
+                                           ss->verified, &ss->verified_count) != 0) {
+        printf("Server%d: no SHA1 reply, uploading all %d candidates\n", s+1, ss->candidate_count);
+        memset(ss->verified, 0, file->chunk_num * sizeof(int));
+        ss->verified_count = 0;
+    }
+    timing_phase(timing, PHASE_VERIFY);
+    
+    // 未验证的归属块上传到本服务器
+    for (int i = 0; i < file->chunk_num; i++) {
+        if (file->owner[i] == s && !ss->verified[i]) {
+            ss->uploads[ss->upload_count++] = i;
+            ss->uploaded_bytes += file->boundary[i];
         }
-        return -1;
     }
+    // 读不到文件内容时直接断开，服务端不会保存本次的清单
+    const unsigned char *data = ss->upload_count > 0 ? session_file_data(file, timing) : NULL;
+    if (ss->upload_count > 0 && !data) {
+        ss->failed = 1;
+        ss->upload_count = 0;
+        ss->uploaded_bytes = 0;
+        g_wire_server = -1;
+        close(sock);
+        return;
+    }
+    printf("Uploading %d new chunks to server%d...\n", ss->upload_count, s+1);
+    if (send_new_chunks(sock, data, file->boundary, file->offsets, file->fastfps, file->sha1,
+                        ss->uploads, ss->upload_count) != 0) {
+        ss->failed = 1;
+    } else {
+        ss->completed = 1;
+    }
+    timing_phase(timing, PHASE_UPLOAD);
+    g_wire_server = -1;
+    close(sock);
+}
+
+static void *server_session_main(void *arg) {
+    run_server_session(arg);
+    return NULL;
+}
+
+// 上次保存的配方中用到的服务器
+static void previous_recipe_servers(const char *filename, int *used) {
+    char path[512];
+    Recipe recipe;
+    recipe_path_for(filename, path, sizeof(path));
+    if (recipe_load(path, &recipe) != 0) {
+        return;
+    }
+    for (int i = 0; i < recipe.count; i++) {
+        int s = recipe.entries[i].server_id - 1;
+        if (s >= 0 && s < NUM_SERVERS) used[s] = 1;
+    }
+    recipe_free(&recipe);
+}
+
+// 客户端主逻辑：先在本地分块，再只与归属服务器（以及上次配方用到的服务器）进行会话
+int process_file_on_client(const char* filename, const char* server1_ip, int server1_port, 
+                          const char* server2_ip, int server2_port,
+                          const char* server3_ip, int server3_port,
+                          const char* server4_ip, int server4_port,
+                          FpCache *cache) {
+    printf("Starting distributed FastCDC client for file: %s\n", filename);
+    SessionTiming timing;
+    timing_begin(&timing);
     
-    // 对本地文件进行FastCDC分块
-    fastCDC_init();
+    // 查询指纹缓存：大小/mtime/inode 均未变化时复用上次的分块结果
+    struct stat st;
+    int have_stat = stat(filename, &st) == 0;
+    const FpCacheEntry *cached = (cache && have_stat) ? fpcache_lookup(cache, filename, &st) : NULL;
+    
+    size_t fileSize = 0;
+    unsigned char *fileCache = NULL;
     int chunk_num = 0;
-    int offset = 0, chunkLength = 0;
-    int maxchunksum = (fileSize / MinSize) + 1;
-    int *boundary = malloc(maxchunksum * sizeof(int));
-    uint64_t *local_fastfps = malloc(maxchunksum * sizeof(uint64_t));
+    int *boundary = NULL;
+    uint64_t *local_fastfps = NULL;
+    unsigned char *chunk_sha1 = NULL;
+    
+    if (cached) {
+        // 文件未修改：直接复用缓存的分块结果，只有需要上传时才读取文件
+        printf("File unchanged since last run, reusing %d cached chunks\n", cached->chunk_count);
+        fileSize = cached->size;
+        chunk_num = cached->chunk_count;
+        int n = chunk_num > 0 ? chunk_num : 1;
+        boundary = malloc(n * sizeof(int));
+        local_fastfps = malloc(n * sizeof(uint64_t));
+        chunk_sha1 = malloc(n * SHA_DIGEST_LENGTH);
+        if (!boundary || !local_fastfps || !chunk_sha1) {
+            perror("Memory allocation failed");
+            free(boundary);
+            free(local_fastfps);
+            free(chunk_sha1);
+            return -1;
+        }
+        memcpy(boundary, cached->sizes, chunk_num * sizeof(int));
+        memcpy(local_fastfps, cached->fastfps, chunk_num * sizeof(uint64_t));
+        memcpy(chunk_sha1, cached->sha1, (size_t)chunk_num * SHA_DIGEST_LENGTH);
+    } else {
+        // 读取本地文件进行分块
+        fileCache = read_local_file(filename, &fileSize);
+        timing_phase(&timing, PHASE_READ);
+        if (!fileCache) {
+            return -1;
+        }
+        
+        // 对本地文件进行FastCDC分块
+        fastCDC_init();
+        int offset = 0, chunkLength = 0;
+        int maxchunksum = (fileSize / MinSize) + 1;
+        boundary = malloc(maxchunksum * sizeof(int));
+        local_fastfps = malloc(maxchunksum * sizeof(uint64_t));
+        chunk_sha1 = malloc(maxchunksum * SHA_DIGEST_LENGTH);
+        
+        if (!boundary || !local_fastfps || !chunk_sha1) {
+            perror("Memory allocation failed");
+            free(fileCache);
+            free(boundary);
+            free(local_fastfps);
+            free(chunk_sha1);
+            return -1;
+        }
+        
+        // 文件有修改但缓存中有上次的分块结果：只对变化区域重新分块
+        const FpCacheEntry *previous = cache ? fpcache_get(cache, filename) : NULL;
+        int sha1_ready = 0;
+        if (previous && previous->chunk_count > 0) {
+            RechunkStats rs;
+            chunk_num = fastCDC_rechunk(chunking, fileCache, fileSize,
+                                        previous->sizes, previous->fastfps, previous->sha1,
+                                        previous->chunk_count, boundary, local_fastfps, chunk_sha1,
+                                        maxchunksum, &rs);
+            if (chunk_num < 0) {
+                printf("Incremental chunking failed, falling back to full chunking\n");
+                chunk_num = 0;
+            } else {
+                printf("Incremental chunking: reused %d of %d chunks, rechunked %ld of %zu bytes\n",
+                       rs.reused_chunks, chunk_num, rs.rechunked_bytes, fileSize);
+                offset = fileSize;
+                sha1_ready = 1;
+            }
+        }
+        
+        // 分块处理
+        int end = fileSize;
+        while (offset < end) {
+            uint64_t feature = 0, weakhash = 0;
+            chunkLength = chunking(fileCache + offset, end - offset, &feature, &weakhash);
+            if (chunkLength <= 0) {
+                printf("Error in chunking, chunk length: %d\n", chunkLength);
+                break;
+            }
+            if (chunk_num >= maxchunksum) {
+                printf("Chunk array overflow\n");
+                break;
+            }
+            boundary[chunk_num] = chunkLength;
+            local_fastfps[chunk_num] = weakhash;
+            offset += chunkLength;
+            chunk_num++;
+            if (offset >= end) break;
+        }
+        
+        printf("Local file chunked into %d pieces\n", chunk_num);
+        timing_phase(&timing, PHASE_CHUNK);
+        
+        // 计算每块 SHA1（用于校验与配方），只计算一次；增量分块时已经算好
+        offset = 0;
+        for (int i = 0; i < chunk_num && !sha1_ready; i++) {
+            calculate_sha1(fileCache + offset, boundary[i], chunk_sha1 + i * SHA_DIGEST_LENGTH);
+            offset += boundary[i];
+        }
+        timing_phase(&timing, PHASE_SHA1);
+    }
     
-    if (!boundary || !local_fastfps) {
+    // 每个块只由其归属服务器负责查询与存储
+    int n = chunk_num > 0 ? chunk_num : 1;
+    int *owner = malloc(n * sizeof(int));
+    size_t *offsets = malloc(n * sizeof(size_t));
+    if (!owner || !offsets) {
         perror("Memory allocation failed");
         free(fileCache);
         free(boundary);
         free(local_fastfps);
-        for (int s = 0; s < NUM_SERVERS; ++s) close(socks[s]);
-        for (int s = 0; s < NUM_SERVERS; ++s) {
-            if (server_fastfps[s].fastfps) free(server_fastfps[s].fastfps);
-        }
+        free(chunk_sha1);
+        free(owner);
+        free(offsets);
         return -1;
     }
     
-    int (*chunking)(unsigned char*, int, uint64_t*, uint64_t*) = normalized_chunking_64;
-    
-    // 分块处理
-    int end = fileSize;
-    while (offset < end) {
-        uint64_t feature = 0, weakhash = 0;
-        chunkLength = chunking(fileCache + offset, end - offset, &feature, &weakhash);
-        if (chunkLength <= 0) {
-            printf("Error in chunking, chunk length: %d\n", chunkLength);
-            break;
-        }
-        if (chunk_num >= maxchunksum) {
-            printf("Chunk array overflow\n");
-            break;
-        }
-        boundary[chunk_num] = chunkLength;
-        local_fastfps[chunk_num] = weakhash;
-        offset += chunkLength;
-        chunk_num++;
-        if (offset >= end) break;
+    // 逐块的 FastFp 只在 debug 级别打印
+    dlog_debug("Local FastFp values:\n");
+    size_t offset = 0;
+    for (int i = 0; i < chunk_num; i++) {
+        owner[i] = dedup_owner(local_fastfps[i], NUM_SERVERS);
+        offsets[i] = offset;
+        offset += boundary[i];
+        dlog_debug("  Chunk %d: FastFp=0x%016lx, Size=%d, Owner=server%d\n", i, local_fastfps[i], boundary[i], owner[i] + 1);
     }
     
-    printf("Local file chunked into %d pieces\n", chunk_num);
-    
-    // 打印所有FastFp值
-    printf("Local FastFp values:\n");
+    // 参与会话的服务器：有归属块的服务器，以及上次配方用到、需要替换旧清单的服务器
+    const char *ips[NUM_SERVERS] = {server1_ip, server2_ip, server3_ip, server4_ip};
+    int ports[NUM_SERVERS] = {server1_port, server2_port, server3_port, server4_port};
+    ServerSession sessions[NUM_SERVERS];
+    int used[NUM_SERVERS] = {0};
+    int alloc_failed = 0;
+    memset(sessions, 0, sizeof(sessions));
+    previous_recipe_servers(filename, used);
     for (int i = 0; i < chunk_num; i++) {
-        printf("  Chunk %d: FastFp=0x%016lx, Size=%d\n", i, local_fastfps[i], boundary[i]);
+        sessions[owner[i]].owned++;
     }
-    
-    // 封装为数组，统一匹配流程
-    FastFpData *matching[NUM_SERVERS];
-    int match_count[NUM_SERVERS] = {0};
     for (int s = 0; s < NUM_SERVERS; ++s) {
-        matching[s] = (FastFpData *)malloc(chunk_num * sizeof(FastFpData));
-        if (!matching[s]) { printf("malloc matching failed for server %d\n", s+1); }
-        find_matches_for_server(&server_fastfps[s], local_fastfps, chunk_num, matching[s], &match_count[s]);
-        printf("Server%d matched %d chunks\n", s+1, match_count[s]);
+        ServerSession *ss = &sessions[s];
+        ss->server = s;
+        ss->ip = ips[s];
+        ss->port = ports[s];
+        ss->verified = calloc(n, sizeof(int));
+        ss->candidates = malloc((ss->owned > 0 ? ss->owned : 1) * sizeof(int));
+        ss->uploads = malloc((ss->owned > 0 ? ss->owned : 1) * sizeof(int));
+        if (!ss->verified || !ss->candidates || !ss->uploads) alloc_failed = 1;
+        if (ss->owned > 0) used[s] = 1;
     }
     
-    // 先向所有服务器发送当前文件的所有 FastFp（用于服务端清理旧块）
-    printf("Sending current file FastFp list to all servers...\n");
-    for (int s = 0; s < NUM_SERVERS; ++s) {
-        if (send_current_fastfp_list_to_server(socks[s], local_fastfps, chunk_num) != 0) {
-            printf("Failed to send FastFp list to server%d\n", s+1);
+    // 各服务器的会话并发进行，线程创建失败时在当前线程中执行
+    int upload_failed = alloc_failed;
+    SessionFile file = {filename, cached != NULL, chunk_num, boundary, offsets, local_fastfps, chunk_sha1,
+                        owner, fileSize};
+    pthread_mutex_init(&file.data_lock, NULL);
+    file.data = fileCache;
+    int started[NUM_SERVERS] = {0};          // 1 在线程中执行，2 已在当前线程中执行
+    const SessionTiming *parts[NUM_SERVERS];
+    int part_count = 0;
+    for (int s = 0; s < NUM_SERVERS && !alloc_failed; ++s) {
+        if (!used[s]) continue;
+        sessions[s].file = &file;
+        if (pthread_create(&sessions[s].thread, NULL, server_session_main, &sessions[s]) == 0) {
+            started[s] = 1;
+        } else {
+            run_server_session(&sessions[s]);
+            started[s] = 2;
         }
     }
-    
-    // 再发送匹配的 FastFp 列表（统一循环）
-    printf("Sending matching FastFp list to all servers...\n");
     for (int s = 0; s < NUM_SERVERS; ++s) {
-        send_matching_fastfps(socks[s], matching[s], match_count[s]);
+        if (!started[s]) continue;
+        if (started[s] == 1) pthread_join(sessions[s].thread, NULL);
+        if (sessions[s].failed) upload_failed = 1;
+        parts[part_count++] = &sessions[s].timing;
     }
+    timing_merge(&timing, parts, part_count);
+    fileCache = file.data;
+    pthread_mutex_destroy(&file.data_lock);
     
-    // 接收服务器返回的SHA1哈希并验证（抽象成循环与通用函数）
-    int actual_matches[NUM_SERVERS] = {0};
-    int *verified[NUM_SERVERS] = {0};
-    for (int s = 0; s < NUM_SERVERS; ++s) {
-        verified[s] = (int*)calloc(chunk_num, sizeof(int));
-        if (!verified[s]) { printf("calloc verified failed for server %d\n", s+1); }
-    }
-
+    int *verified[NUM_SERVERS];
+    int actual_matches[NUM_SERVERS];
+    int upload_count[NUM_SERVERS];
     for (int s = 0; s < NUM_SERVERS; ++s) {
-        if (match_count[s] <= 0) continue;
-        int ret = receive_and_verify_sha1_for_server(
-            socks[s], matching[s], match_count[s],
-            fileCache, boundary, chunk_num, local_fastfps,
-            verified[s], &actual_matches[s]
-        );
-        if (ret != 0 && s > 0) {
-            // 兼容旧行为：server2/3/4 接收失败时，视为全部匹配有效
-            actual_matches[s] = match_count[s];
-            for (int i = 0; i < match_count[s]; ++i) {
-                uint64_t fp = matching[s][i].fastfp;
-                for (int j = 0; j < chunk_num; ++j) {
-                    if (local_fastfps[j] == fp) { verified[s][j] = 1; break; }
-                }
-            }
-        }
+        verified[s] = sessions[s].verified;
+        actual_matches[s] = sessions[s].verified_count;
+        upload_count[s] = sessions[s].upload_count;
+        timing.matched[s] = sessions[s].candidate_count;
+        timing.verified[s] = sessions[s].verified_count;
+        timing.uploaded[s] = sessions[s].upload_count;
+        timing.uploaded_bytes[s] = sessions[s].uploaded_bytes;
     }
     
-    // 计算需要上传到每个服务器的块（抽象成轮询分配）
-    FastFpData *upload_fastfps[NUM_SERVERS];
-    int upload_count[NUM_SERVERS] = {0};
-    for (int s = 0; s < NUM_SERVERS; ++s) {
-        upload_fastfps[s] = (FastFpData*)malloc(chunk_num * sizeof(FastFpData));
-    }
-
-    for (int i = 0; i < chunk_num; i++) {
-        uint64_t current_fastfp = local_fastfps[i];
-        int verified_any = 0;
-        for (int s = 0; s < NUM_SERVERS; ++s) {
-            if (verified[s] && verified[s][i]) { verified_any = 1; break; }
+    // 会话全部成功后才更新指纹缓存和配方：否则配方可能引用没有保存成功的块
+    // 已完成的服务器已替换清单，上次配方引用的块可能已被回收，此时删除旧配方
+    if (upload_failed) {
+        int replaced = 0;
+        for (int s = 0; s < NUM_SERVERS; ++s) replaced |= sessions[s].completed;
+        char path[512];
+        recipe_path_for(filename, path, sizeof(path));
+        if (replaced && remove(path) == 0) {
+            printf("Session for %s failed, removed stale recipe %s; back it up again\n", filename, path);
+        } else {
+            printf("Session for %s failed, recipe not updated\n", filename);
+        }
+    } else {
+        if (cache && have_stat && !cached &&
+            fpcache_put(cache, filename, &st, chunk_num, boundary, local_fastfps, chunk_sha1) != 0) {
+            printf("Failed to update fingerprint cache for %s\n", filename);
+        }
+        // 保存文件配方，记录每块所在服务器，供按范围读取
+        if (save_file_recipe(filename, fileSize, boundary, local_fastfps, chunk_sha1,
+                             owner, chunk_num, verified) != 0) {
+            printf("Failed to save recipe for %s\n", filename);
+            upload_failed = 1;
         }
-        if (verified_any) continue;
-
-        int server_idx = i % NUM_SERVERS; // 轮询分配
-        upload_fastfps[server_idx][upload_count[server_idx]].fastfp = current_fastfp;
-        upload_fastfps[server_idx][upload_count[server_idx]].server_id = server_idx + 1; // 1-based
-        upload_count[server_idx]++;
-    }
-
-    // 打印上传计划并发送
-    for (int s = 0; s < NUM_SERVERS; ++s) {
-        printf("Uploading %d new chunks to server%d...\n", upload_count[s], s+1);
-        send_new_chunks(socks[s], fileCache, boundary, local_fastfps, chunk_num,
-                        upload_fastfps[s], upload_count[s]);
     }
+    timing_phase(&timing, PHASE_FINALIZE);
     
-    // 计算冗余率指标（注意：总冗余率按“并集”计算，避免双计）
+    // 计算冗余率指标（每块只在归属服务器验证；仍按“并集”计算，兼容迁移前的重复副本）
     long server_verified_size[NUM_SERVERS] = {0};
     long total_verified_size = 0;
     for (int i = 0; i < chunk_num; i++) {
@@ -578,9 +1009,6 @@ int process_file_on_client(const char* filename, const char* server1_ip, int ser
     }
     double total_redundancy_rate = (fileSize > 0) ? (total_verified_size * 100.0 / fileSize) : 0.0;
 
-    
-
-    
     printf("\n========== 冗余率统计 ==========\n");
     printf("文件总大小: %zu bytes\n", fileSize);
     printf("总块数: %d\n", chunk_num);
@@ -608,20 +1036,23 @@ int process_file_on_client(const char* filename, const char* server1_ip, int ser
     for (int s = 0; s < NUM_SERVERS; ++s) {
         printf("Server%d matched %d\n", s+1, actual_matches[s]);
     }
+    timing_report(&timing, filename, fileSize, chunk_num, cached != NULL, !upload_failed);
     
     // 清理资源
     free(fileCache);
     free(boundary);
     free(local_fastfps);
+    free(chunk_sha1);
+    free(owner);
+    free(offsets);
     for (int s = 0; s < NUM_SERVERS; ++s) {
-        if (matching[s]) free(matching[s]);
-        if (upload_fastfps[s]) free(upload_fastfps[s]);
-        if (verified[s]) free(verified[s]);
-        if (server_fastfps[s].fastfps) free(server_fastfps[s].fastfps);
-        close(socks[s]);
+        free(sessions[s].verified);
+        free(sessions[s].candidates);
+        free(sessions[s].uploads);
+        fpfilter_bits_free(&sessions[s].filter);
     }
     
-    return 0;
+    return upload_failed ? -1 : 0;
 }
 
 // 配置结构体
@@ -634,6 +1065,8 @@ typedef struct {
     int server3_port;
     char server4_ip[256];
     int server4_port;
+    char chunking[32];        // 分块算法名，可选，默认 normalized
+    unsigned int avg_size;    // 平均块长，可选，默认 8KB
 } ServerConfig;
 
 // 从配置文件读取服务器信息
@@ -645,6 +1078,8 @@ int read_server_config(const char* config_file, ServerConfig* config) {
     }
     
     char line[512];
+    strcpy(config->chunking, "normalized");
+    config->avg_size = FASTCDC_DEFAULT_AVG_SIZE;
     int found_server1_ip = 0, found_server1_port = 0;
     int found_server2_ip = 0, found_server2_port = 0;
     int found_server3_ip = 0, found_server3_port = 0;
@@ -704,6 +1139,16 @@ int read_server_config(const char* config_file, ServerConfig* config) {
             found_server4_port = 1;
             continue;
         }
+        
+        // 解析 chunking（可选）
+        if (sscanf(line, "chunking=%31s", config->chunking) == 1) {
+            continue;
+        }
+        
+        // 解析 avg_size（可选）
+        if (sscanf(line, "avg_size=%u", &config->avg_size) == 1) {
+            continue;
+        }
     }
     
     fclose(file);
@@ -719,22 +1164,1008 @@ int read_server_config(const char* config_file, ServerConfig* config) {
     return 0;
 }
 
-void print_usage(const char* program_name) {
+// 按范围读取时的块获取上下文，每个服务器一个按需建立的长连接
+typedef struct {
+    const char *ips[NUM_SERVERS];
+    int ports[NUM_SERVERS];
+    int socks[NUM_SERVERS];
+} ChunkFetchContext;
+
+// 从指定连接获取块并校验 SHA1；返回 0 成功，1 块不存在或不一致，-1 连接错误
+static int fetch_chunk_from_server(int sock, const RecipeEntry *entry, unsigned char *out) {
+    int cmd = CMD_GET_CHUNK;
+    if (send_all(sock, &cmd, sizeof(int)) <= 0 ||
+        send_all(sock, &entry->fastfp, sizeof(uint64_t)) <= 0 ||
+        send_all(sock, entry->sha1, SHA_DIGEST_LENGTH) <= 0) {
+        return -1;
+    }
+
+    int size = 0;
+    if (recv_all(sock, &size, sizeof(int)) <= 0) {
+        return -1;
+    }
+    if (size < 0) {
+        return 1;
+    }
+    if ((uint32_t)size != entry->size) {
+        // 大小不一致，读掉数据保持连接同步
+        unsigned char *skip = malloc(size > 0 ? size : 1);
+        int ret = (skip && recv_all(sock, skip, size) >= 0) ? 1 : -1;
+        free(skip);
+        return ret;
+    }
+    if (recv_all(sock, out, size) <= 0) {
+        return -1;
+    }
+
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    calculate_sha1(out, size, sha1);
+    return memcmp(sha1, entry->sha1, SHA_DIGEST_LENGTH) == 0 ? 0 : 1;
+}
+
+// recipe_fetch_fn：优先访问配方记录的服务器，失败时依次尝试其他服务器
+static int fetch_chunk(void *ctx, const RecipeEntry *entry, unsigned char *out) {
+    ChunkFetchContext *fc = (ChunkFetchContext *)ctx;
+    int first = entry->server_id - 1;
+    if (first < 0 || first >= NUM_SERVERS) first = 0;
+
+    for (int k = 0; k < NUM_SERVERS; k++) {
+        int s = (first + k) % NUM_SERVERS;
+        if (fc->socks[s] < 0) {
+            fc->socks[s] = open_server_stream(fc->ips[s], fc->ports[s]);
+            if (fc->socks[s] < 0) continue;
+        }
+        int ret = fetch_chunk_from_server(fc->socks[s], entry, out);
+        if (ret == 0) return 0;
+        if (ret < 0) {
+            close(fc->socks[s]);
+            fc->socks[s] = -1;
+        }
+    }
+    printf("Chunk 0x%016lx not available on any server\n", entry->fastfp);
+    return -1;
+}
+
+// 读取已存储文件的 [offset, offset+length)，写入 out_path
+int read_file_range(const ServerConfig *config, const char *filename,
+                    uint64_t offset, size_t length, const char *out_path) {
+    char path[512];
+    recipe_path_for(filename, path, sizeof(path));
+
+    Recipe recipe;
+    if (recipe_load(path, &recipe) != 0) {
+        printf("Cannot load recipe %s\n", path);
+        return -1;
+    }
+
+    ChunkFetchContext fc = {
+        {config->server1_ip, config->server2_ip, config->server3_ip, config->server4_ip},
+        {config->server1_port, config->server2_port, config->server3_port, config->server4_port},
+        {-1, -1, -1, -1}
+    };
+    RangeReader rr;
+    unsigned char *buf = malloc(length > 0 ? length : 1);
+    if (!buf || range_reader_init(&rr, &recipe, RANGE_CACHE_SLOTS, fetch_chunk, &fc) != 0) {
+        free(buf);
+        recipe_free(&recipe);
+        return -1;
+    }
+
+    long n = range_read(&rr, offset, length, buf);
+    int ret = -1;
+    if (n >= 0) {
+        FILE *out = fopen(out_path, "wb");
+        if (out && fwrite(buf, 1, n, out) == (size_t)n) {
+            ret = 0;
+        }
+        if (out) fclose(out);
+        printf("Read %ld bytes at offset %lu from %s (%ld chunk fetches, %ld cache hits)\n",
+               n, (unsigned long)offset, filename, rr.fetches, rr.cache_hits);
+    } else {
+        printf("Range read failed for %s\n", filename);
+    }
+
+    range_reader_free(&rr);
+    for (int s = 0; s < NUM_SERVERS; ++s) {
+        if (fc.socks[s] >= 0) close(fc.socks[s]);
+    }
+    free(buf);
+    recipe_free(&recipe);
+    return ret;
+}
+
+// 服务端块列表中的一条记录（CMD_LIST_CHUNKS）
+typedef struct {
+    uint64_t fastfp;
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+} ChunkRecord;
+
+static int chunk_record_compare(const void *a, const void *b) {
+    const ChunkRecord *x = a, *y = b;
+    if (x->fastfp != y->fastfp) return x->fastfp < y->fastfp ? -1 : 1;
+    return memcmp(x->sha1, y->sha1, SHA_DIGEST_LENGTH);
+}
+
+// 获取服务器保存的全部块，按 (FastFp, SHA1) 排序
+static ChunkRecord *list_server_chunks(int sock, int *count) {
+    int cmd = CMD_LIST_CHUNKS;
+    *count = 0;
+    if (send_all(sock, &cmd, sizeof(int)) <= 0 || recv_all(sock, count, sizeof(int)) <= 0 || *count < 0) {
+        return NULL;
+    }
+    size_t bytes = (size_t)*count * DEDUP_CHUNK_RECORD_SIZE;
+    unsigned char *wire = malloc(bytes > 0 ? bytes : 1);
+    ChunkRecord *records = malloc((*count > 0 ? *count : 1) * sizeof(ChunkRecord));
+    if (!wire || !records || (bytes > 0 && recv_all(sock, wire, bytes) <= 0)) {
+        free(wire);
+        free(records);
+        return NULL;
+    }
+    for (int i = 0; i < *count; i++) {
+        memcpy(&records[i].fastfp, wire + i * DEDUP_CHUNK_RECORD_SIZE, sizeof(uint64_t));
+        memcpy(records[i].sha1, wire + i * DEDUP_CHUNK_RECORD_SIZE + sizeof(uint64_t), SHA_DIGEST_LENGTH);
+    }
+    free(wire);
+    qsort(records, *count, sizeof(ChunkRecord), chunk_record_compare);
+    return records;
+}
+
+// 从服务器读取一个块并校验 SHA1，返回 malloc 的数据，失败返回 NULL
+static unsigned char *get_server_chunk(int sock, const ChunkRecord *rec, int *size) {
+    int cmd = CMD_GET_CHUNK;
+    if (send_all(sock, &cmd, sizeof(int)) <= 0 ||
+        send_all(sock, &rec->fastfp, sizeof(uint64_t)) <= 0 ||
+        send_all(sock, rec->sha1, SHA_DIGEST_LENGTH) <= 0 ||
+        recv_all(sock, size, sizeof(int)) <= 0 || *size <= 0) {
+        return NULL;
+    }
+    unsigned char *data = malloc(*size);
+    if (!data || recv_all(sock, data, *size) <= 0) {
+        free(data);
+        return NULL;
+    }
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    calculate_sha1(data, *size, sha1);
+    if (memcmp(sha1, rec->sha1, SHA_DIGEST_LENGTH) != 0) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+// 发送块操作命令并读取状态：PUT 带数据，DEL 不带
+static int chunk_command(int sock, int cmd, const ChunkRecord *rec, const unsigned char *data, int size) {
+    int status = -1;
+    if (send_all(sock, &cmd, sizeof(int)) <= 0 ||
+        send_all(sock, &rec->fastfp, sizeof(uint64_t)) <= 0 ||
+        send_all(sock, rec->sha1, SHA_DIGEST_LENGTH) <= 0) {
+        return -1;
+    }
+    if (data && (send_all(sock, &size, sizeof(int)) <= 0 || send_all(sock, data, size) <= 0)) {
+        return -1;
+    }
+    if (recv_all(sock, &status, sizeof(int)) <= 0) {
+        return -1;
+    }
+    return status;
+}
+
+// 发送 CMD_ADOPT_CHUNKS / CMD_RELEASE_CHUNKS 并读取状态
+static int legacy_command(int sock, int cmd, const ChunkRecord *recs, int count) {
+    unsigned char *wire = malloc((count > 0 ? count : 1) * (size_t)DEDUP_CHUNK_RECORD_SIZE);
+    if (!wire) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        memcpy(wire + i * DEDUP_CHUNK_RECORD_SIZE, &recs[i].fastfp, sizeof(uint64_t));
+        memcpy(wire + i * DEDUP_CHUNK_RECORD_SIZE + sizeof(uint64_t), recs[i].sha1, SHA_DIGEST_LENGTH);
+    }
+    int status = -1;
+    if (send_all(sock, &cmd, sizeof(int)) <= 0 || send_all(sock, &count, sizeof(int)) <= 0 ||
+        (count > 0 && send_all(sock, wire, (size_t)count * DEDUP_CHUNK_RECORD_SIZE) <= 0) ||
+        recv_all(sock, &status, sizeof(int)) <= 0) {
+        status = -1;
+    }
+    free(wire);
+    return status;
+}
+
+// 手动维护命令（--rebalance），不会在后台自动执行，需要定期合并时由运维按计划运行（如 cron）：
+// 把不在归属服务器上的块（启用按归属路由之前写入的）迁移过去并删除原副本。
+// 这些块在原服务器上记在遗留清单中，旧配方可能仍指向原服务器；归属服务器有了副本后先用 CMD_ADOPT_CHUNKS
+// 接管遗留引用，再让原服务器用 CMD_RELEASE_CHUNKS 放弃引用，随后删除原副本，旧配方读取时回退到归属服务器。
+// 仍被原服务器上某个文件清单引用的块（该文件的配方指向它）原服务器拒绝删除，留到该文件不再引用时回收
+int rebalance_cluster(const ServerConfig *config) {
+    const char *ips[NUM_SERVERS] = {config->server1_ip, config->server2_ip, config->server3_ip, config->server4_ip};
+    int ports[NUM_SERVERS] = {config->server1_port, config->server2_port, config->server3_port, config->server4_port};
+    int socks[NUM_SERVERS];
+    ChunkRecord *lists[NUM_SERVERS] = {0};
+    int counts[NUM_SERVERS] = {0};
+    int ret = 0;
+
+    for (int s = 0; s < NUM_SERVERS; ++s) {
+        socks[s] = open_server_stream(ips[s], ports[s]);
+        if (socks[s] >= 0) {
+            set_socket_timeout(socks[s], 60);
+            lists[s] = list_server_chunks(socks[s], &counts[s]);
+        }
+        if (!lists[s]) {
+            printf("Server%d: cannot list chunks\n", s+1);
+            ret = -1;
+        }
+    }
+
+    int moved = 0, removed = 0, kept = 0, failed = 0;
+    long moved_bytes = 0;
+    for (int s = 0; s < NUM_SERVERS && ret == 0; ++s) {
+        // 按归属服务器分组：已在归属服务器上（原有或刚复制过去）的原副本
+        ChunkRecord *placed[NUM_SERVERS] = {0};
+        int placed_count[NUM_SERVERS] = {0};
+        for (int o = 0; o < NUM_SERVERS; ++o) {
+            if (o != s && !(placed[o] = malloc((counts[s] > 0 ? counts[s] : 1) * sizeof(ChunkRecord)))) {
+                ret = -1;
+            }
+        }
+        for (int i = 0; i < counts[s] && ret == 0; i++) {
+            const ChunkRecord *rec = &lists[s][i];
+            int o = dedup_owner(rec->fastfp, NUM_SERVERS);
+            if (o == s) continue;
+
+            if (!bsearch(rec, lists[o], counts[o], sizeof(ChunkRecord), chunk_record_compare)) {
+                int size = 0;
+                unsigned char *data = get_server_chunk(socks[s], rec, &size);
+                int status = data ? chunk_command(socks[o], CMD_PUT_CHUNK, rec, data, size) : -1;
+                free(data);
+                if (status != 0) {
+                    printf("Failed to move chunk 0x%016lx from server%d to server%d\n", rec->fastfp, s+1, o+1);
+                    failed++;
+                    continue;
+                }
+                moved++;
+                moved_bytes += size;
+            }
+            placed[o][placed_count[o]++] = *rec;
+        }
+
+        // 归属服务器接管遗留引用后，原服务器才放弃引用；接管失败的一组原副本保持不动
+        ChunkRecord *release = malloc((counts[s] > 0 ? counts[s] : 1) * sizeof(ChunkRecord));
+        int release_count = 0;
+        if (!release) ret = -1;
+        for (int o = 0; o < NUM_SERVERS && ret == 0; ++o) {
+            if (o == s || placed_count[o] == 0) continue;
+            if (legacy_command(socks[o], CMD_ADOPT_CHUNKS, placed[o], placed_count[o]) != 0) {
+                printf("Server%d failed to adopt %d chunks from server%d\n", o+1, placed_count[o], s+1);
+                failed += placed_count[o];
+                continue;
+            }
+            memcpy(release + release_count, placed[o], placed_count[o] * sizeof(ChunkRecord));
+            release_count += placed_count[o];
+        }
+        if (ret == 0 && release_count > 0 &&
+            legacy_command(socks[s], CMD_RELEASE_CHUNKS, release, release_count) != 0) {
+            printf("Server%d failed to release %d chunks\n", s+1, release_count);
+            failed += release_count;
+            release_count = 0;
+        }
+        for (int i = 0; i < release_count && ret == 0; i++) {
+            int status = chunk_command(socks[s], CMD_DEL_CHUNK, &release[i], NULL, 0);
+            if (status == 0) {
+                removed++;
+            } else if (status == 2) {
+                kept++;
+            } else {
+                printf("Failed to delete chunk 0x%016lx on server%d\n", release[i].fastfp, s+1);
+                failed++;
+            }
+        }
+        free(release);
+        for (int o = 0; o < NUM_SERVERS; ++o) {
+            free(placed[o]);
+        }
+    }
+
+    if (ret == 0) {
+        printf("Rebalance: moved %d chunks (%ld bytes) to their owners, removed %d misplaced copies, "
+               "kept %d copies still referenced by files, %d failures\n", moved, moved_bytes, removed, kept, failed);
+        if (failed > 0) ret = -1;
+    }
+    for (int s = 0; s < NUM_SERVERS; ++s) {
+        free(lists[s]);
+        if (socks[s] >= 0) close(socks[s]);
+    }
+    return ret;
+}
+
+#define STATS_MAX_FAMILIES 256
+
+// 把 CMD_STATS 文本按指标族切分，每族从 "# HELP" 行开始；返回族数，超过 max 时返回 -1
+static int stats_families(const char *text, int length, int *starts, int max) {
+    int count = 0;
+    for (int i = 0; i < length; i++) {
+        if ((i == 0 || text[i - 1] == '\n') && length - i >= 7 && memcmp(text + i, "# HELP ", 7) == 0) {
+            if (count == max) {
+                return -1;
+            }
+            starts[count++] = i;
+        }
+    }
+    return count;
+}
+
+// 读取各服务器的运行指标（CMD_STATS，Prometheus 文本格式），写入 out_path，为 NULL 时输出到标准输出。
+// 各服务器的样本按指标族合并，每族只保留一组 HELP/TYPE，便于直接交给 Prometheus 采集
+int collect_cluster_stats(const ServerConfig *config, const char *out_path) {
+    const char *ips[NUM_SERVERS] = {config->server1_ip, config->server2_ip, config->server3_ip, config->server4_ip};
+    int ports[NUM_SERVERS] = {config->server1_port, config->server2_port, config->server3_port, config->server4_port};
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        printf("Failed to open %s: %s\n", out_path, strerror(errno));
+        return -1;
+    }
+
+    int ret = 0;
+    char *texts[NUM_SERVERS] = {0};
+    int lengths[NUM_SERVERS] = {0};
+    for (int s = 0; s < NUM_SERVERS; ++s) {
+        int sock = open_server_stream(ips[s], ports[s]);
+        int cmd = CMD_STATS;
+        int length = -1;
+        char *text = NULL;
+        if (sock >= 0) {
+            set_socket_timeout(sock, 60);
+            if (send_all(sock, &cmd, sizeof(int)) > 0 && recv_all(sock, &length, sizeof(int)) > 0 && length >= 0) {
+                text = malloc(length > 0 ? length : 1);
+                if (text && length > 0 && recv_all(sock, text, length) <= 0) {
+                    free(text);
+                    text = NULL;
+                }
+            }
+            close(sock);
+        }
+        if (!text) {
+            printf("Server%d: cannot read stats\n", s+1);
+            ret = -1;
+            continue;
+        }
+        texts[s] = text;
+        lengths[s] = length;
+    }
+
+    // 各服务器版本相同时指标族顺序一致，按族交错输出；否则原样拼接
+    int starts[NUM_SERVERS][STATS_MAX_FAMILIES];
+    int families = -1;
+    for (int s = 0; s < NUM_SERVERS; ++s) {
+        if (!texts[s]) continue;
+        int n = stats_families(texts[s], lengths[s], starts[s], STATS_MAX_FAMILIES);
+        families = (families == -1 || families == n) ? n : -2;
+    }
+    if (families < 0) {
+        for (int s = 0; s < NUM_SERVERS; ++s) {
+            if (texts[s]) fwrite(texts[s], 1, lengths[s], out);
+        }
+    }
+    for (int f = 0; f < families; ++f) {
+        int header = 1;
+        for (int s = 0; s < NUM_SERVERS; ++s) {
+            if (!texts[s]) continue;
+            int pos = starts[s][f];
+            int end = f + 1 < families ? starts[s][f + 1] : lengths[s];
+            while (pos < end) {
+                const char *nl = memchr(texts[s] + pos, '\n', end - pos);
+                int next = nl ? (int)(nl - texts[s]) + 1 : end;
+                if (header || texts[s][pos] != '#') {
+                    fwrite(texts[s] + pos, 1, next - pos, out);
+                }
+                pos = next;
+            }
+            header = 0;
+        }
+    }
+    for (int s = 0; s < NUM_SERVERS; ++s) {
+        free(texts[s]);
+    }
+    if (out_path && fclose(out) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+// ------------------ 目录批量备份 ------------------
+// 整个运行期间与每个服务器只保持一条连接：开始时用 CMD_LIST_CHUNKS 取回归属块目录，
+// 之后按文件组分块、本地查重，每组向每个服务器只发一次 CMD_PUT_BATCH，再为组内每个文件提交清单
+// （CMD_PUT_MANIFEST），与单文件会话一样由清单决定哪些块仍被引用。
+
+// 块 (FastFp, SHA1) 集合，开放寻址
+typedef struct {
+    ChunkRecord *slots;
+    unsigned char *used;
+    size_t cap;
+    size_t count;
+} ChunkSet;
+
+static size_t chunk_set_slot(const ChunkSet *set, uint64_t fastfp, const unsigned char *sha1) {
+    uint64_t h;
+    memcpy(&h, sha1, sizeof(h));
+    h ^= fastfp;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    size_t i = h & (set->cap - 1);
+    while (set->used[i] &&
+           (set->slots[i].fastfp != fastfp || memcmp(set->slots[i].sha1, sha1, SHA_DIGEST_LENGTH) != 0)) {
+        i = (i + 1) & (set->cap - 1);
+    }
+    return i;
+}
+
+static int chunk_set_contains(const ChunkSet *set, uint64_t fastfp, const unsigned char *sha1) {
+    return set->cap > 0 && set->used[chunk_set_slot(set, fastfp, sha1)];
+}
+
+// 新加入返回 1，已存在返回 0，内存不足返回 -1
+static int chunk_set_insert(ChunkSet *set, uint64_t fastfp, const unsigned char *sha1) {
+    if ((set->count + 1) * 2 > set->cap) {
+        // 装载因子不超过 0.5
+        ChunkSet grown = {0};
+        grown.cap = set->cap ? set->cap * 2 : 1024;
+        grown.slots = malloc(grown.cap * sizeof(ChunkRecord));
+        grown.used = calloc(grown.cap, 1);
+        if (!grown.slots || !grown.used) {
+            free(grown.slots);
+            free(grown.used);
+            return -1;
+        }
+        for (size_t i = 0; i < set->cap; i++) {
+            if (set->used[i]) {
+                size_t j = chunk_set_slot(&grown, set->slots[i].fastfp, set->slots[i].sha1);
+                grown.slots[j] = set->slots[i];
+                grown.used[j] = 1;
+            }
+        }
+        grown.count = set->count;
+        free(set->slots);
+        free(set->used);
+        *set = grown;
+    }
+    size_t i = chunk_set_slot(set, fastfp, sha1);
+    if (set->used[i]) return 0;
+    set->slots[i].fastfp = fastfp;
+    memcpy(set->slots[i].sha1, sha1, SHA_DIGEST_LENGTH);
+    set->used[i] = 1;
+    set->count++;
+    return 1;
+}
+
+static void chunk_set_free(ChunkSet *set) {
+    free(set->slots);
+    free(set->used);
+    memset(set, 0, sizeof(*set));
+}
+
+typedef struct {
+    char **paths;
+    int count;
+    int cap;
+} FileList;
+
+static int file_list_add(FileList *fl, const char *path) {
+    if (fl->count >= fl->cap) {
+        int cap = fl->cap ? fl->cap * 2 : 256;
+        char **p = realloc(fl->paths, cap * sizeof(char *));
+        if (!p) return -1;
+        fl->paths = p;
+        fl->cap = cap;
+    }
+    fl->paths[fl->count] = strdup(path);
+    return fl->paths[fl->count++] ? 0 : -1;
+}
+
+static void file_list_free(FileList *fl) {
+    for (int i = 0; i < fl->count; i++) free(fl->paths[i]);
+    free(fl->paths);
+    memset(fl, 0, sizeof(*fl));
+}
+
+// 递归收集普通文件，不跟随符号链接
+static void collect_files(const char *path, FileList *fl) {
+    struct stat st;
+    if (lstat(path, &st) != 0) {
+        printf("Cannot access %s\n", path);
+        return;
+    }
+    if (S_ISREG(st.st_mode)) {
+        if (file_list_add(fl, path) != 0) printf("Out of memory, skipping %s\n", path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) return;
+
+    DIR *d = opendir(path);
+    if (!d) {
+        printf("Cannot open directory %s\n", path);
+        return;
+    }
+    struct dirent *entry;
+    char child[4096];
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        collect_files(child, fl);
+    }
+    closedir(d);
+}
+
+// 批量模式中一个文件的分块结果
+typedef struct {
+    const char *path;
+    struct stat st;
+    int cached;                 // 分块结果来自指纹缓存
+    int need_data;              // 需要读取文件内容（分块或上传）
+    unsigned char *data;
+    size_t size;
+    int chunk_num;
+    int *boundary;
+    uint64_t *fastfps;
+    unsigned char *sha1;
+    int failed;
+} BatchFile;
+
+typedef struct {
+    BatchFile *files;
+    int count;
+    int next;                   // 下一个待处理文件下标
+    pthread_mutex_t lock;
+} BatchQueue;
+
+// 按 fstat 的大小读取整个文件，空文件返回长度为 0 的缓冲区
+static unsigned char *read_whole_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    struct stat st;
+    if (!file) return NULL;
+    if (fstat(fileno(file), &st) != 0 || st.st_size > MAX_CACHE_SIZE) {
+        fclose(file);
+        return NULL;
+    }
+    *size = (size_t)st.st_size;
+    unsigned char *data = malloc(*size > 0 ? *size : 1);
+    if (data && fread(data, 1, *size, file) != *size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+// 读取文件；未命中缓存的文件同时完成分块与 SHA1 计算
+static int batch_prepare_file(BatchFile *f) {
+    f->data = read_whole_file(f->path, &f->size);
+    if (!f->data) return -1;
+    if (f->cached) {
+        return f->size == (size_t)f->st.st_size ? 0 : -1;
+    }
+
+    int maxchunks = (int)(f->size / MinSize) + 1;
+    f->boundary = malloc(maxchunks * sizeof(int));
+    f->fastfps = malloc(maxchunks * sizeof(uint64_t));
+    f->sha1 = malloc((size_t)maxchunks * SHA_DIGEST_LENGTH);
+    if (!f->boundary || !f->fastfps || !f->sha1) return -1;
+
+    size_t offset = 0;
+    while (offset < f->size && f->chunk_num < maxchunks) {
+        uint64_t feature = 0, weakhash = 0;
+        size_t left = f->size - offset;
+        int len = chunking(f->data + offset, left > MaxSize ? (int)MaxSize : (int)left, &feature, &weakhash);
+        if (len <= 0) return -1;
+        f->boundary[f->chunk_num] = len;
+        f->fastfps[f->chunk_num] = weakhash;
+        calculate_sha1(f->data + offset, len, f->sha1 + (size_t)f->chunk_num * SHA_DIGEST_LENGTH);
+        f->chunk_num++;
+        offset += len;
+    }
+    return offset == f->size ? 0 : -1;
+}
+
+// 分块参数在启动线程前已设置好，线程只读
+static void *batch_worker(void *arg) {
+    BatchQueue *q = (BatchQueue *)arg;
+    for (;;) {
+        pthread_mutex_lock(&q->lock);
+        int idx = q->next++;
+        pthread_mutex_unlock(&q->lock);
+        if (idx >= q->count) break;
+        BatchFile *f = &q->files[idx];
+        if (f->need_data && batch_prepare_file(f) != 0) {
+            f->failed = 1;
+        }
+    }
+    return NULL;
+}
+
+static void batch_file_free(BatchFile *f) {
+    free(f->data);
+    free(f->boundary);
+    free(f->fastfps);
+    free(f->sha1);
+}
+
+// 待上传块在文件组中的位置
+typedef struct {
+    int file;
+    int chunk;
+    size_t offset;
+} BatchChunkRef;
+
+// 以一个 CMD_PUT_BATCH 把块发给服务器，服务端全部接受返回 0
+static int send_chunk_batch(int sock, const BatchFile *files, const BatchChunkRef *refs, int count) {
+    int cmd = CMD_PUT_BATCH;
+    if (send_all(sock, &cmd, sizeof(int)) <= 0 || send_all(sock, &count, sizeof(int)) <= 0) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        const BatchFile *f = &files[refs[i].file];
+        int c = refs[i].chunk;
+        if (send_all(sock, &f->fastfps[c], sizeof(uint64_t)) <= 0 ||
+            send_all(sock, f->sha1 + (size_t)c * SHA_DIGEST_LENGTH, SHA_DIGEST_LENGTH) <= 0 ||
+            send_all(sock, &f->boundary[c], sizeof(int)) <= 0 ||
+            send_all(sock, f->data + refs[i].offset, f->boundary[c]) <= 0) {
+            return -1;
+        }
+    }
+    int status = -1;
+    if (recv_all(sock, &status, sizeof(int)) <= 0) {
+        return -1;
+    }
+    return status == 0 ? 0 : -1;
+}
+
+// 为组内每个文件向服务器 s 提交清单（该文件归属 s 的块），先连续发送再依次读取结果；
+// 清单未保存的文件在 failed_out 中置 1（各服务器并发提交，不直接改 files）。连接出错返回 -1
+static int send_file_manifests(int sock, int s, const BatchFile *files, int n, unsigned char *failed_out) {
+    unsigned char *records = NULL;
+    int cap = 0;
+    int sent[BATCH_MAX_FILES];
+    int sent_count = 0;
+    for (int k = 0; k < n; k++) {
+        const BatchFile *f = &files[k];
+        if (f->failed) continue;
+        if (f->chunk_num > cap) {
+            unsigned char *r = realloc(records, (size_t)f->chunk_num * DEDUP_CHUNK_RECORD_SIZE);
+            if (!r) {
+                free(records);
+                return -1;
+            }
+            records = r;
+            cap = f->chunk_num;
+        }
+        int count = 0;
+        for (int i = 0; i < f->chunk_num; i++) {
+            if (dedup_owner(f->fastfps[i], NUM_SERVERS) != s) continue;
+            unsigned char *rec = records + (size_t)count * DEDUP_CHUNK_RECORD_SIZE;
+            memcpy(rec, &f->fastfps[i], sizeof(uint64_t));
+            memcpy(rec + sizeof(uint64_t), f->sha1 + (size_t)i * SHA_DIGEST_LENGTH, SHA_DIGEST_LENGTH);
+            count++;
+        }
+        char name[DEDUP_MAX_NAME + 1];
+        session_name_for(f->path, name, sizeof(name));
+        int cmd = CMD_PUT_MANIFEST;
+        int name_len = strlen(name);
+        if (send_all(sock, &cmd, sizeof(int)) <= 0 || send_all(sock, &name_len, sizeof(int)) <= 0 ||
+            send_all(sock, name, name_len) <= 0 || send_all(sock, &count, sizeof(int)) <= 0 ||
+            (count > 0 && send_all(sock, records, (size_t)count * DEDUP_CHUNK_RECORD_SIZE) <= 0)) {
+            free(records);
+            return -1;
+        }
+        sent[sent_count++] = k;
+    }
+    free(records);
+    for (int j = 0; j < sent_count; j++) {
+        int status = -1;
+        if (recv_all(sock, &status, sizeof(int)) <= 0) {
+            return -1;
+        }
+        if (status != 0) {
+            printf("Server%d failed to save the manifest of %s\n", s+1, files[sent[j]].path);
+            failed_out[sent[j]] = 1;
+        }
+    }
+    return 0;
+}
+
+// 一组文件在一个服务器上的批量上传或清单提交，各服务器在各自的线程中并发进行
+typedef struct {
+    int server;
+    int sock;
+    int manifests;              // 0 发送 CMD_PUT_BATCH，1 提交清单
+    const BatchFile *files;
+    int file_count;
+    const BatchChunkRef *refs;
+    int ref_count;
+    unsigned char failed[BATCH_MAX_FILES];   // 清单未保存的文件
+    int ret;
+} BatchServerJob;
+
+static void *batch_server_main(void *arg) {
+    BatchServerJob *job = arg;
+    g_wire_server = job->server;
+    if (!job->manifests) {
+        if (job->ref_count > 0 && send_chunk_batch(job->sock, job->files, job->refs, job->ref_count) != 0) {
+            printf("Batch upload of %d chunks to server%d failed\n", job->ref_count, job->server+1);
+            job->ret = -1;
+        }
+    } else if (send_file_manifests(job->sock, job->server, job->files, job->file_count, job->failed) != 0) {
+        printf("Sending manifests to server%d failed\n", job->server+1);
+        job->ret = -1;
+    }
+    g_wire_server = -1;
+    return NULL;
+}
+
+// 在所有服务器上并发执行同一阶段，任一服务器失败返回 -1
+static int run_batch_servers(BatchServerJob *jobs) {
+    pthread_t tids[NUM_SERVERS];
+    int started[NUM_SERVERS] = {0};
+    for (int s = 0; s < NUM_SERVERS; ++s) {
+        started[s] = pthread_create(&tids[s], NULL, batch_server_main, &jobs[s]) == 0;
+        if (!started[s]) batch_server_main(&jobs[s]);
+    }
+    int ret = 0;
+    for (int s = 0; s < NUM_SERVERS; ++s) {
+        if (started[s]) pthread_join(tids[s], NULL);
+        if (jobs[s].ret != 0) ret = -1;
+    }
+    return ret;
+}
+
+// 批量备份若干文件或目录：client --batch [-j N] <path> [path ...]
+int backup_paths(const ServerConfig *config, int argc, char *argv[], FpCache *cache) {
+    int threads = BATCH_DEFAULT_THREADS;
+    if (argc >= 2 && strcmp(argv[0], "-j") == 0) {
+        threads = atoi(argv[1]);
+        argc -= 2;
+        argv += 2;
+    }
+    if (threads < 1 || argc < 1) {
+        printf("Usage: --batch [-j threads] <path> [path ...]\n");
+        return -1;
+    }
+
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    FileList list = {0};
+    for (int i = 0; i < argc; i++) {
+        collect_files(argv[i], &list);
+    }
+    printf("Batch backup: %d files, %d threads\n", list.count, threads);
+
+    // 连接所有服务器，取回各自归属的块目录
+    const char *ips[NUM_SERVERS] = {config->server1_ip, config->server2_ip, config->server3_ip, config->server4_ip};
+    int ports[NUM_SERVERS] = {config->server1_port, config->server2_port, config->server3_port, config->server4_port};
+    int socks[NUM_SERVERS];
+    ChunkSet known = {0};
+    int ret = 0;
+    for (int s = 0; s < NUM_SERVERS; ++s) {
+        socks[s] = open_server_stream(ips[s], ports[s]);
+        int count = 0;
+        ChunkRecord *records = NULL;
+        if (socks[s] >= 0) {
+            set_socket_timeout(socks[s], 60);
+            records = list_server_chunks(socks[s], &count);
+        }
+        if (!records) {
+            printf("Server%d: cannot list chunks\n", s+1);
+            ret = -1;
+            continue;
+        }
+        // 只信任归属服务器上的副本，其余副本等待 --rebalance 处理
+        for (int i = 0; i < count && ret == 0; i++) {
+            if (dedup_owner(records[i].fastfp, NUM_SERVERS) == s &&
+                chunk_set_insert(&known, records[i].fastfp, records[i].sha1) < 0) {
+                ret = -1;
+            }
+        }
+        printf("Server%d: %d chunks\n", s+1, count);
+        free(records);
+    }
+
+    long long total_bytes = 0, uploaded_bytes = 0;
+    long long total_chunks = 0, uploaded_chunks = 0;
+    int done_files = 0, failed_files = 0;
+    BatchFile *group = calloc(BATCH_MAX_FILES, sizeof(BatchFile));
+    BatchChunkRef *refs[NUM_SERVERS] = {0};
+    int ref_cap[NUM_SERVERS] = {0};
+    BatchServerJob *jobs = calloc(NUM_SERVERS, sizeof(BatchServerJob));
+    if (!group || !jobs) ret = -1;
+
+    for (int first = 0; first < list.count && ret == 0; ) {
+        // 组成一组：最多 BATCH_MAX_FILES 个文件、约 BATCH_MAX_BYTES 字节
+        int n = 0;
+        long long group_bytes = 0;
+        while (first + n < list.count && n < BATCH_MAX_FILES && (n == 0 || group_bytes < BATCH_MAX_BYTES)) {
+            BatchFile *f = &group[n++];
+            memset(f, 0, sizeof(*f));
+            f->path = list.paths[first + n - 1];
+            if (stat(f->path, &f->st) != 0) {
+                f->failed = 1;
+                continue;
+            }
+            group_bytes += f->st.st_size;
+            const FpCacheEntry *cached = fpcache_lookup(cache, f->path, &f->st);
+            f->need_data = 1;
+            if (cached) {
+                int c = cached->chunk_count > 0 ? cached->chunk_count : 1;
+                f->boundary = malloc(c * sizeof(int));
+                f->fastfps = malloc(c * sizeof(uint64_t));
+                f->sha1 = malloc((size_t)c * SHA_DIGEST_LENGTH);
+                if (!f->boundary || !f->fastfps || !f->sha1) {
+                    f->failed = 1;
+                    continue;
+                }
+                f->cached = 1;
+                f->size = cached->size;
+                f->chunk_num = cached->chunk_count;
+                memcpy(f->boundary, cached->sizes, f->chunk_num * sizeof(int));
+                memcpy(f->fastfps, cached->fastfps, f->chunk_num * sizeof(uint64_t));
+                memcpy(f->sha1, cached->sha1, (size_t)f->chunk_num * SHA_DIGEST_LENGTH);
+                // 所有块都已在服务器上时无需读取文件
+                f->need_data = 0;
+                for (int i = 0; i < f->chunk_num && !f->need_data; i++) {
+                    f->need_data = !chunk_set_contains(&known, f->fastfps[i], f->sha1 + (size_t)i * SHA_DIGEST_LENGTH);
+                }
+            }
+        }
+        first += n;
+
+        // 并行读取、分块与计算 SHA1
+        BatchQueue q = {group, n, 0};
+        pthread_mutex_init(&q.lock, NULL);
+        pthread_t tids[BATCH_MAX_THREADS];
+        int started = 0;
+        for (int i = 0; i < threads && i < BATCH_MAX_THREADS && i < n; i++) {
+            if (pthread_create(&tids[i], NULL, batch_worker, &q) != 0) break;
+            started++;
+        }
+        if (started == 0) batch_worker(&q);
+        for (int i = 0; i < started; i++) pthread_join(tids[i], NULL);
+        pthread_mutex_destroy(&q.lock);
+
+        // 本地查重：不在服务器上、且组内未出现过的块上传到其归属服务器
+        int ref_count[NUM_SERVERS] = {0};
+        for (int k = 0; k < n && ret == 0; k++) {
+            BatchFile *f = &group[k];
+            if (f->failed) continue;
+            size_t offset = 0;
+            for (int i = 0; i < f->chunk_num; i++) {
+                const unsigned char *sha1 = f->sha1 + (size_t)i * SHA_DIGEST_LENGTH;
+                int added = chunk_set_insert(&known, f->fastfps[i], sha1);
+                if (added < 0) {
+                    ret = -1;
+                    break;
+                }
+                if (added) {
+                    int o = dedup_owner(f->fastfps[i], NUM_SERVERS);
+                    if (ref_count[o] == ref_cap[o]) {
+                        int cap = ref_cap[o] ? ref_cap[o] * 2 : 1024;
+                        BatchChunkRef *r = realloc(refs[o], cap * sizeof(BatchChunkRef));
+                        if (!r) {
+                            ret = -1;
+                            break;
+                        }
+                        refs[o] = r;
+                        ref_cap[o] = cap;
+                    }
+                    refs[o][ref_count[o]].file = k;
+                    refs[o][ref_count[o]].chunk = i;
+                    refs[o][ref_count[o]].offset = offset;
+                    ref_count[o]++;
+                    uploaded_bytes += f->boundary[i];
+                    uploaded_chunks++;
+                }
+                offset += f->boundary[i];
+            }
+        }
+
+        // 每个服务器一次批量上传，各服务器并发；失败时已加入集合的块状态未知，整组作废并停止
+        if (ret == 0) {
+            for (int s = 0; s < NUM_SERVERS; ++s) {
+                BatchServerJob *job = &jobs[s];
+                memset(job, 0, sizeof(*job));
+                job->server = s;
+                job->sock = socks[s];
+                job->files = group;
+                job->file_count = n;
+                job->refs = refs[s];
+                job->ref_count = ref_count[s];
+            }
+            ret = run_batch_servers(jobs);
+        }
+        // 所有服务器的块都保存后再并发提交清单，之后保存的配方引用的块都受清单保护
+        if (ret == 0) {
+            for (int s = 0; s < NUM_SERVERS; ++s) jobs[s].manifests = 1;
+            ret = run_batch_servers(jobs);
+            for (int s = 0; s < NUM_SERVERS; ++s) {
+                for (int k = 0; k < n; k++) {
+                    if (jobs[s].failed[k]) group[k].failed = 1;
+                }
+            }
+        }
+
+        for (int k = 0; k < n; k++) {
+            BatchFile *f = &group[k];
+            if (ret != 0 || f->failed) {
+                printf("Failed to back up %s\n", f->path);
+                failed_files++;
+                batch_file_free(f);
+                continue;
+            }
+            if (!f->cached && fpcache_put(cache, f->path, &f->st, f->chunk_num, f->boundary, f->fastfps, f->sha1) != 0) {
+                printf("Failed to update fingerprint cache for %s\n", f->path);
+            }
+            int *owner = malloc((f->chunk_num > 0 ? f->chunk_num : 1) * sizeof(int));
+            int *none[NUM_SERVERS] = {0};
+            for (int i = 0; owner && i < f->chunk_num; i++) {
+                owner[i] = dedup_owner(f->fastfps[i], NUM_SERVERS);
+            }
+            if (!owner || save_file_recipe(f->path, f->size, f->boundary, f->fastfps, f->sha1,
+                                           owner, f->chunk_num, none) != 0) {
+                printf("Failed to save recipe for %s\n", f->path);
+                failed_files++;
+            } else {
+                done_files++;
+                total_bytes += f->size;
+                total_chunks += f->chunk_num;
+            }
+            free(owner);
+            batch_file_free(f);
+        }
+    }
+
+    gettimeofday(&end, NULL);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+    printf("\n========== 批量备份统计 ==========\n");
+    printf("文件数: %d (失败 %d)\n", done_files, failed_files);
+    printf("数据量: %lld bytes, 块数: %lld\n", total_bytes, total_chunks);
+    printf("上传块数: %lld, 上传数据量: %lld bytes\n", uploaded_chunks, uploaded_bytes);
+    printf("耗时: %.3f s (%.1f files/s)\n", seconds, seconds > 0 ? done_files / seconds : 0.0);
+    printf("==================================\n\n");
+
+    for (int s = 0; s < NUM_SERVERS; ++s) {
+        free(refs[s]);
+        if (socks[s] >= 0) close(socks[s]);
+    }
+    free(group);
+    free(jobs);
+    chunk_set_free(&known);
+    file_list_free(&list);
+    return (ret != 0 || failed_files > 0) ? -1 : 0;
+}
+
+void print_usage(const char* program_name) {
     printf("Usage:\n");
-    printf("  %s <filename>\n", program_name);
+    printf("  %s [-a <algorithm>] [-s <avg_size>] [-t <timing.jsonl>] <filename>\n", program_name);
     printf("  %s <old_file> <new_file>  # 先用 old_file 预置服务端，再对 new_file 计算冗余率\n", program_name);
+    printf("  %s --read <file> <offset> <length> <out_file>  # 按配方读取已存储文件的字节范围\n", program_name);
+    printf("  %s --rebalance  # 把块迁移到其归属服务器并合并重复副本\n", program_name);
+    printf("  %s --stats [out_file]  # 导出各服务器的运行指标（Prometheus 文本格式）\n", program_name);
+    printf("  %s --batch [-j <threads>] <path> [path ...]  # 批量备份文件或目录，全程复用服务器连接\n", program_name);
     printf("Example: %s random.txt random_copy.txt\n", program_name);
-    printf("Note: Server configuration is read from client.conf\n");
+    printf("Algorithms: origin, rolling2, normalized (default), normalized2\n");
+    printf("Average chunk size: power of two from 4096 to 1048576 bytes (default 8192)\n");
+    printf("Note: Server configuration is read from client.conf, chunking=<algorithm> and avg_size=<bytes> set the defaults\n");
+    printf("Timing: each session prints a \"Timing: {...}\" JSON line with per-phase seconds and per-server bytes/chunks, -t also appends it to a file\n");
 }
 
 int main(int argc, char *argv[]) {
     ServerConfig config;
+    const char *program_name = argv[0];
+    dlog_init(DLOG_CONSOLE);
     
     // 从配置文件读取服务器信息
     if (read_server_config("client.conf", &config) != 0) {
         printf("Failed to read server configuration from client.conf\n");
         return -1;
     }
+    // 服务器中途断开时 send 返回错误，不终止进程；退出时关闭连接池
+    signal(SIGPIPE, SIG_IGN);
+    atexit(close_server_connections);
     
     printf("Server configuration loaded:\n");
     printf("  Server1: %s:%d\n", config.server1_ip, config.server1_port);
@@ -742,37 +2173,93 @@ int main(int argc, char *argv[]) {
     printf("  Server3: %s:%d\n", config.server3_ip, config.server3_port);
     printf("  Server4: %s:%d\n", config.server4_ip, config.server4_port);
 
-    if (argc == 2) {
-        const char* filename = argv[1];
-        struct timeval start, end; gettimeofday(&start, NULL);
-        int result = process_file_on_client(filename, config.server1_ip, config.server1_port,
+    // 命令行 -a/-s 覆盖配置文件中的分块算法与平均块长
+    const char *algorithm = config.chunking;
+    unsigned long avg_size = config.avg_size;
+    while (argc >= 3 && (strcmp(argv[1], "-a") == 0 || strcmp(argv[1], "-s") == 0 || strcmp(argv[1], "-t") == 0)) {
+        if (argv[1][1] == 'a') {
+            algorithm = argv[2];
+        } else if (argv[1][1] == 's') {
+            avg_size = strtoul(argv[2], NULL, 10);
+        } else if (!(g_timing_file = fopen(argv[2], "a"))) {
+            printf("Failed to open timing file %s: %s\n", argv[2], strerror(errno));
+            return -1;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    int algorithm_id = fastCDC_parse_algorithm(algorithm);
+    if (fastCDC_select(algorithm_id) != 0) {
+        printf("Unknown chunking algorithm: %s\n", algorithm);
+        print_usage(program_name);
+        return -1;
+    }
+    if (avg_size > UINT32_MAX || fastCDC_set_avg_size((uint32_t)avg_size) != 0) {
+        printf("Invalid average chunk size: %lu\n", avg_size);
+        print_usage(program_name);
+        return -1;
+    }
+    fastCDC_init();
+    printf("Chunking algorithm: %s, average chunk size: %u bytes\n",
+           fastCDC_algorithm_name(algorithm_id), AvgSize);
+
+    if (argc == 6 && strcmp(argv[1], "--read") == 0) {
+        uint64_t offset = strtoull(argv[3], NULL, 10);
+        size_t length = strtoull(argv[4], NULL, 10);
+        return read_file_range(&config, argv[2], offset, length, argv[5]);
+    } else if (argc == 2 && strcmp(argv[1], "--rebalance") == 0) {
+        return rebalance_cluster(&config);
+    } else if ((argc == 2 || argc == 3) && strcmp(argv[1], "--stats") == 0) {
+        return collect_cluster_stats(&config, argc == 3 ? argv[2] : NULL);
+    } else if ((argc >= 2 && strcmp(argv[1], "--batch") == 0) || argc == 2 || argc == 3) {
+        // 加载指纹缓存，未修改的文件跳过读取/分块/哈希
+        FpCache cache;
+        if (fpcache_load(&cache, FPCACHE_FILE, fastCDC_config_id()) != 0) {
+            printf("Ignoring unreadable fingerprint cache %s\n", FPCACHE_FILE);
+        }
+        
+        int result;
+        if (strcmp(argv[1], "--batch") == 0) {
+            result = backup_paths(&config, argc - 2, argv + 2, &cache);
+        } else if (argc == 2) {
+            const char* filename = argv[1];
+            struct timeval start, end; gettimeofday(&start, NULL);
+            result = process_file_on_client(filename, config.server1_ip, config.server1_port,
                                             config.server2_ip, config.server2_port,
                                             config.server3_ip, config.server3_port,
-                                            config.server4_ip, config.server4_port);
-        gettimeofday(&end, NULL);
-        double total_time = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
-        printf("Total processing time: %.6f seconds\n", total_time);
-        return result;
-    } else if (argc == 3) {
-        // 配对模式：先用旧文件铺底，再用新文件计算冗余率（保证对称的基线）
-        const char* old_file = argv[1];
-        const char* new_file = argv[2];
-
-        printf("[Pair Mode] Seeding servers with old file: %s\n", old_file);
-        if (process_file_on_client(old_file, config.server1_ip, config.server1_port, 
-                                   config.server2_ip, config.server2_port,
-                                   config.server3_ip, config.server3_port,
-                                   config.server4_ip, config.server4_port) != 0) {
-            printf("Seeding failed\n");
-            return -1;
+                                            config.server4_ip, config.server4_port, &cache);
+            gettimeofday(&end, NULL);
+            double total_time = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+            printf("Total processing time: %.6f seconds\n", total_time);
+        } else {
+            // 配对模式：先用旧文件铺底，再用新文件计算冗余率（保证对称的基线）
+            const char* old_file = argv[1];
+            const char* new_file = argv[2];
+
+            printf("[Pair Mode] Seeding servers with old file: %s\n", old_file);
+            result = process_file_on_client(old_file, config.server1_ip, config.server1_port, 
+                                            config.server2_ip, config.server2_port,
+                                            config.server3_ip, config.server3_port,
+                                            config.server4_ip, config.server4_port, &cache);
+            if (result != 0) {
+                printf("Seeding failed\n");
+            } else {
+                printf("[Pair Mode] Computing redundancy for new file: %s\n", new_file);
+                result = process_file_on_client(new_file, config.server1_ip, config.server1_port, 
+                                                config.server2_ip, config.server2_port,
+                                                config.server3_ip, config.server3_port,
+                                                config.server4_ip, config.server4_port, &cache);
+            }
+        }
+        
+        if (fpcache_save(&cache, FPCACHE_FILE) != 0) {
+            printf("Failed to save fingerprint cache %s\n", FPCACHE_FILE);
         }
-        printf("[Pair Mode] Computing redundancy for new file: %s\n", new_file);
-        return process_file_on_client(new_file, config.server1_ip, config.server1_port, 
-                                      config.server2_ip, config.server2_port,
-                                      config.server3_ip, config.server3_port,
-                                      config.server4_ip, config.server4_port);
+        fpcache_free(&cache);
+        printf("Wire bytes: sent %lld, received %lld\n", g_wire_sent, g_wire_received);
+        return result;
     } else {
-        print_usage(argv[0]);
+        print_usage(program_name);
         return -1;
     }
 }
\ No newline at end of file
@@ -0,0 +1,105 @@
+#pragma once
+/**
+ * 客户端与服务端之间的协议定义
+ *
+ * 每个请求以一个 int 开头：
+ *   > 0  : 文件名长度，后续为去重会话（文件名/文件数据/候选块查找/上传）
+ *   < 0  : 命令字，见下方 CMD_* 定义
+ * 同一连接上可以先执行任意多个命令，再开始去重会话；连接关闭即结束。
+ * 连接以 CMD_MUX 开始时改为多路复用，每个逻辑流相当于一条上述的连接（见 mux.h）。
+ *
+ * 会话的查找阶段：客户端先用 CMD_GET_FILTER 取得布隆过滤器，只把归属该服务器、且过滤器判定可能存在的块
+ * 作为候选发送：int count，随后 count 条 { uint64_t fastfp, unsigned char sha1[20] }。服务端逐条精确查找，
+ * 回复 count 个 SHA1（20 字节），块已存储时为其 SHA1，否则为全 0。服务端不再发送整个块目录。
+ * 客户端只与拥有归属块的服务器会话；没有归属块但上次用到的服务器收到 0 个候选、0 个上传的空会话，
+ * 用来替换旧清单。
+ *
+ * 会话的上传阶段：int upload_count，随后每块
+ *   uint64_t fastfp, unsigned char sha1[20], int size, size 字节数据
+ * 服务端边接收边计算 SHA1，与声明不一致的块丢弃不保存。全部接收后回复
+ *   int status : 0 全部保存, > 0 被拒绝的块数, -1 接收或保存出错
+ * status 为 0 时，服务端已把本文件用到的块（查询命中的块与本次上传的块）写入以文件名为键的清单，
+ * 替换该文件上一次的清单；不再被任何清单引用的块随后回收（见 manifest.h）。
+ */
+
+#include <stdint.h>
+
+// 读取单个块，块由 FastFp 与 SHA1 共同确定
+//   请求: int cmd, uint64_t fastfp, unsigned char sha1[20]
+//   响应: int size (< 0 表示块不存在), 随后 size 字节的块数据
+#define CMD_GET_CHUNK (-1)
+
+// 导出 FastFp 布隆过滤器位图，客户端据此跳过一定不存在的块
+//   请求: int cmd
+//   响应: uint32_t log2_size, 随后 (1 << log2_size) / 8 字节位图
+#define CMD_GET_FILTER (-2)
+
+// 列出服务端保存的全部块
+//   请求: int cmd
+//   响应: int count, 随后 count 条 { uint64_t fastfp, unsigned char sha1[20] }（每条 28 字节，无填充）
+#define CMD_LIST_CHUNKS (-3)
+
+// 写入单个块，服务端边接收边校验 SHA1，用于把块迁移到其归属服务器
+//   请求: int cmd, uint64_t fastfp, unsigned char sha1[20], int size, size 字节数据
+//   响应: int status (0 已保存, 1 SHA1 不符已丢弃, -1 出错)
+#define CMD_PUT_CHUNK (-4)
+
+// 删除单个块
+//   请求: int cmd, uint64_t fastfp, unsigned char sha1[20]
+//   响应: int status (0 已删除, 1 块不存在, 2 仍被文件清单引用而未删除)
+#define CMD_DEL_CHUNK (-5)
+
+// 批量写入多个块，用于目录/批量备份
+//   请求: int cmd, int count, 随后 count 个与会话上传相同格式的块
+//   响应: int status (同会话上传结果)
+#define CMD_PUT_BATCH (-6)
+
+// 把连接切换为多路复用帧，只能作为连接上的第一个请求，之后的数据格式见 mux.h
+//   请求: int cmd
+#define CMD_MUX (-7)
+
+// 导出服务端运行指标，Prometheus 文本格式（见 metrics.h）
+//   请求: int cmd
+//   响应: int length (< 0 表示出错), 随后 length 字节文本
+#define CMD_STATS (-8)
+
+// 替换文件的清单（见 manifest.h），批量备份上传块之后为每个文件向每个服务器提交一次，
+// 列出该文件在此服务器上用到的块；不再被任何清单引用的块随后回收。
+// 执行过 CMD_LIST_CHUNKS/PUT_*/DEL_CHUNK/PUT_MANIFEST 的连接（或逻辑流）关闭前，服务端不回收任何块，
+// 因此客户端可以放心引用之前列出的块
+//   请求: int cmd, int name_len, name, int count, 随后 count 条 { uint64_t fastfp, unsigned char sha1[20] }
+//   响应: int status (0 已保存, -1 出错)
+#define CMD_PUT_MANIFEST (-9)
+
+// 把块记入本节点的遗留清单（见 manifest.h），永不回收。--rebalance 把启用清单之前的块迁移到归属服务器后，
+// 旧配方仍可能指向原服务器，读取时回退到归属服务器上的这份副本，因此归属服务器要先接管引用
+//   请求: int cmd, int count, 随后 count 条 { uint64_t fastfp, unsigned char sha1[20] }
+//   响应: int status (0 已记录, > 0 本节点未存储而未记录的块数, -1 出错)
+#define CMD_ADOPT_CHUNKS (-10)
+
+// 从本节点的遗留清单中去掉这些块（归属服务器已用 CMD_ADOPT_CHUNKS 接管），不再被任何清单引用的块
+// 与 CMD_PUT_MANIFEST 释放的块一样随后回收，也可以随后用 CMD_DEL_CHUNK 立即删除
+//   请求: 同 CMD_ADOPT_CHUNKS
+//   响应: int status (0 已去掉, -1 出错)
+#define CMD_RELEASE_CHUNKS (-11)
+
+#define DEDUP_CHUNK_RECORD_SIZE (8 + 20)
+// 会话文件名长度上限。文件名同时是服务端清单的键，客户端发送文件的绝对路径
+#define DEDUP_MAX_NAME 4096
+// 单个会话或批量请求中块数的上限（100MB 文件按 4KB 平均块长约 2.5 万块）
+#define DEDUP_MAX_CHUNKS (1 << 22)
+
+/**
+ * 块的归属服务器（0-based）
+ *
+ * 每个 FastFp 在集群中只有一个归属服务器：客户端只向归属服务器查询和上传，
+ * 同一内容不会在多个服务器上各存一份。FastFp 是分块点处的滚动哈希，低位分布受
+ * 分块掩码影响，先做一次混合再取模。
+ */
+static inline int dedup_owner(uint64_t fastfp, int nodes) {
+    uint64_t h = fastfp;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (int)(h % (uint64_t)nodes);
+}
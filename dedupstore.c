@@ -0,0 +1,1114 @@
+// dedupstore.c - 存储节点（去重会话、块命令与连接处理）
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <openssl/sha.h>
+#include <openssl/evp.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/time.h> 
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include "dedup_proto.h"
+#include "fastcdc.h"
+#include "chunkstore.h"
+#include "chunkcache.h"
+#include "packstore.h"
+#include "manifest.h"
+#include "mux.h"
+#include "bufpool.h"
+#include "metrics.h"
+#include "dlog.h"
+#include "dedupstore.h"
+
+#define MAX_CACHE_SIZE (100 * 1024 * 1024)
+#define TIMEOUT_SECONDS 60
+#define CHUNK_CACHE_BYTES (64 * 1024 * 1024)  // 热点块读缓存上限
+
+static DedupStoreConfig g_config;
+// 已存储块的布隆过滤器，未命中时无需访问磁盘
+static FpFilter g_filter;
+static ChunkCache g_cache;
+// 小块打包存储
+static PackStore g_packs;
+// 各连接的批已写入临时文件、尚未提交的块文件，由存储锁保护
+static ChunkInflight g_inflight;
+// 上传块的异步写入队列，不可用时为 NULL（同步写入）
+static StoreIo *g_io;
+// 每个连接（及多路复用的每个逻辑流）一个线程，块存储、pack 与过滤器的访问由该锁串行化；
+// 块缓存的读取不经过该锁，但填充与失效都在锁内，与块的删除保持先后一致
+static pthread_mutex_t g_store_lock = PTHREAD_MUTEX_INITIALIZER;
+// 每次提交发布结果后广播，等待自己的小块被其他提交写出的连接据此重新检查
+static pthread_cond_t g_commit_cond = PTHREAD_COND_INITIALIZER;
+// 每个文件在本节点上用到的块及其引用数，由清单锁保护；需要同时持有存储锁时先取清单锁
+static ManifestStore g_manifests;
+static pthread_mutex_t g_manifest_lock = PTHREAD_MUTEX_INITIALIZER;
+// 回收：替换清单时引用数降为 0 的块成为候选，等所有会话都结束后由最后离开的线程删除。
+// 会话从查询块之前到写完清单一直计入 g_gc_users，查询到的块因此不会在写入清单前被删除
+static pthread_mutex_t g_gc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_gc_cond = PTHREAD_COND_INITIALIZER;
+static int g_gc_users;
+static int g_gc_running;
+static ChunkId *g_gc_candidates;
+static int g_gc_count, g_gc_cap;
+
+// 创建目录
+static int create_directory_if_not_exists(const char *dir) {
+    struct stat st = {0};
+    if (stat(dir, &st) == -1) {
+        #ifdef _WIN32
+            return mkdir(dir);
+        #else
+            return mkdir(dir, 0755);
+        #endif
+    }
+    return 0;
+}
+
+// 确保所有数据都发送完成
+static int send_all(int socket, const void *buffer, size_t length) {
+    const char *buf = (const char *)buffer;
+    size_t sent = 0;
+    
+    while (sent < length) {
+        int result = send(socket, buf + sent, length - sent, 0);
+        if (result <= 0) {
+            return result;
+        }
+        sent += result;
+    }
+    metrics_add(METRIC_BYTES_OUT, sent);
+    return sent;
+}
+
+// 确保所有数据都接收完成
+static int recv_all(int socket, void *buffer, size_t length) {
+    char *buf = (char *)buffer;
+    size_t received = 0;
+    
+    while (received < length) {
+        int result = recv(socket, buf + received, length - received, 0);
+        if (result < 0) {
+            perror("recv_all error");
+            return -1;
+        }
+        if (result == 0) {
+            // 连接已关闭
+            dlog_warn("Connection closed by peer, received %zu/%zu bytes\n", received, length);
+            return -1;
+        }
+        received += result;
+    }
+    metrics_add(METRIC_BYTES_IN, received);
+    return received;
+}
+
+// 进入会话或命令流：等待正在进行的回收结束，并阻止新的回收开始
+static void gc_enter(void) {
+    pthread_mutex_lock(&g_gc_lock);
+    while (g_gc_running) {
+        pthread_cond_wait(&g_gc_cond, &g_gc_lock);
+    }
+    g_gc_users++;
+    pthread_mutex_unlock(&g_gc_lock);
+}
+
+// 删除候选块中仍没有清单引用的块（单独的块文件和 pack 中的小块），再回收失效过半的 pack
+static void gc_sweep(const ChunkId *candidates, int count) {
+    uint64_t start_us = metrics_now_us();
+    metrics_add(METRIC_GC_RUNS, 1);
+    metrics_gauge_set(GAUGE_GC_PENDING, count);
+    for (int i = 0; i < count; i++) {
+        const ChunkId *id = &candidates[i];
+        metrics_add(METRIC_GC_CHUNKS_SCANNED, 1);
+        metrics_gauge_add(GAUGE_GC_PENDING, -1);
+        pthread_mutex_lock(&g_manifest_lock);
+        int refs = manifest_refs(&g_manifests, id);
+        pthread_mutex_unlock(&g_manifest_lock);
+        if (refs > 0) {
+            continue;
+        }
+        
+        char chunk_path[512];
+        chunkstore_path(g_config.storage_dir, id, chunk_path, sizeof(chunk_path));
+        pthread_mutex_lock(&g_store_lock);
+        int status = chunkstore_remove(g_config.storage_dir, &g_packs, id);
+        if (status == 0) {
+            fpfilter_remove(&g_filter, id->fastfp);
+            chunkcache_remove(&g_cache, id);
+        }
+        pthread_mutex_unlock(&g_store_lock);
+        if (status == 0) {
+            metrics_add(METRIC_GC_CHUNKS_DELETED, 1);
+            dlog_debug("Deleted unreferenced chunk: %s\n", chunk_path);
+        } else if (status < 0) {
+            dlog_error("Failed to delete unreferenced chunk: %s\n", chunk_path);
+        }
+    }
+    
+    // 失效数据过半的 pack 立即搬迁回收
+    pthread_mutex_lock(&g_store_lock);
+    long reclaimed = packstore_compact(&g_packs);
+    int synced = chunkstore_filter_sync(g_config.storage_dir, &g_packs, &g_filter);
+    pthread_mutex_unlock(&g_store_lock);
+    if (reclaimed > 0) {
+        metrics_add(METRIC_GC_BYTES_RECLAIMED, reclaimed);
+        dlog_info("Reclaimed %ld bytes of packed chunks\n", reclaimed);
+    } else if (reclaimed < 0) {
+        dlog_error("Failed to compact packed chunks in %s\n", g_config.storage_dir);
+    }
+    if (synced != 0) {
+        dlog_error("Failed to save FastFp filter in %s\n", g_config.storage_dir);
+    }
+    metrics_observe(PHASE_CLEANUP, start_us);
+}
+
+// 离开会话或命令流；最后一个离开者执行积攒的回收，期间新的会话在 gc_enter 中等待
+static void gc_leave(void) {
+    pthread_mutex_lock(&g_gc_lock);
+    g_gc_users--;
+    if (g_gc_users > 0 || g_gc_count == 0) {
+        pthread_mutex_unlock(&g_gc_lock);
+        return;
+    }
+    ChunkId *candidates = g_gc_candidates;
+    int count = g_gc_count;
+    g_gc_candidates = NULL;
+    g_gc_count = g_gc_cap = 0;
+    g_gc_running = 1;
+    pthread_mutex_unlock(&g_gc_lock);
+    
+    dlog_info("Collecting %d chunks no longer referenced by any file\n", count);
+    gc_sweep(candidates, count);
+    free(candidates);
+    
+    pthread_mutex_lock(&g_gc_lock);
+    g_gc_running = 0;
+    pthread_cond_broadcast(&g_gc_cond);
+    pthread_mutex_unlock(&g_gc_lock);
+}
+
+// 引用数降为 0 的块加入回收候选
+static void gc_add_candidates(const ChunkId *released, int released_count) {
+    if (released_count > 0) {
+        pthread_mutex_lock(&g_gc_lock);
+        if (g_gc_count + released_count > g_gc_cap) {
+            int cap = g_gc_cap > 0 ? g_gc_cap : 1024;
+            while (cap < g_gc_count + released_count) cap *= 2;
+            ChunkId *grown = realloc(g_gc_candidates, cap * sizeof(ChunkId));
+            if (grown) {
+                g_gc_candidates = grown;
+                g_gc_cap = cap;
+            }
+        }
+        // 内存不足时放弃这些候选，块只是暂不回收
+        if (g_gc_count + released_count <= g_gc_cap) {
+            memcpy(g_gc_candidates + g_gc_count, released, released_count * sizeof(ChunkId));
+            g_gc_count += released_count;
+        }
+        pthread_mutex_unlock(&g_gc_lock);
+    }
+}
+
+// 用 ids 替换文件 name 的清单，引用数降为 0 的块加入回收候选
+static int save_file_manifest(const char *name, const ChunkId *ids, int count) {
+    ChunkId *released = NULL;
+    int released_count = 0;
+    pthread_mutex_lock(&g_manifest_lock);
+    int ret = manifest_replace(&g_manifests, name, ids, count, &released, &released_count);
+    pthread_mutex_unlock(&g_manifest_lock);
+    gc_add_candidates(released, released_count);
+    free(released);
+    return ret;
+}
+
+// 打印块缓存命中统计
+static void print_cache_stats(void) {
+    ChunkCacheStats stats;
+    chunkcache_stats(&g_cache, &stats);
+    dlog_info("Chunk cache: %lu hits, %lu misses, %lu evictions, %lu chunks (%zu/%zu bytes)\n",
+              (unsigned long)stats.hits, (unsigned long)stats.misses, (unsigned long)stats.evictions,
+              (unsigned long)stats.entries, stats.bytes, stats.capacity);
+    BufPoolStats pool;
+    bufpool_stats(&pool);
+    dlog_info("Buffer pool: %lu slabs (%lu huge, %lu bytes), %lu oversized chunks\n",
+              (unsigned long)pool.slabs, (unsigned long)pool.huge_slabs,
+              (unsigned long)pool.slab_bytes, (unsigned long)pool.oversized);
+}
+
+// 接收一个上传块：FastFp、声明的SHA1、大小与数据（见 dedup_proto.h），边接收边计算SHA1
+// 成功返回 0，data 为缓冲区池中的块数据（调用者用 bufpool_put 归还）；SHA1 不符返回 1；连接或参数错误返回 -1
+static int recv_verified_chunk(int client_socket, EVP_MD_CTX *sha_ctx, ChunkId *id,
+                               unsigned char **data, int *size, const char *client_ip) {
+    *data = NULL;
+    if (recv_all(client_socket, &id->fastfp, sizeof(uint64_t)) <= 0 ||
+        recv_all(client_socket, id->sha1, SHA_DIGEST_LENGTH) <= 0) {
+        dlog_error("Failed to receive FastFp from %s: %s\n", client_ip, strerror(errno));
+        return -1;
+    }
+    
+    // 接收块大小
+    int chunk_size;
+    if (recv_all(client_socket, &chunk_size, sizeof(int)) <= 0) {
+        dlog_error("Failed to receive chunk size from %s: %s\n", client_ip, strerror(errno));
+        return -1;
+    }
+    
+    if (chunk_size <= 0 || chunk_size > MAX_CACHE_SIZE) {
+        dlog_error("Invalid chunk size received: %d\n", chunk_size);
+        return -1;
+    }
+    
+    // 接收块数据
+    unsigned char *chunk_data = bufpool_get(chunk_size);
+    if (!chunk_data) {
+        dlog_error("Memory allocation failed for chunk data\n");
+        return -1;
+    }
+    
+    EVP_DigestInit_ex(sha_ctx, EVP_sha1(), NULL);
+    int total_received = 0;
+    while (total_received < chunk_size) {
+        int bytes_received = recv(client_socket, chunk_data + total_received, chunk_size - total_received, 0);
+        if (bytes_received <= 0) {
+            dlog_error("Failed to receive chunk data from %s: %s\n", client_ip, strerror(errno));
+            bufpool_put(chunk_data, chunk_size);
+            return -1;
+        }
+        EVP_DigestUpdate(sha_ctx, chunk_data + total_received, bytes_received);
+        total_received += bytes_received;
+    }
+    metrics_add(METRIC_BYTES_IN, chunk_size);
+    
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    EVP_DigestFinal_ex(sha_ctx, sha1, NULL);
+    if (memcmp(sha1, id->sha1, SHA_DIGEST_LENGTH) != 0) {
+        dlog_warn("SHA1 mismatch for chunk 0x%016lx from %s, discarding\n", id->fastfp, client_ip);
+        bufpool_put(chunk_data, chunk_size);
+        metrics_add(METRIC_CHUNKS_REJECTED, 1);
+        return 1;
+    }
+    metrics_add(METRIC_CHUNKS_RECEIVED, 1);
+    
+    *data = chunk_data;
+    *size = chunk_size;
+    return 0;
+}
+
+// 提交一批块：只在取出待提交的块和发布结果（rename、pack 索引、过滤器）时持有存储锁，
+// syncfs/fsync 期间其他连接可以继续读写
+static int commit_chunks(ChunkBatch *batch) {
+    ChunkCommit commit;
+    pthread_mutex_lock(&g_store_lock);
+    while (!chunkstore_commit_ready(batch)) {
+        pthread_cond_wait(&g_commit_cond, &g_store_lock);
+    }
+    chunkstore_commit_begin(batch, &commit);
+    pthread_mutex_unlock(&g_store_lock);
+    chunkstore_commit_sync(&commit);
+    pthread_mutex_lock(&g_store_lock);
+    chunkstore_commit_finish(&commit);
+    pthread_cond_broadcast(&g_commit_cond);
+    pthread_mutex_unlock(&g_store_lock);
+    return chunkstore_commit_end(&commit);
+}
+
+// 接收 count 个上传块并批量保存（格式见 dedup_proto.h）
+// accepted 非 NULL 时追加已保存的块；rejected 累加 SHA1 不符被丢弃的块数
+// 全部接收并保存成功返回 0；保存失败时仍读完剩余的块以保持连接同步，返回 -1
+static int receive_chunks(int client_socket, int count, ChunkId *accepted, int *accepted_count,
+                          int *rejected, const char *client_ip) {
+    uint64_t start_us = metrics_now_us();
+    ChunkBatch batch;
+    if (chunkstore_batch_open(&batch, g_config.storage_dir, &g_filter, &g_packs, &g_inflight, g_io) != 0) {
+        dlog_error("Failed to open storage directory %s\n", g_config.storage_dir);
+        return -1;
+    }
+    
+    // 上传块的 SHA1 在接收时增量计算，整批复用一个摘要上下文
+    EVP_MD_CTX *sha_ctx = EVP_MD_CTX_new();
+    int ret = 0;
+    if (!sha_ctx) {
+        dlog_error("Failed to allocate SHA1 context\n");
+        ret = -1;
+        count = 0;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        ChunkId id;
+        unsigned char *chunk_data = NULL;
+        int chunk_size = 0;
+        int status = recv_verified_chunk(client_socket, sha_ctx, &id, &chunk_data, &chunk_size, client_ip);
+        if (status < 0) {
+            ret = -1;
+            break;
+        }
+        
+        // 数据损坏或与声明的SHA1不符：丢弃该块，不加入当前文件的列表
+        if (status > 0) {
+            (*rejected)++;
+            continue;
+        }
+        
+        // 保存到文件（先写临时文件，批量提交时统一持久化）
+        char chunk_filename[256];
+        chunkstore_path(g_config.storage_dir, &id, chunk_filename, sizeof(chunk_filename));
+        
+        pthread_mutex_lock(&g_store_lock);
+        int saved = chunkstore_write(&batch, &id, chunk_data, chunk_size);
+        int full = saved == 0 && chunkstore_batch_full(&batch);
+        pthread_mutex_unlock(&g_store_lock);
+        if (full) {
+            saved = commit_chunks(&batch);
+        }
+        if (saved == 0) {
+            metrics_add(METRIC_CHUNKS_STORED, 1);
+            dlog_debug("Saved chunk to %s (size: %d) from client %s\n", chunk_filename, chunk_size, client_ip);
+            if (accepted) {
+                accepted[(*accepted_count)++] = id;
+            }
+        } else {
+            dlog_error("Failed to save chunk to %s\n", chunk_filename);
+            ret = -1;
+        }
+        
+        bufpool_put(chunk_data, chunk_size);
+    }
+    EVP_MD_CTX_free(sha_ctx);
+    metrics_observe(PHASE_UPLOAD, start_us);
+    
+    // 提交剩余的块，确保写入清单前新块已持久化
+    start_us = metrics_now_us();
+    int committed = commit_chunks(&batch);
+    pthread_mutex_lock(&g_store_lock);
+    if (chunkstore_batch_close(&batch) != 0) {
+        committed = -1;
+    }
+    pthread_mutex_unlock(&g_store_lock);
+    metrics_observe(PHASE_COMMIT, start_us);
+    if (committed != 0) {
+        dlog_error("Failed to commit chunks to %s\n", g_config.storage_dir);
+        ret = -1;
+    }
+    return ret;
+}
+
+// 读取下一个请求头；连接正常关闭时返回 0
+static int recv_request_header(int client_socket, int *header) {
+    ssize_t n = recv(client_socket, header, sizeof(int), MSG_WAITALL);
+    if (n == (ssize_t)sizeof(int)) {
+        return 1;
+    }
+    if (n < 0) {
+        dlog_error("Failed to receive request header: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// 回复 CMD_STATS：全局指标加上按需采样的存储、缓存和缓冲区池状态
+static int send_stats(int client_socket, const char *client_ip) {
+    MetricsText text = {0};
+    metrics_render(&text, g_config.server_id);
+    
+    pthread_mutex_lock(&g_store_lock);
+    double stored_chunks = g_filter.count;
+    double write_queue = g_io ? storeio_in_flight(g_io) : 0;
+    pthread_mutex_unlock(&g_store_lock);
+    ChunkCacheStats cache;
+    chunkcache_stats(&g_cache, &cache);
+    BufPoolStats pool;
+    bufpool_stats(&pool);
+    metrics_text_sample(&text, g_config.server_id, "dedup_stored_chunks", "gauge", "Chunks in the store", stored_chunks);
+    metrics_text_sample(&text, g_config.server_id, "dedup_write_queue_depth", "gauge",
+                        "Chunk writes submitted but not completed", write_queue);
+    metrics_text_sample(&text, g_config.server_id, "dedup_cache_hits_total", "counter", "Chunk cache hits", cache.hits);
+    metrics_text_sample(&text, g_config.server_id, "dedup_cache_misses_total", "counter", "Chunk cache misses", cache.misses);
+    metrics_text_sample(&text, g_config.server_id, "dedup_cache_evictions_total", "counter", "Chunk cache evictions",
+                        cache.evictions);
+    metrics_text_sample(&text, g_config.server_id, "dedup_cache_bytes", "gauge", "Bytes held by the chunk cache", cache.bytes);
+    metrics_text_sample(&text, g_config.server_id, "dedup_buffer_pool_bytes", "gauge", "Bytes of chunk buffer slabs",
+                        pool.slab_bytes);
+    
+    int length = text.failed ? -1 : (int)text.len;
+    int ret = 0;
+    if (send_all(client_socket, &length, sizeof(int)) <= 0 ||
+        (length > 0 && send_all(client_socket, text.data, length) <= 0)) {
+        dlog_error("Failed to send stats to %s\n", client_ip);
+        ret = -1;
+    }
+    metrics_text_free(&text);
+    return ret;
+}
+
+// 接收 count 条块记录 { fastfp, sha1 }，返回 malloc 的 ChunkId 数组，失败返回 NULL
+static ChunkId *recv_chunk_ids(int client_socket, int count) {
+    unsigned char *records = malloc((count > 0 ? count : 1) * (size_t)DEDUP_CHUNK_RECORD_SIZE);
+    ChunkId *ids = malloc((count > 0 ? count : 1) * sizeof(ChunkId));
+    if (!records || !ids ||
+        (count > 0 && recv_all(client_socket, records, (size_t)count * DEDUP_CHUNK_RECORD_SIZE) <= 0)) {
+        free(records);
+        free(ids);
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) {
+        memcpy(&ids[i].fastfp, records + i * DEDUP_CHUNK_RECORD_SIZE, sizeof(uint64_t));
+        memcpy(ids[i].sha1, records + i * DEDUP_CHUNK_RECORD_SIZE + sizeof(uint64_t), SHA_DIGEST_LENGTH);
+    }
+    free(records);
+    return ids;
+}
+
+// 接收 CMD_PUT_MANIFEST：用客户端给出的块替换文件的清单（批量备份不经过会话，由客户端逐个文件提交）
+static int receive_manifest(int client_socket, const char *client_ip) {
+    int name_len = 0;
+    if (recv_all(client_socket, &name_len, sizeof(int)) <= 0 || name_len <= 0 || name_len > DEDUP_MAX_NAME) {
+        dlog_error("Invalid manifest name length from %s\n", client_ip);
+        return -1;
+    }
+    char name[name_len + 1];
+    int count = 0;
+    if (recv_all(client_socket, name, name_len) <= 0 ||
+        recv_all(client_socket, &count, sizeof(int)) <= 0 || count < 0 || count > DEDUP_MAX_CHUNKS) {
+        dlog_error("Invalid manifest from %s\n", client_ip);
+        return -1;
+    }
+    name[name_len] = '\0';
+    
+    ChunkId *ids = recv_chunk_ids(client_socket, count);
+    if (!ids) {
+        dlog_error("Failed to receive manifest of %s from %s\n", name, client_ip);
+        return -1;
+    }
+    int status = save_file_manifest(name, ids, count);
+    if (status != 0) {
+        dlog_error("Failed to save manifest of %s in %s\n", name, g_config.storage_dir);
+    }
+    free(ids);
+    return send_all(client_socket, &status, sizeof(int)) > 0 ? 0 : -1;
+}
+
+// 接收 CMD_ADOPT_CHUNKS / CMD_RELEASE_CHUNKS：把块记入遗留清单或从中去掉（--rebalance 合并重复副本时使用）
+static int receive_legacy_update(int client_socket, int cmd, const char *client_ip) {
+    int count = 0;
+    if (recv_all(client_socket, &count, sizeof(int)) <= 0 || count < 0 || count > DEDUP_MAX_CHUNKS) {
+        dlog_error("Invalid chunk count from %s\n", client_ip);
+        return -1;
+    }
+    ChunkId *ids = recv_chunk_ids(client_socket, count);
+    if (!ids) {
+        dlog_error("Failed to receive chunk list from %s\n", client_ip);
+        return -1;
+    }
+    
+    int status;
+    ChunkId *released = NULL;
+    int released_count = 0;
+    pthread_mutex_lock(&g_manifest_lock);
+    if (cmd == CMD_ADOPT_CHUNKS) {
+        // 只接管本节点已存储的块；持有清单锁，检查之后块不会被 CMD_DEL_CHUNK 删除
+        int stored = 0;
+        pthread_mutex_lock(&g_store_lock);
+        for (int i = 0; i < count; i++) {
+            if (chunkstore_contains(g_config.storage_dir, &g_packs, &ids[i])) {
+                ids[stored++] = ids[i];
+            }
+        }
+        pthread_mutex_unlock(&g_store_lock);
+        status = manifest_update(&g_manifests, MANIFEST_LEGACY_NAME, ids, stored, NULL, 0, NULL, NULL);
+        if (status == 0) {
+            status = count - stored;
+        }
+    } else {
+        status = manifest_update(&g_manifests, MANIFEST_LEGACY_NAME, NULL, 0, ids, count,
+                                 &released, &released_count);
+    }
+    pthread_mutex_unlock(&g_manifest_lock);
+    gc_add_candidates(released, released_count);
+    free(released);
+    free(ids);
+    if (status < 0) {
+        dlog_error("Failed to update the legacy manifest in %s\n", g_config.storage_dir);
+    } else {
+        dlog_info("%s %d legacy chunk references for %s\n",
+                  cmd == CMD_ADOPT_CHUNKS ? "Adopted" : "Released", count - (status > 0 ? status : 0), client_ip);
+    }
+    return send_all(client_socket, &status, sizeof(int)) > 0 ? 0 : -1;
+}
+
+// 处理协议命令（见 dedup_proto.h），成功返回 0
+static int handle_command(int client_socket, int cmd, const char *client_ip) {
+    metrics_add(METRIC_COMMANDS, 1);
+    if (cmd == CMD_GET_CHUNK) {
+        uint64_t start_us = metrics_now_us();
+        ChunkId id;
+        if (recv_all(client_socket, &id.fastfp, sizeof(uint64_t)) <= 0 ||
+            recv_all(client_socket, id.sha1, SHA_DIGEST_LENGTH) <= 0) {
+            dlog_error("Failed to receive FastFp for GET from %s\n", client_ip);
+            return -1;
+        }
+        // 先查热点块缓存，未命中再读盘并加入缓存。加入缓存与读盘在同一次持锁内完成，
+        // 否则并发的 DEL 可能在两者之间删除该块，缓存又把它放回去
+        long size = 0;
+        unsigned char *data = chunkcache_get(&g_cache, &id, &size);
+        if (!data) {
+            pthread_mutex_lock(&g_store_lock);
+            data = chunkstore_read(g_config.storage_dir, &g_packs, &id, &size);
+            if (data) {
+                chunkcache_put(&g_cache, &id, data, size);
+            }
+            pthread_mutex_unlock(&g_store_lock);
+        }
+        int reply_size = data ? (int)size : -1;
+        int ret = 0;
+        if (send_all(client_socket, &reply_size, sizeof(int)) <= 0 ||
+            (data && send_all(client_socket, data, size) <= 0)) {
+            dlog_error("Failed to send chunk 0x%016lx to %s\n", id.fastfp, client_ip);
+            ret = -1;
+        } else if (data) {
+            metrics_add(METRIC_CHUNKS_SERVED, 1);
+        }
+        free(data);
+        metrics_observe(PHASE_GET_CHUNK, start_us);
+        return ret;
+    }
+    
+    if (cmd == CMD_LIST_CHUNKS) {
+        int count = 0;
+        pthread_mutex_lock(&g_store_lock);
+        ChunkId *ids = chunkstore_list(g_config.storage_dir, &g_packs, &count);
+        pthread_mutex_unlock(&g_store_lock);
+        unsigned char *records = malloc((count > 0 ? count : 1) * DEDUP_CHUNK_RECORD_SIZE);
+        if (!ids || !records) {
+            dlog_error("Failed to list chunks for %s\n", client_ip);
+            free(ids);
+            free(records);
+            return -1;
+        }
+        for (int i = 0; i < count; i++) {
+            memcpy(records + i * DEDUP_CHUNK_RECORD_SIZE, &ids[i].fastfp, sizeof(uint64_t));
+            memcpy(records + i * DEDUP_CHUNK_RECORD_SIZE + sizeof(uint64_t), ids[i].sha1, SHA_DIGEST_LENGTH);
+        }
+        int ret = 0;
+        if (send_all(client_socket, &count, sizeof(int)) <= 0 ||
+            (count > 0 && send_all(client_socket, records, (size_t)count * DEDUP_CHUNK_RECORD_SIZE) <= 0)) {
+            dlog_error("Failed to send chunk list to %s\n", client_ip);
+            ret = -1;
+        }
+        free(ids);
+        free(records);
+        return ret;
+    }
+    
+    if (cmd == CMD_PUT_CHUNK || cmd == CMD_PUT_BATCH) {
+        int count = 1;
+        if (cmd == CMD_PUT_BATCH &&
+            (recv_all(client_socket, &count, sizeof(int)) <= 0 || count < 0 || count > DEDUP_MAX_CHUNKS)) {
+            dlog_error("Invalid batch size from %s\n", client_ip);
+            return -1;
+        }
+        int rejected = 0;
+        int ret = receive_chunks(client_socket, count, NULL, NULL, &rejected, client_ip);
+        int status = ret != 0 ? -1 : rejected;
+        dlog_info("Stored %d of %d chunks from %s\n", count - rejected, count, client_ip);
+        if (send_all(client_socket, &status, sizeof(int)) <= 0) {
+            return -1;
+        }
+        return ret;
+    }
+    
+    if (cmd == CMD_DEL_CHUNK) {
+        ChunkId id;
+        if (recv_all(client_socket, &id.fastfp, sizeof(uint64_t)) <= 0 ||
+            recv_all(client_socket, id.sha1, SHA_DIGEST_LENGTH) <= 0) {
+            dlog_error("Failed to receive FastFp for DEL from %s\n", client_ip);
+            return -1;
+        }
+        // 仍被某个文件的清单引用的块不能删除，否则该文件的配方无法读回
+        pthread_mutex_lock(&g_manifest_lock);
+        int status = 2;
+        if (manifest_refs(&g_manifests, &id) == 0) {
+            pthread_mutex_lock(&g_store_lock);
+            status = chunkstore_remove(g_config.storage_dir, &g_packs, &id);
+            if (status == 0) {
+                fpfilter_remove(&g_filter, id.fastfp);
+                chunkcache_remove(&g_cache, &id);
+            }
+            pthread_mutex_unlock(&g_store_lock);
+        }
+        pthread_mutex_unlock(&g_manifest_lock);
+        if (status == 0) {
+            dlog_debug("Deleted chunk 0x%016lx on request from %s\n", id.fastfp, client_ip);
+        }
+        return send_all(client_socket, &status, sizeof(int)) > 0 ? 0 : -1;
+    }
+    
+    if (cmd == CMD_GET_FILTER) {
+        FpFilterBits bits;
+        pthread_mutex_lock(&g_store_lock);
+        int exported = fpfilter_export(&g_filter, &bits);
+        pthread_mutex_unlock(&g_store_lock);
+        if (exported != 0) {
+            dlog_error("Failed to export filter for %s\n", client_ip);
+            return -1;
+        }
+        int ret = 0;
+        if (send_all(client_socket, &bits.log2_size, sizeof(uint32_t)) <= 0 ||
+            send_all(client_socket, bits.bits, fpfilter_bits_bytes(bits.log2_size)) <= 0) {
+            dlog_error("Failed to send filter to %s\n", client_ip);
+            ret = -1;
+        }
+        fpfilter_bits_free(&bits);
+        return ret;
+    }
+    
+    if (cmd == CMD_STATS) {
+        return send_stats(client_socket, client_ip);
+    }
+    
+    if (cmd == CMD_PUT_MANIFEST) {
+        return receive_manifest(client_socket, client_ip);
+    }
+    
+    if (cmd == CMD_ADOPT_CHUNKS || cmd == CMD_RELEASE_CHUNKS) {
+        return receive_legacy_update(client_socket, cmd, client_ip);
+    }
+
+    dlog_error("Unknown command %d from %s\n", cmd, client_ip);
+    return -1;
+}
+
+// 去重会话：逐个确认客户端给出的候选块是否已存储、接收新块并更新本文件的清单（格式见 dedup_proto.h）
+// 连接出错返回 -1
+static int dedup_session(int client_socket, const char *filename, const char *client_ip) {
+    // 接收候选块：客户端用本节点的布隆过滤器筛过，每条带 SHA1，服务端只做精确查找
+    int match_count = 0;
+    if (recv_all(client_socket, &match_count, sizeof(int)) <= 0) {
+        dlog_error("Failed to receive match count from %s: %s\n", client_ip, strerror(errno));
+        return -1;
+    }
+    
+    if (match_count < 0 || match_count > DEDUP_MAX_CHUNKS) {
+        dlog_error("Invalid match count received: %d\n", match_count);
+        return -1;
+    }
+    
+    dlog_info("Client asked for %d candidate chunks\n", match_count);
+    
+    // 本文件在本节点上用到的块：查询命中的块加上本次上传的块，会话成功后写入清单
+    ChunkId *file_chunks = NULL;
+    int file_chunk_count = 0;
+    if (match_count > 0) {
+        unsigned char *records = malloc((size_t)match_count * DEDUP_CHUNK_RECORD_SIZE);
+        unsigned char *sha1_hashes = malloc(match_count * SHA_DIGEST_LENGTH);
+        file_chunks = malloc(match_count * sizeof(ChunkId));
+        if (!records || !sha1_hashes || !file_chunks) {
+            dlog_error("Memory allocation failed for candidate chunks\n");
+            free(records);
+            free(sha1_hashes);
+            free(file_chunks);
+            return -1;
+        }
+        if (recv_all(client_socket, records, (size_t)match_count * DEDUP_CHUNK_RECORD_SIZE) <= 0) {
+            dlog_error("Failed to receive candidate chunks from %s: %s\n", client_ip, strerror(errno));
+            free(records);
+            free(sha1_hashes);
+            free(file_chunks);
+            return -1;
+        }
+        
+        // 块由 (FastFp, SHA1) 确定，已存储的块回复其 SHA1，否则回复全 0
+        uint64_t phase_start_us = metrics_now_us();
+        metrics_add(METRIC_LOOKUPS, match_count);
+        pthread_mutex_lock(&g_store_lock);
+        for (int i = 0; i < match_count; i++) {
+            ChunkId id;
+            memcpy(&id.fastfp, records + i * DEDUP_CHUNK_RECORD_SIZE, sizeof(uint64_t));
+            memcpy(id.sha1, records + i * DEDUP_CHUNK_RECORD_SIZE + sizeof(uint64_t), SHA_DIGEST_LENGTH);
+            if (fpfilter_maybe_contains(&g_filter, id.fastfp) &&
+                chunkstore_contains(g_config.storage_dir, &g_packs, &id)) {
+                metrics_add(METRIC_LOOKUP_HITS, 1);
+                memcpy(sha1_hashes + i * SHA_DIGEST_LENGTH, id.sha1, SHA_DIGEST_LENGTH);
+                file_chunks[file_chunk_count++] = id;
+            } else {
+                memset(sha1_hashes + i * SHA_DIGEST_LENGTH, 0, SHA_DIGEST_LENGTH);
+                dlog_debug("Chunk 0x%016lx not found locally, sending empty SHA1\n", id.fastfp);
+            }
+        }
+        pthread_mutex_unlock(&g_store_lock);
+        free(records);
+        
+        // 发送SHA1哈希给客户端
+        if (send_all(client_socket, sha1_hashes, match_count * SHA_DIGEST_LENGTH) <= 0) {
+            dlog_error("Failed to send SHA1 hashes to %s: %s\n", client_ip, strerror(errno));
+            free(sha1_hashes);
+            free(file_chunks);
+            return -1;
+        }
+        
+        free(sha1_hashes);
+        metrics_observe(PHASE_SHA1_LOOKUP, phase_start_us);
+    } else {
+        dlog_info("No candidate chunks to look up\n");
+    }
+    
+    // 接收需要上传的新块
+    int upload_count = 0;
+    if (recv_all(client_socket, &upload_count, sizeof(int)) <= 0) {
+        dlog_error("Failed to receive upload count from %s: %s\n", client_ip, strerror(errno));
+        free(file_chunks);
+        return -1;
+    }
+    
+    if (upload_count < 0 || upload_count > DEDUP_MAX_CHUNKS) {
+        dlog_error("Invalid upload count received: %d\n", upload_count);
+        free(file_chunks);
+        return -1;
+    }
+    
+    dlog_info("Receiving %d new chunks from client %s\n", upload_count, client_ip);
+    
+    int error_occurred = 0;
+    int rejected = 0;
+    ChunkId *grown = realloc(file_chunks, (file_chunk_count + upload_count + 1) * sizeof(ChunkId));
+    if (!grown) {
+        dlog_error("Memory allocation failed for current file chunks\n");
+        error_occurred = 1;
+    } else {
+        file_chunks = grown;
+    }
+    
+    if (!error_occurred &&
+        receive_chunks(client_socket, upload_count, file_chunks, &file_chunk_count, &rejected, client_ip) != 0) {
+        error_occurred = 1;
+    }
+    if (rejected > 0) {
+        dlog_warn("Rejected %d corrupt chunks from %s\n", rejected, client_ip);
+    }
+    
+    // 所有块都已保存且通过校验时才替换本文件的清单；清单落盘后再回复结果，
+    // 客户端据此保存的配方引用的块此后都受清单保护
+    if (!error_occurred && !rejected) {
+        if (save_file_manifest(filename, file_chunks, file_chunk_count) != 0) {
+            dlog_error("Failed to save manifest of %s in %s\n", filename, g_config.storage_dir);
+            error_occurred = 1;
+        }
+    } else {
+        dlog_warn("Error occurred during processing, keeping the previous manifest of %s\n", filename);
+    }
+    
+    // 回复上传结果：被拒绝的块数，出错时为 -1
+    int upload_status = error_occurred ? -1 : rejected;
+    if (send_all(client_socket, &upload_status, sizeof(int)) <= 0) {
+        dlog_error("Failed to send upload status to %s: %s\n", client_ip, strerror(errno));
+    }
+    
+    free(file_chunks);
+    
+    return 0;
+}
+
+// 列出、写入、删除块和修改清单的命令在所在的流关闭前暂停回收：客户端据块列表判断某些块已存在、
+// 随后用 CMD_PUT_MANIFEST 引用它们，期间这些块不能被删除
+static int command_pins_gc(int cmd) {
+    return cmd == CMD_LIST_CHUNKS || cmd == CMD_PUT_CHUNK || cmd == CMD_PUT_BATCH ||
+           cmd == CMD_DEL_CHUNK || cmd == CMD_PUT_MANIFEST ||
+           cmd == CMD_ADOPT_CHUNKS || cmd == CMD_RELEASE_CHUNKS;
+}
+
+// 处理一条连接上的请求；执行过暂停回收的命令时把 *pinned 置 1，由调用者在连接结束时解除
+static void serve_client(int client_socket, struct sockaddr_in *client_addr, int *pinned) {
+    char client_ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &(client_addr->sin_addr), client_ip, INET_ADDRSTRLEN);
+    dlog_info("Handling client connection from %s\n", client_ip);
+    
+    // 确保目录存在
+    create_directory_if_not_exists(g_config.storage_dir);
+    
+    // 接收文件名（负数为命令字，可在会话前连续执行多个命令）
+    int name_len;
+    if (recv_all(client_socket, &name_len, sizeof(int)) <= 0) {
+        dlog_error("Failed to receive filename length from %s: %s\n", client_ip, strerror(errno));
+        return;
+    }
+    while (name_len < 0) {
+        if (!*pinned && command_pins_gc(name_len)) {
+            gc_enter();
+            *pinned = 1;
+        }
+        if (handle_command(client_socket, name_len, client_ip) != 0) {
+            return;
+        }
+        if (recv_request_header(client_socket, &name_len) <= 0) {
+            dlog_info("Finished handling commands from %s on server%d\n", client_ip, g_config.server_id);
+            // 迁移命令可能修改了块集合
+            pthread_mutex_lock(&g_store_lock);
+            int synced = chunkstore_filter_sync(g_config.storage_dir, &g_packs, &g_filter);
+            pthread_mutex_unlock(&g_store_lock);
+            if (synced != 0) {
+                dlog_error("Failed to save FastFp filter in %s\n", g_config.storage_dir);
+            }
+            print_cache_stats();
+            return;
+        }
+    }
+    
+    if (name_len <= 0 || name_len > DEDUP_MAX_NAME) {
+        dlog_error("Invalid filename length: %d\n", name_len);
+        return;
+    }
+    
+    char filename[name_len + 1];
+    if (recv_all(client_socket, filename, name_len) <= 0) {
+        dlog_error("Failed to receive filename from %s: %s\n", client_ip, strerror(errno));
+        return;
+    }
+    filename[name_len] = '\0';
+    
+    dlog_info("Received file: %s from client %s\n", filename, client_ip);
+    uint64_t session_start_us = metrics_now_us();
+    
+    // 接收文件大小
+    long file_size = 0;
+    if (recv_all(client_socket, &file_size, sizeof(long)) <= 0) {
+        dlog_error("Failed to receive file size from %s: %s\n", client_ip, strerror(errno));
+        return;
+    }
+    
+    dlog_info("Receiving file of size: %ld bytes\n", file_size);
+    
+    // 丢弃文件内容
+    unsigned char buffer[4096];
+    long total_size = 0;
+    ssize_t bytes_read;
+    // 只读到文件末尾：客户端不等回复就接着发送候选块
+    while (total_size < file_size &&
+           (bytes_read = recv(client_socket, buffer,
+                              file_size - total_size < (long)sizeof(buffer) ? (size_t)(file_size - total_size)
+                                                                            : sizeof(buffer), 0)) > 0) {
+        total_size += bytes_read;
+    }
+    metrics_add(METRIC_BYTES_IN, total_size);
+    
+    if (total_size != file_size) {
+        dlog_warn("Expected %ld bytes but received %ld bytes\n", file_size, total_size);
+    }
+    
+    // 会话期间暂停回收：查询到的块在写入本文件的清单之前不能被删除
+    gc_enter();
+    int session_ret = dedup_session(client_socket, filename, client_ip);
+    gc_leave();
+    if (session_ret != 0) {
+        return;
+    }
+    
+    // 过滤器随存储目录一起持久化
+    pthread_mutex_lock(&g_store_lock);
+    int synced = chunkstore_filter_sync(g_config.storage_dir, &g_packs, &g_filter);
+    pthread_mutex_unlock(&g_store_lock);
+    if (synced != 0) {
+        dlog_error("Failed to save FastFp filter in %s\n", g_config.storage_dir);
+    }
+    
+    metrics_add(METRIC_SESSIONS, 1);
+    metrics_observe(PHASE_SESSION, session_start_us);
+    dlog_info("Finished handling client %s on server%d\n", client_ip, g_config.server_id);
+    print_cache_stats();
+}
+
+// 处理客户端连接
+static void handle_client(int client_socket, struct sockaddr_in *client_addr) {
+    int pinned = 0;
+    serve_client(client_socket, client_addr, &pinned);
+    if (pinned) {
+        gc_leave();
+    }
+}
+
+// 多路复用连接上的一个逻辑流，按一条普通连接处理
+static void handle_stream(int stream_fd, void *arg) {
+    metrics_gauge_add(GAUGE_STREAMS, 1);
+    handle_client(stream_fd, (struct sockaddr_in *)arg);
+    metrics_gauge_add(GAUGE_STREAMS, -1);
+}
+
+typedef struct {
+    int socket;
+    struct sockaddr_in addr;
+} ClientConnection;
+
+// 每个连接一个线程：以 CMD_MUX 开始的长连接上可以并发多个会话
+static void *connection_thread(void *arg) {
+    ClientConnection *conn = arg;
+    metrics_gauge_add(GAUGE_CONNECTIONS, 1);
+    int header = 0;
+    if (recv(conn->socket, &header, sizeof(int), MSG_PEEK | MSG_WAITALL) == (ssize_t)sizeof(int) &&
+        header == CMD_MUX) {
+        char client_ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &conn->addr.sin_addr, client_ip, INET_ADDRSTRLEN);
+        recv(conn->socket, &header, sizeof(int), MSG_WAITALL);
+        dlog_info("Multiplexed connection from %s\n", client_ip);
+        mux_serve(conn->socket, handle_stream, &conn->addr);
+        dlog_info("Closed multiplexed connection from %s\n", client_ip);
+    } else {
+        handle_stream(conn->socket, &conn->addr);
+    }
+    metrics_gauge_add(GAUGE_CONNECTIONS, -1);
+    close(conn->socket);
+    free(conn);
+    return NULL;
+}
+
+// 加载文件清单。清单目录是新建的（首次启用清单的旧存储目录）时，现有的块可能被客户端已有的配方引用，
+// 全部记入遗留清单，永不回收
+static int open_manifests(void) {
+    int created = 0;
+    if (manifest_open(&g_manifests, g_config.storage_dir, &created) != 0) {
+        dlog_error("Failed to load file manifests in %s\n", g_config.storage_dir);
+        return -1;
+    }
+    if (created) {
+        int count = 0;
+        ChunkId *stored = chunkstore_list(g_config.storage_dir, &g_packs, &count);
+        if (!stored || manifest_replace(&g_manifests, MANIFEST_LEGACY_NAME, stored, count, NULL, NULL) != 0) {
+            dlog_error("Failed to record existing chunks in %s/%s\n", g_config.storage_dir, MANIFEST_DIR);
+            free(stored);
+            manifest_close(&g_manifests);
+            // 下次启动时重新记录
+            char dir[DEDUPSTORE_DIR_MAX + 32];
+            snprintf(dir, sizeof(dir), "%s/%s", g_config.storage_dir, MANIFEST_DIR);
+            rmdir(dir);
+            return -1;
+        }
+        free(stored);
+        dlog_info("Recorded %d existing chunks as referenced\n", count);
+    }
+    dlog_info("File manifests: %d files, %zu chunks\n", g_manifests.files, g_manifests.count);
+    return 0;
+}
+
+void dedupstore_default_config(DedupStoreConfig *config, int server_id) {
+    memset(config, 0, sizeof(*config));
+    config->server_id = server_id;
+    config->port = 8080 + server_id;
+    snprintf(config->storage_dir, sizeof(config->storage_dir), "./server%dfile", server_id);
+    config->pack_max = FASTCDC_NORMAL_MIN_SIZE(FASTCDC_DEFAULT_AVG_SIZE);
+}
+
+int dedupstore_open(const DedupStoreConfig *config) {
+    g_config = *config;
+    
+    // 确保目录存在，并清理上次崩溃遗留的临时文件
+    create_directory_if_not_exists(g_config.storage_dir);
+    int stale = chunkstore_recover(g_config.storage_dir);
+    if (stale > 0) {
+        dlog_info("Removed %d incomplete chunk writes from %s\n", stale, g_config.storage_dir);
+    }
+    int migrated = chunkstore_migrate(g_config.storage_dir);
+    if (migrated > 0) {
+        dlog_info("Renamed %d chunks in %s to the <fastfp>-<sha1> layout\n", migrated, g_config.storage_dir);
+    }
+    if (packstore_open(&g_packs, g_config.storage_dir, g_config.pack_max) != 0) {
+        dlog_error("Failed to open packed chunks in %s\n", g_config.storage_dir);
+        return -1;
+    }
+    long reclaimed = packstore_compact(&g_packs);
+    if (reclaimed > 0) {
+        dlog_info("Packed chunks: %d (up to %d bytes), reclaimed %ld bytes\n", g_packs.live_count,
+                  g_packs.max_object, reclaimed);
+    } else {
+        dlog_info("Packed chunks: %d (up to %d bytes)\n", g_packs.live_count, g_packs.max_object);
+    }
+    if (chunkstore_filter_open(g_config.storage_dir, &g_packs, &g_filter) != 0) {
+        dlog_error("Failed to load FastFp filter for %s\n", g_config.storage_dir);
+        return -1;
+    }
+    dlog_info("FastFp filter: %lu chunks, %u counters\n", (unsigned long)g_filter.count, 1U << g_filter.log2_size);
+    if (open_manifests() != 0) {
+        return -1;
+    }
+    if (chunkcache_init(&g_cache, CHUNK_CACHE_BYTES) != 0) {
+        dlog_error("Failed to allocate chunk cache\n");
+        return -1;
+    }
+    if (bufpool_init(1)) {
+        dlog_info("Chunk buffers: huge pages\n");
+    } else {
+        dlog_info("Chunk buffers: huge pages unavailable, using normal pages\n");
+    }
+    g_io = storeio_open(STOREIO_AUTO);
+    if (g_io) {
+        dlog_info("Chunk writes: %s, %d in flight\n", storeio_backend_name(g_io), STOREIO_DEPTH);
+    } else {
+        dlog_warn("Async chunk writes unavailable, writing synchronously\n");
+    }
+    return 0;
+}
+
+int dedupstore_serve(void) {
+    int server_fd, new_socket;
+    struct sockaddr_in address;
+    int opt = 1;
+    int addrlen = sizeof(address);
+    
+    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        perror("socket failed");
+        return -1;
+    }
+    
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
+        perror("setsockopt");
+        close(server_fd);
+        return -1;
+    }
+    
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(g_config.port);
+    
+    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("bind failed");
+        close(server_fd);
+        return -1;
+    }
+    
+    if (listen(server_fd, 3) < 0) {
+        perror("listen");
+        close(server_fd);
+        return -1;
+    }
+    
+    dlog_info("Server%d listening on port %d, storing chunks in %s/\n", g_config.server_id, g_config.port,
+              g_config.storage_dir);
+    
+    while(1) {
+        if ((new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen)) < 0) {
+            perror("accept");
+            continue;
+        }
+        
+        ClientConnection *conn = malloc(sizeof(ClientConnection));
+        pthread_t thread;
+        if (!conn) {
+            close(new_socket);
+            continue;
+        }
+        conn->socket = new_socket;
+        conn->addr = address;
+        if (pthread_create(&thread, NULL, connection_thread, conn) != 0) {
+            dlog_error("Failed to start connection thread\n");
+            close(new_socket);
+            free(conn);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    
+    return 0;
+}
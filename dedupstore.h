@@ -0,0 +1,29 @@
+#pragma once
+/**
+ * 存储节点（libdedupstore）
+ *
+ * 原 server1.c~server4.c 的全部逻辑：块存储的打开与恢复、去重会话、CMD_* 命令、多路复用连接。
+ * 四个节点只在编号、端口和存储目录上不同，由调用者在运行时传入（见 server.c）。
+ * 一个进程只运行一个存储节点。
+ */
+
+// 存储目录路径上限，块文件路径在其后再拼接 "<fastfp>-<sha1>.chunk"
+#define DEDUPSTORE_DIR_MAX 256
+
+typedef struct {
+    int server_id;                  // 节点编号（1 起），用于日志和指标标签
+    int port;
+    char storage_dir[DEDUPSTORE_DIR_MAX];
+    int pack_max;                   // 不超过该大小的块打包存储（0~PACKSTORE_MAX_OBJECT，0 不打包）
+} DedupStoreConfig;
+
+// 按 server_id 填入默认配置：端口 8080 + server_id，存储目录 ./server<id>file，
+// 打包阈值为默认平均块长下的最小块长（只有小文件和文件尾块会小于它）
+void dedupstore_default_config(DedupStoreConfig *config, int server_id);
+
+// 打开存储目录：清理崩溃遗留的临时文件、迁移旧布局、加载 pack 与过滤器，初始化缓存、缓冲池和写入队列。
+// 失败返回 -1
+int dedupstore_open(const DedupStoreConfig *config);
+
+// 监听端口，每个连接一个线程；只在监听失败时返回 -1
+int dedupstore_serve(void);
@@ -0,0 +1,155 @@
+// dlog.c - 分级日志
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "dlog.h"
+
+DlogLevel g_dlog_level = DLOG_INFO;
+
+static const char *g_level_names[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+// 环形缓冲区：head/tail 为只增不减的字节序号，[tail, head) 为待刷出的日志
+static struct {
+    int async;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;         // 有日志待刷出或需要立即刷出
+    pthread_cond_t drained;       // 刷出线程推进了 tail
+    char ring[DLOG_RING_SIZE];
+    unsigned long head;
+    unsigned long tail;
+    pthread_t thread;
+} g_log = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .ready = PTHREAD_COND_INITIALIZER,
+    .drained = PTHREAD_COND_INITIALIZER,
+};
+
+static void write_fully(const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, data, len);
+        if (n <= 0) {
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+static void *flush_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_log.lock);
+    for (;;) {
+        // 没有待刷出的日志时等待唤醒或超时，期间写入的日志攒成一批 write
+        if (g_log.head == g_log.tail) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += DLOG_FLUSH_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&g_log.ready, &g_log.lock, &deadline);
+            continue;
+        }
+        // 生产者只写 head 之后的空间，[tail, head) 在刷出期间不会被覆盖
+        unsigned long tail = g_log.tail, head = g_log.head;
+        pthread_mutex_unlock(&g_log.lock);
+        size_t start = tail % DLOG_RING_SIZE;
+        size_t len = head - tail;
+        size_t first = len < DLOG_RING_SIZE - start ? len : DLOG_RING_SIZE - start;
+        write_fully(g_log.ring + start, first);
+        write_fully(g_log.ring, len - first);
+        pthread_mutex_lock(&g_log.lock);
+        g_log.tail = head;
+        pthread_cond_broadcast(&g_log.drained);
+    }
+    return NULL;
+}
+
+static void ring_push(const char *line, size_t len, int urgent) {
+    pthread_mutex_lock(&g_log.lock);
+    while (DLOG_RING_SIZE - (g_log.head - g_log.tail) < len) {
+        pthread_cond_signal(&g_log.ready);
+        pthread_cond_wait(&g_log.drained, &g_log.lock);
+    }
+    size_t start = g_log.head % DLOG_RING_SIZE;
+    size_t first = len < DLOG_RING_SIZE - start ? len : DLOG_RING_SIZE - start;
+    memcpy(g_log.ring + start, line, first);
+    memcpy(g_log.ring, line + first, len - first);
+    g_log.head += len;
+    if (urgent || g_log.head - g_log.tail >= DLOG_RING_SIZE / 2) {
+        pthread_cond_signal(&g_log.ready);
+    }
+    pthread_mutex_unlock(&g_log.lock);
+}
+
+void dlog_write(DlogLevel level, const char *fmt, ...) {
+    va_list ap;
+    if (!g_log.async) {
+        va_start(ap, fmt);
+        vprintf(fmt, ap);
+        va_end(ap);
+        return;
+    }
+
+    char line[DLOG_LINE_MAX];
+    struct timeval now;
+    struct tm tm;
+    gettimeofday(&now, NULL);
+    localtime_r(&now.tv_sec, &tm);
+    size_t len = strftime(line, sizeof(line), "%Y-%m-%d %H:%M:%S", &tm);
+    len += snprintf(line + len, sizeof(line) - len, ".%03ld %-5s ", (long)now.tv_usec / 1000,
+                    g_level_names[level]);
+    va_start(ap, fmt);
+    int n = vsnprintf(line + len, sizeof(line) - len, fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        return;
+    }
+    len += (size_t)n;
+    if (len >= sizeof(line)) {
+        // 截断的行仍以换行结束
+        len = sizeof(line) - 1;
+        line[len - 1] = '\n';
+    }
+    ring_push(line, len, level >= DLOG_WARN);
+}
+
+void dlog_flush(void) {
+    if (g_log.async) {
+        pthread_mutex_lock(&g_log.lock);
+        while (g_log.tail != g_log.head) {
+            pthread_cond_signal(&g_log.ready);
+            pthread_cond_wait(&g_log.drained, &g_log.lock);
+        }
+        pthread_mutex_unlock(&g_log.lock);
+    } else {
+        fflush(stdout);
+    }
+}
+
+void dlog_init(DlogMode mode) {
+    const char *level = getenv("DEDUP_LOG_LEVEL");
+    if (level) {
+        for (int i = DLOG_DEBUG; i <= DLOG_ERROR; i++) {
+            if (strcasecmp(level, g_level_names[i]) == 0) {
+                g_dlog_level = (DlogLevel)i;
+            }
+        }
+    }
+    if (mode == DLOG_SERVICE && !g_log.async) {
+        fflush(stdout);
+        if (pthread_create(&g_log.thread, NULL, flush_thread, NULL) == 0) {
+            pthread_detach(g_log.thread);
+            g_log.async = 1;
+            atexit(dlog_flush);
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+/**
+ * 分级日志
+ *
+ * 日志级别由环境变量 DEDUP_LOG_LEVEL（debug/info/warn/error）决定，默认 info：逐块的明细
+ * （保存、删除、校验的每个块）只在 debug 级别输出。低于当前级别的调用只有一次整数比较，
+ * 不会格式化参数。
+ *
+ * DLOG_SERVICE 模式（服务端）：每行加时间戳和级别，格式化后复制进 DLOG_RING_SIZE 的环形缓冲区立即返回，
+ * 由后台线程每 DLOG_FLUSH_MS 毫秒或缓冲区过半时批量 write 到标准输出；缓冲区满时调用者等待刷出，
+ * 不丢日志。warn 及以上级别立即唤醒刷出线程。进程正常退出时刷出剩余日志，崩溃时最后一批可能丢失。
+ * DLOG_CONSOLE 模式（客户端）：直接 printf，不加前缀，与其他终端输出保持顺序。
+ */
+
+typedef enum {
+    DLOG_DEBUG,
+    DLOG_INFO,
+    DLOG_WARN,
+    DLOG_ERROR
+} DlogLevel;
+
+typedef enum {
+    DLOG_CONSOLE,
+    DLOG_SERVICE
+} DlogMode;
+
+#define DLOG_RING_SIZE (1 << 20)
+#define DLOG_LINE_MAX 1024        // 单行（含前缀）上限，超长截断
+#define DLOG_FLUSH_MS 100
+
+extern DlogLevel g_dlog_level;
+
+// 读取 DEDUP_LOG_LEVEL 并按 mode 启动日志；未调用时按 DLOG_CONSOLE、info 级别输出
+void dlog_init(DlogMode mode);
+// 等待已写入的日志全部刷出
+void dlog_flush(void);
+
+void dlog_write(DlogLevel level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define dlog_enabled(level) ((level) >= g_dlog_level)
+#define dlog_debug(...) do { if (dlog_enabled(DLOG_DEBUG)) dlog_write(DLOG_DEBUG, __VA_ARGS__); } while (0)
+#define dlog_info(...) do { if (dlog_enabled(DLOG_INFO)) dlog_write(DLOG_INFO, __VA_ARGS__); } while (0)
+#define dlog_warn(...) do { if (dlog_enabled(DLOG_WARN)) dlog_write(DLOG_WARN, __VA_ARGS__); } while (0)
+#define dlog_error(...) dlog_write(DLOG_ERROR, __VA_ARGS__)
@@ -1,7 +1,9 @@
 // fastcdc.c - FastCDC算法实现
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <openssl/md5.h>
+#include <openssl/sha.h>
 #include "fastcdc.h"
 
 // 预定义 Gear 表（与原 fastcdc.h 中一致）
@@ -103,6 +105,33 @@ uint64_t FING_GEAR_08KB_64 = 0x0000d93003530000ULL;
 uint64_t FING_GEAR_02KB_64 = 0x0000d90003530000ULL;
 uint64_t FING_GEAR_32KB_64 = 0x0000d9f003530000ULL;
 
+// 按 1 的个数索引的 Gear 掩码，1 均匀分布在第 16~47 位；
+// 11/13/15 位沿用上面的 2KB/8KB/32KB 掩码，保证 8KB 平均块长时分块结果不变
+#define GEAR_MASK_10 0x0000124912490000ULL
+#define GEAR_MASK_11 0x0000d90003530000ULL
+#define GEAR_MASK_12 0x0000252525250000ULL
+#define GEAR_MASK_13 0x0000d93003530000ULL
+#define GEAR_MASK_14 0x00002a552a550000ULL
+#define GEAR_MASK_15 0x0000d9f003530000ULL
+#define GEAR_MASK_16 0x0000555555550000ULL
+#define GEAR_MASK_17 0x00005555aaab0000ULL
+#define GEAR_MASK_18 0x000055ab55ab0000ULL
+#define GEAR_MASK_19 0x000056b5ad6b0000ULL
+#define GEAR_MASK_20 0x00005b5b5b5b0000ULL
+#define GEAR_MASK_21 0x00005b6db6db0000ULL
+#define GEAR_MASK_22 0x00006db76db70000ULL
+
+static const uint64_t gear_masks[] = {
+    [10] = GEAR_MASK_10, [11] = GEAR_MASK_11, [12] = GEAR_MASK_12, [13] = GEAR_MASK_13,
+    [14] = GEAR_MASK_14, [15] = GEAR_MASK_15, [16] = GEAR_MASK_16, [17] = GEAR_MASK_17,
+    [18] = GEAR_MASK_18, [19] = GEAR_MASK_19, [20] = GEAR_MASK_20, [21] = GEAR_MASK_21,
+    [22] = GEAR_MASK_22,
+};
+
+// 当前平均块长对应的掩码：MaskA 用于原始算法，MaskS/MaskL 用于归一化分块
+uint64_t MaskA_64, MaskS_64, MaskL_64;
+uint64_t MaskA_ls_64, MaskS_ls_64, MaskL_ls_64;
+
 struct timeval tmStart, tmEnd;
 float totalTm = 0;
 int chunk_dist[30] = {0};
@@ -116,11 +145,14 @@ uint64_t Mask_11_64 = 0, Mask_15_64 = 0;
 uint32_t MinSize = 0;
 uint32_t MinSize_divide_by_2 = 0;
 uint32_t MaxSize = 0;
+uint32_t AvgSize = FASTCDC_DEFAULT_AVG_SIZE;
+uint32_t NormalMinSize = 0;
 int sameCount = 0;
 int tmpCount = 0;
 int smalChkCnt = 0;  // 记录小于8KB的分块
 
-int (*chunking)(unsigned char *p, int n, uint64_t *feature, uint64_t *weakhash) = NULL;
+chunking_fn chunking = NULL;
+static int current_algorithm = NORMALIZED_CDC;
 
 void fastCDC_init(void) {
     unsigned char md5_digest[16];
@@ -137,39 +169,169 @@ void fastCDC_init(void) {
         LEARv2[i] = GEARv2[i] << 1;
     }
 
-    MinSize = 8192 / 4;
-    MaxSize = 8192 * 4;
+    int bits = 0;
+    while ((1U << bits) < AvgSize) bits++;
+    MinSize = AvgSize / 4;
+    MaxSize = AvgSize * 4;
+    NormalMinSize = FASTCDC_NORMAL_MIN_SIZE(AvgSize);
+    MaskA_64 = gear_masks[bits];
+    MaskS_64 = gear_masks[bits + 2];
+    MaskL_64 = gear_masks[bits - 2];
+    MaskA_ls_64 = MaskA_64 << 1;
+    MaskS_ls_64 = MaskS_64 << 1;
+    MaskL_ls_64 = MaskL_64 << 1;
     Mask_15 = 0xf9070353U;
     Mask_11 = 0xd9000353U;
     Mask_11_64 = 0x0000d90003530000ULL;
     Mask_15_64 = 0x0000f90703530000ULL;
     MinSize_divide_by_2 = MinSize / 2;
+
+    fastCDC_select(current_algorithm);
 }
 
-int normalized_chunking_64(unsigned char *p, int n, uint64_t *feature, uint64_t *weakhash) {
+int fastCDC_set_avg_size(uint32_t avg_size) {
+    if (avg_size < FASTCDC_MIN_AVG_SIZE || avg_size > FASTCDC_MAX_AVG_SIZE ||
+        (avg_size & (avg_size - 1)) != 0) {
+        return -1;
+    }
+    AvgSize = avg_size;
+    return 0;
+}
+
+static const char *algorithm_names[] = {NULL, "origin", "rolling2", "normalized", "normalized2"};
+
+static chunking_fn normalized_specialized(uint32_t avg_size, int two_bytes);
+
+int fastCDC_select(int algorithm) {
+    chunking_fn fn = NULL;
+    switch (algorithm) {
+    case ORIGIN_CDC:        chunking = cdc_origin_64; break;
+    case ROLLING_2Bytes:    chunking = rolling_data_2byes_64; break;
+    case NORMALIZED_CDC:
+        fn = normalized_specialized(AvgSize, 0);
+        chunking = fn ? fn : normalized_chunking_64;
+        break;
+    case NORMALIZED_2Bytes:
+        fn = normalized_specialized(AvgSize, 1);
+        chunking = fn ? fn : normalized_chunking_2byes_64;
+        break;
+    default: return -1;
+    }
+    current_algorithm = algorithm;
+    return 0;
+}
+
+int fastCDC_parse_algorithm(const char *name) {
+    for (int i = ORIGIN_CDC; i <= NORMALIZED_2Bytes; i++) {
+        if (strcmp(name, algorithm_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+const char *fastCDC_algorithm_name(int algorithm) {
+    if (algorithm < ORIGIN_CDC || algorithm > NORMALIZED_2Bytes) return "unknown";
+    return algorithm_names[algorithm];
+}
+
+uint32_t fastCDC_config_id(void) {
+    return (uint32_t)current_algorithm | (AvgSize << 8);
+}
+
+// 优化构建（-DFASTCDC_DISPATCH，见 makefile）为分块函数额外生成 x86-64-v3（AVX2/BMI2）版本，
+// 由 ifunc 在加载时按 CPU 特性选择，同一个二进制在老 CPU 上仍使用通用版本
+#if defined(FASTCDC_DISPATCH) && defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define FASTCDC_DISPATCHED __attribute__((target_clones("arch=x86-64-v3", "default")))
+#else
+#define FASTCDC_DISPATCHED
+#endif
+
+// 不足最小块长时整块作为一个分块，FastFp 取全部字节的 Gear 指纹
+static uint64_t gear_fingerprint(const unsigned char *p, int n) {
     uint64_t fingerprint = 0;
-    int originalMinSize = MinSize;
-    MinSize = 6 * 1024;
-    int i = MinSize, Mid = 8 * 1024;
+    for (int j = 0; j < n; j++) {
+        fingerprint = (fingerprint << 1) + (GEARv2[p[j]]);
+    }
+    return fingerprint;
+}
+
+// 原始 Gear CDC：跳过 MinSize 后逐字节滚动，单一掩码判定边界
+FASTCDC_DISPATCHED
+int cdc_origin_64(unsigned char *p, int n, uint64_t *feature, uint64_t *weakhash) {
+    uint64_t fingerprint = 0;
+    int i = MinSize;
 
     if (n <= (int)MinSize) {
-        for (int j = 0; j < n; j++) {
-            fingerprint = (fingerprint << 1) + (GEARv2[(unsigned char)p[j]]);
+        *weakhash = gear_fingerprint(p, n);
+        return n;
+    }
+    if (n > (int)MaxSize) n = MaxSize;
+
+    while (i < n) {
+        fingerprint = (fingerprint << 1) + (GEARv2[p[i]]);
+        if (!(fingerprint & MaskA_64)) {
+            *weakhash = fingerprint;
+            return i;
+        }
+        i++;
+    }
+
+    *weakhash = fingerprint;
+    return n;
+}
+
+// 每次迭代处理两个字节：偶数字节用左移一位的 LEARv2 表，
+// 指纹相当于多左移了一位，因此用左移后的 _ls 掩码判定，奇数字节与原始算法一致
+FASTCDC_DISPATCHED
+int rolling_data_2byes_64(unsigned char *p, int n, uint64_t *feature, uint64_t *weakhash) {
+    uint64_t fingerprint = 0;
+    int i = MinSize_divide_by_2;
+
+    if (n <= (int)MinSize) {
+        *weakhash = gear_fingerprint(p, n);
+        return n;
+    }
+    if (n > (int)MaxSize) n = MaxSize;
+
+    int a = n / 2;
+    while (i < a) {
+        fingerprint = (fingerprint << 2) + (LEARv2[p[i << 1]]);
+        if (!(fingerprint & MaskA_ls_64)) {
+            *weakhash = fingerprint;
+            return i << 1;
         }
-        MinSize = originalMinSize;
-        *weakhash = fingerprint;
+        fingerprint += GEARv2[p[(i << 1) + 1]];
+        if (!(fingerprint & MaskA_64)) {
+            *weakhash = fingerprint;
+            return (i << 1) + 1;
+        }
+        i++;
+    }
+
+    *weakhash = fingerprint;
+    return n;
+}
+
+// 归一化分块内核：[min, mid) 用较难命中的 mask_s，[mid, max) 用较易命中的 mask_l。
+// 强制内联，特化版本传入常量，热循环中的边界与掩码都是编译期常量
+static inline __attribute__((always_inline))
+int normalized_kernel(unsigned char *p, int n, uint64_t *weakhash,
+                      int min, int mid, int max, uint64_t mask_s, uint64_t mask_l) {
+    uint64_t fingerprint = 0;
+    int i = min;
+
+    if (n <= min) {
+        *weakhash = gear_fingerprint(p, n);
         return n;
     }
 
-    if (n > (int)MaxSize)
-        n = MaxSize;
-    else if (n < Mid)
-        Mid = n;
+    if (n > max)
+        n = max;
+    else if (n < mid)
+        mid = n;
 
-    while (i < Mid) {
-        fingerprint = (fingerprint << 1) + (GEARv2[(unsigned char)p[i]]);
-        if ((!(fingerprint & FING_GEAR_32KB_64))) {
-            MinSize = originalMinSize;
+    while (i < mid) {
+        fingerprint = (fingerprint << 1) + (GEARv2[p[i]]);
+        if (!(fingerprint & mask_s)) {
             *weakhash = fingerprint;
             return i;
         }
@@ -177,16 +339,218 @@ int normalized_chunking_64(unsigned char *p, int n, uint64_t *feature, uint64_t
     }
 
     while (i < n) {
-        fingerprint = (fingerprint << 1) + (GEARv2[(unsigned char)p[i]]);
-        if ((!(fingerprint & FING_GEAR_02KB_64))) {
-            MinSize = originalMinSize;
+        fingerprint = (fingerprint << 1) + (GEARv2[p[i]]);
+        if (!(fingerprint & mask_l)) {
             *weakhash = fingerprint;
             return i;
         }
         i++;
     }
 
-    MinSize = originalMinSize;
     *weakhash = fingerprint;
     return n;
 }
+
+// 双字节版本：每次迭代处理两个字节，偶数字节用 LEARv2 与左移后的掩码，边界与单字节版本相同
+static inline __attribute__((always_inline))
+int normalized_kernel_2bytes(unsigned char *p, int n, uint64_t *weakhash,
+                             int min, int mid, int max, uint64_t mask_s, uint64_t mask_l) {
+    uint64_t fingerprint = 0;
+    int i = min / 2;
+
+    if (n <= min) {
+        *weakhash = gear_fingerprint(p, n);
+        return n;
+    }
+
+    if (n > max)
+        n = max;
+    else if (n < mid)
+        mid = n;
+
+    int a = mid / 2;
+    while (i < a) {
+        fingerprint = (fingerprint << 2) + (LEARv2[p[i << 1]]);
+        if (!(fingerprint & (mask_s << 1))) {
+            *weakhash = fingerprint;
+            return i << 1;
+        }
+        fingerprint += GEARv2[p[(i << 1) + 1]];
+        if (!(fingerprint & mask_s)) {
+            *weakhash = fingerprint;
+            return (i << 1) + 1;
+        }
+        i++;
+    }
+
+    a = n / 2;
+    while (i < a) {
+        fingerprint = (fingerprint << 2) + (LEARv2[p[i << 1]]);
+        if (!(fingerprint & (mask_l << 1))) {
+            *weakhash = fingerprint;
+            return i << 1;
+        }
+        fingerprint += GEARv2[p[(i << 1) + 1]];
+        if (!(fingerprint & mask_l)) {
+            *weakhash = fingerprint;
+            return (i << 1) + 1;
+        }
+        i++;
+    }
+
+    *weakhash = fingerprint;
+    return n;
+}
+
+// 通用版本：按 fastCDC_set_avg_size 设置的块长在运行时取边界与掩码
+FASTCDC_DISPATCHED
+int normalized_chunking_64(unsigned char *p, int n, uint64_t *feature, uint64_t *weakhash) {
+    return normalized_kernel(p, n, weakhash, NormalMinSize, AvgSize, MaxSize, MaskS_64, MaskL_64);
+}
+
+FASTCDC_DISPATCHED
+int normalized_chunking_2byes_64(unsigned char *p, int n, uint64_t *feature, uint64_t *weakhash) {
+    return normalized_kernel_2bytes(p, n, weakhash, NormalMinSize, AvgSize, MaxSize, MaskS_64, MaskL_64);
+}
+
+// 为平均块长 2^BITS 生成特化版本：最小 3/4、归一化点 1 倍、最大 4 倍平均块长，掩码 BITS±2 位
+#define DEFINE_NORMALIZED_CHUNKERS(BITS, S_BITS, L_BITS)                                           \
+    FASTCDC_DISPATCHED                                                                            \
+    static int normalized_chunking_##BITS##_64(unsigned char *p, int n, uint64_t *feature,        \
+                                               uint64_t *weakhash) {                              \
+        return normalized_kernel(p, n, weakhash, (1 << BITS) / 4 * 3, 1 << BITS, 4 << BITS,       \
+                                 GEAR_MASK_##S_BITS, GEAR_MASK_##L_BITS);                         \
+    }                                                                                             \
+    FASTCDC_DISPATCHED                                                                            \
+    static int normalized_chunking_2byes_##BITS##_64(unsigned char *p, int n, uint64_t *feature,  \
+                                                     uint64_t *weakhash) {                        \
+        return normalized_kernel_2bytes(p, n, weakhash, (1 << BITS) / 4 * 3, 1 << BITS,           \
+                                        4 << BITS, GEAR_MASK_##S_BITS, GEAR_MASK_##L_BITS);       \
+    }
+
+DEFINE_NORMALIZED_CHUNKERS(12, 14, 10)  // 4KB
+DEFINE_NORMALIZED_CHUNKERS(13, 15, 11)  // 8KB
+DEFINE_NORMALIZED_CHUNKERS(14, 16, 12)  // 16KB
+DEFINE_NORMALIZED_CHUNKERS(15, 17, 13)  // 32KB
+DEFINE_NORMALIZED_CHUNKERS(16, 18, 14)  // 64KB
+DEFINE_NORMALIZED_CHUNKERS(17, 19, 15)  // 128KB
+DEFINE_NORMALIZED_CHUNKERS(18, 20, 16)  // 256KB
+DEFINE_NORMALIZED_CHUNKERS(19, 21, 17)  // 512KB
+DEFINE_NORMALIZED_CHUNKERS(20, 22, 18)  // 1MB
+
+static const struct {
+    uint32_t avg_size;
+    chunking_fn one_byte;
+    chunking_fn two_bytes;
+} normalized_chunkers[] = {
+    {1 << 12, normalized_chunking_12_64, normalized_chunking_2byes_12_64},
+    {1 << 13, normalized_chunking_13_64, normalized_chunking_2byes_13_64},
+    {1 << 14, normalized_chunking_14_64, normalized_chunking_2byes_14_64},
+    {1 << 15, normalized_chunking_15_64, normalized_chunking_2byes_15_64},
+    {1 << 16, normalized_chunking_16_64, normalized_chunking_2byes_16_64},
+    {1 << 17, normalized_chunking_17_64, normalized_chunking_2byes_17_64},
+    {1 << 18, normalized_chunking_18_64, normalized_chunking_2byes_18_64},
+    {1 << 19, normalized_chunking_19_64, normalized_chunking_2byes_19_64},
+    {1 << 20, normalized_chunking_20_64, normalized_chunking_2byes_20_64},
+};
+
+// 查找平均块长对应的特化版本，没有时返回 NULL（使用通用版本）
+static chunking_fn normalized_specialized(uint32_t avg_size, int two_bytes) {
+    for (size_t i = 0; i < sizeof(normalized_chunkers) / sizeof(normalized_chunkers[0]); i++) {
+        if (normalized_chunkers[i].avg_size == avg_size) {
+            return two_bytes ? normalized_chunkers[i].two_bytes : normalized_chunkers[i].one_byte;
+        }
+    }
+    return NULL;
+}
+
+// 旧块结尾 FastFp -> 旧块下标 的开放寻址索引，用于重新同步
+static int *rechunk_index_build(const uint64_t *old_fastfps, int old_count, int *cap_out) {
+    int cap = 16;
+    while (cap < old_count * 2) cap <<= 1;
+    int *slots = malloc(cap * sizeof(int));
+    if (!slots) return NULL;
+    memset(slots, -1, cap * sizeof(int));
+    for (int j = 0; j < old_count; j++) {
+        uint32_t h = (uint32_t)(old_fastfps[j] ^ (old_fastfps[j] >> 32)) & (cap - 1);
+        while (slots[h] >= 0) h = (h + 1) & (cap - 1);
+        slots[h] = j;
+    }
+    *cap_out = cap;
+    return slots;
+}
+
+// 查找 FastFp 相同且下标 >= from 的最小旧块下标，没有返回 -1
+static int rechunk_index_find(const int *slots, int cap, const uint64_t *old_fastfps,
+                              uint64_t fastfp, int from) {
+    int best = -1;
+    uint32_t h = (uint32_t)(fastfp ^ (fastfp >> 32)) & (cap - 1);
+    while (slots[h] >= 0) {
+        int j = slots[h];
+        if (old_fastfps[j] == fastfp && j >= from && (best < 0 || j < best)) best = j;
+        h = (h + 1) & (cap - 1);
+    }
+    return best;
+}
+
+int fastCDC_rechunk(int (*chunker)(unsigned char *, int, uint64_t *, uint64_t *),
+                    unsigned char *p, int n,
+                    const int *old_sizes, const uint64_t *old_fastfps,
+                    const unsigned char *old_sha1, int old_count,
+                    int *sizes, uint64_t *fastfps, unsigned char *sha1,
+                    int max_chunks, RechunkStats *stats) {
+    int cap = 0;
+    int *slots = rechunk_index_build(old_fastfps, old_count, &cap);
+    if (!slots) return -1;
+
+    long old_total = 0;
+    for (int j = 0; j < old_count; j++) old_total += old_sizes[j];
+
+    stats->reused_chunks = 0;
+    stats->rechunked_bytes = 0;
+
+    int count = 0, pos = 0;
+    int k = 0;              // 当前位置预期对应的旧块
+    long old_off = 0;       // 旧块 k 在旧文件中的偏移
+    int synced = 1;         // 当前位置是否与旧块 k 的起点对齐
+
+    while (pos < n && count < max_chunks) {
+        // 剩余长度都不小于 MaxSize 时，分块结果只取决于块内容，旧边界可以直接复用
+        if (synced && k < old_count && n - pos >= (int)MaxSize && old_total - old_off >= MaxSize &&
+            old_sizes[k] <= n - pos) {
+            unsigned char digest[SHA_DIGEST_LENGTH];
+            SHA1(p + pos, old_sizes[k], digest);
+            if (memcmp(digest, old_sha1 + (size_t)k * SHA_DIGEST_LENGTH, SHA_DIGEST_LENGTH) == 0) {
+                sizes[count] = old_sizes[k];
+                fastfps[count] = old_fastfps[k];
+                memcpy(sha1 + (size_t)count * SHA_DIGEST_LENGTH, digest, SHA_DIGEST_LENGTH);
+                count++;
+                pos += old_sizes[k];
+                old_off += old_sizes[k];
+                k++;
+                stats->reused_chunks++;
+                continue;
+            }
+        }
+
+        // 变化区域：正常分块，并尝试与旧块结尾重新同步
+        uint64_t feature = 0, weakhash = 0;
+        int len = chunker(p + pos, n - pos, &feature, &weakhash);
+        if (len <= 0) break;
+        sizes[count] = len;
+        fastfps[count] = weakhash;
+        SHA1(p + pos, len, sha1 + (size_t)count * SHA_DIGEST_LENGTH);
+        count++;
+        pos += len;
+        stats->rechunked_bytes += len;
+
+        int j = rechunk_index_find(slots, cap, old_fastfps, weakhash, k);
+        synced = j >= 0;
+        if (synced) {
+            for (; k <= j; k++) old_off += old_sizes[k];
+        }
+    }
+
+    free(slots);
+    return count;
+}
@@ -21,6 +21,13 @@
 #define NORMALIZED_CDC 3
 #define NORMALIZED_2Bytes 4
 
+// 平均块长（2 的幂）：最小块长为其 1/4（归一化分块为 3/4），最大块长为其 4 倍
+#define FASTCDC_DEFAULT_AVG_SIZE (8 * 1024)
+#define FASTCDC_MIN_AVG_SIZE (4 * 1024)
+#define FASTCDC_MAX_AVG_SIZE (1024 * 1024)
+// 归一化分块（默认算法）的最小块长：除文件尾块外，块都不小于该值
+#define FASTCDC_NORMAL_MIN_SIZE(avg) ((avg) / 4 * 3)
+
 // 公开的全局数据（由 fastcdc.c 定义）
 extern uint64_t GEARv2[256];
 extern uint64_t LEARv2[256];
@@ -31,6 +38,9 @@ extern uint64_t FING_GEAR_32KB_ls_64;
 extern uint64_t FING_GEAR_08KB_64;
 extern uint64_t FING_GEAR_02KB_64;
 extern uint64_t FING_GEAR_32KB_64;
+// 当前平均块长对应的掩码（fastCDC_init 设置）
+extern uint64_t MaskA_64, MaskS_64, MaskL_64;
+extern uint64_t MaskA_ls_64, MaskS_ls_64, MaskL_ls_64;
 
 // 全局变量（由 fastcdc.c 定义）
 extern struct timeval tmStart, tmEnd;
@@ -46,16 +56,44 @@ extern uint64_t Mask_11_64, Mask_15_64;
 extern uint32_t MinSize;
 extern uint32_t MinSize_divide_by_2;
 extern uint32_t MaxSize;
+extern uint32_t AvgSize;
+extern uint32_t NormalMinSize;
 extern int sameCount;
 extern int tmpCount;
 extern int smalChkCnt;  // 记录小于8KB的分块
 
 // 函数指针（可选）
-extern int (*chunking)(unsigned char *p, int n, uint64_t *feature, uint64_t *weakhash);
+typedef int (*chunking_fn)(unsigned char *p, int n, uint64_t *feature, uint64_t *weakhash);
+extern chunking_fn chunking;
 
 // API：初始化/分块
 void fastCDC_init(void);
+// 设置平均块长（4KB~1MB 的 2 的幂），之后需调用 fastCDC_init 生效，非法值返回 -1
+int fastCDC_set_avg_size(uint32_t avg_size);
+// 选择分块算法（ORIGIN_CDC ... NORMALIZED_2Bytes），设置 chunking 指针，成功返回 0
+int fastCDC_select(int algorithm);
+// 算法名与编号互转："origin" "rolling2" "normalized" "normalized2"，未知名称返回 -1
+int fastCDC_parse_algorithm(const char *name);
+const char *fastCDC_algorithm_name(int algorithm);
+// 当前分块配置的标识，配置不同的分块结果不可复用
+uint32_t fastCDC_config_id(void);
 int cdc_origin_64(unsigned char *p, int n, uint64_t *feature, uint64_t *weakhash);
 int rolling_data_2byes_64(unsigned char *p, int n, uint64_t *feature, uint64_t *weakhash);
 int normalized_chunking_64(unsigned char *p, int n, uint64_t *feature, uint64_t *weakhash);
 int normalized_chunking_2byes_64(unsigned char *p, int n, uint64_t *feature, uint64_t *weakhash);
+
+// 增量分块：利用上次的分块结果（块大小/FastFp/SHA1），只对变化区域重新分块。
+// 与旧块 SHA1 一致的位置直接复用旧边界；遇到变化时从当前位置重新分块，
+// 直到新边界的 FastFp 与某个旧块的结尾重合（重新同步）后继续复用。
+// 输出数组容量为 max_chunks，输出的 SHA1 可直接用于后续校验。返回块数，失败返回 -1。
+typedef struct {
+    int reused_chunks;     // 复用的旧块数
+    long rechunked_bytes;  // 实际执行分块的字节数
+} RechunkStats;
+
+int fastCDC_rechunk(int (*chunker)(unsigned char *, int, uint64_t *, uint64_t *),
+                    unsigned char *p, int n,
+                    const int *old_sizes, const uint64_t *old_fastfps,
+                    const unsigned char *old_sha1, int old_count,
+                    int *sizes, uint64_t *fastfps, unsigned char *sha1,
+                    int max_chunks, RechunkStats *stats);
@@ -0,0 +1,236 @@
+// fpcache.c - 客户端持久化指纹缓存
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fpcache.h"
+
+static uint32_t fpcache_hash_path(const char *path) {
+    uint32_t h = 2166136261U;  // FNV-1a
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+        h ^= *p;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static int fpcache_find_slot(const FpCache *cache, const char *path) {
+    if (cache->bucket_count == 0) return -1;
+    uint32_t mask = cache->bucket_count - 1;
+    uint32_t slot = fpcache_hash_path(path) & mask;
+    while (cache->buckets[slot] >= 0) {
+        if (strcmp(cache->entries[cache->buckets[slot]].path, path) == 0) {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// 保持装载因子不超过 1/2
+static int fpcache_reserve(FpCache *cache, int count) {
+    if (count > cache->cap) {
+        int cap = cache->cap ? cache->cap * 2 : 64;
+        while (cap < count) cap *= 2;
+        FpCacheEntry *temp = realloc(cache->entries, cap * sizeof(FpCacheEntry));
+        if (!temp) return -1;
+        cache->entries = temp;
+        cache->cap = cap;
+    }
+
+    if (count * 2 > cache->bucket_count) {
+        int bucket_count = cache->bucket_count ? cache->bucket_count : 128;
+        while (count * 2 > bucket_count) bucket_count *= 2;
+        int *buckets = malloc(bucket_count * sizeof(int));
+        if (!buckets) return -1;
+        memset(buckets, -1, bucket_count * sizeof(int));
+
+        free(cache->buckets);
+        cache->buckets = buckets;
+        cache->bucket_count = bucket_count;
+        for (int i = 0; i < cache->count; i++) {
+            cache->buckets[fpcache_find_slot(cache, cache->entries[i].path)] = i;
+        }
+    }
+    return 0;
+}
+
+static void fpcache_entry_free(FpCacheEntry *e) {
+    free(e->path);
+    free(e->sizes);
+    free(e->fastfps);
+    free(e->sha1);
+    memset(e, 0, sizeof(*e));
+}
+
+static int fpcache_entry_alloc(FpCacheEntry *e, int chunk_count) {
+    int n = chunk_count > 0 ? chunk_count : 1;
+    e->chunk_count = chunk_count;
+    e->sizes = malloc(n * sizeof(int));
+    e->fastfps = malloc(n * sizeof(uint64_t));
+    e->sha1 = malloc(n * SHA_DIGEST_LENGTH);
+    return (e->sizes && e->fastfps && e->sha1) ? 0 : -1;
+}
+
+// 追加一个条目（调用前已确认 path 不存在）
+static int fpcache_append(FpCache *cache, FpCacheEntry *e) {
+    if (fpcache_reserve(cache, cache->count + 1) != 0) return -1;
+    int slot = fpcache_find_slot(cache, e->path);
+    cache->entries[cache->count] = *e;
+    cache->buckets[slot] = cache->count;
+    cache->count++;
+    return 0;
+}
+
+int fpcache_load(FpCache *cache, const char *path, uint32_t config_id) {
+    memset(cache, 0, sizeof(*cache));
+    cache->config_id = config_id;
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+
+    char magic[8];
+    uint32_t file_config_id = 0;
+    int count = 0;
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, FPCACHE_MAGIC, sizeof(magic)) != 0 ||
+        fread(&file_config_id, sizeof(uint32_t), 1, file) != 1 ||
+        fread(&count, sizeof(int), 1, file) != 1 || count < 0) {
+        fclose(file);
+        return -1;
+    }
+    // 分块配置变化后旧结果全部作废，下次保存时覆盖
+    if (file_config_id != config_id) {
+        fclose(file);
+        cache->dirty = 1;
+        return 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        FpCacheEntry e;
+        memset(&e, 0, sizeof(e));
+        int path_len = 0, chunk_count = 0;
+        if (fread(&path_len, sizeof(int), 1, file) != 1 || path_len <= 0 || path_len > 4096) break;
+        e.path = malloc(path_len + 1);
+        if (!e.path || fread(e.path, 1, path_len, file) != (size_t)path_len) { fpcache_entry_free(&e); break; }
+        e.path[path_len] = '\0';
+        if (fread(&e.size, sizeof(uint64_t), 1, file) != 1 ||
+            fread(&e.inode, sizeof(uint64_t), 1, file) != 1 ||
+            fread(&e.mtime_sec, sizeof(int64_t), 1, file) != 1 ||
+            fread(&e.mtime_nsec, sizeof(int64_t), 1, file) != 1 ||
+            fread(&chunk_count, sizeof(int), 1, file) != 1 || chunk_count < 0 ||
+            fpcache_entry_alloc(&e, chunk_count) != 0 ||
+            fread(e.sizes, sizeof(int), chunk_count, file) != (size_t)chunk_count ||
+            fread(e.fastfps, sizeof(uint64_t), chunk_count, file) != (size_t)chunk_count ||
+            fread(e.sha1, SHA_DIGEST_LENGTH, chunk_count, file) != (size_t)chunk_count ||
+            fpcache_append(cache, &e) != 0) {
+            fpcache_entry_free(&e);
+            break;
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+int fpcache_save(FpCache *cache, const char *path) {
+    if (!cache->dirty) {
+        return 0;
+    }
+
+    char tmp_path[512];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.new", path);
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        return -1;
+    }
+
+    char magic[8];
+    memcpy(magic, FPCACHE_MAGIC, sizeof(magic));
+    int ok = fwrite(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+             fwrite(&cache->config_id, sizeof(uint32_t), 1, file) == 1 &&
+             fwrite(&cache->count, sizeof(int), 1, file) == 1;
+    for (int i = 0; ok && i < cache->count; i++) {
+        const FpCacheEntry *e = &cache->entries[i];
+        int path_len = strlen(e->path);
+        ok = fwrite(&path_len, sizeof(int), 1, file) == 1 &&
+             fwrite(e->path, 1, path_len, file) == (size_t)path_len &&
+             fwrite(&e->size, sizeof(uint64_t), 1, file) == 1 &&
+             fwrite(&e->inode, sizeof(uint64_t), 1, file) == 1 &&
+             fwrite(&e->mtime_sec, sizeof(int64_t), 1, file) == 1 &&
+             fwrite(&e->mtime_nsec, sizeof(int64_t), 1, file) == 1 &&
+             fwrite(&e->chunk_count, sizeof(int), 1, file) == 1 &&
+             fwrite(e->sizes, sizeof(int), e->chunk_count, file) == (size_t)e->chunk_count &&
+             fwrite(e->fastfps, sizeof(uint64_t), e->chunk_count, file) == (size_t)e->chunk_count &&
+             fwrite(e->sha1, SHA_DIGEST_LENGTH, e->chunk_count, file) == (size_t)e->chunk_count;
+    }
+    if (fclose(file) != 0) ok = 0;
+
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+    cache->dirty = 0;
+    return 0;
+}
+
+void fpcache_free(FpCache *cache) {
+    for (int i = 0; i < cache->count; i++) {
+        fpcache_entry_free(&cache->entries[i]);
+    }
+    free(cache->entries);
+    free(cache->buckets);
+    memset(cache, 0, sizeof(*cache));
+}
+
+const FpCacheEntry *fpcache_get(const FpCache *cache, const char *path) {
+    int slot = fpcache_find_slot(cache, path);
+    if (slot < 0 || cache->buckets[slot] < 0) {
+        return NULL;
+    }
+    return &cache->entries[cache->buckets[slot]];
+}
+
+const FpCacheEntry *fpcache_lookup(const FpCache *cache, const char *path, const struct stat *st) {
+    const FpCacheEntry *e = fpcache_get(cache, path);
+    if (!e) {
+        return NULL;
+    }
+    if (e->size != (uint64_t)st->st_size || e->inode != (uint64_t)st->st_ino ||
+        e->mtime_sec != (int64_t)st->st_mtim.tv_sec ||
+        e->mtime_nsec != (int64_t)st->st_mtim.tv_nsec) {
+        return NULL;
+    }
+    return e;
+}
+
+int fpcache_put(FpCache *cache, const char *path, const struct stat *st, int chunk_count,
+                const int *sizes, const uint64_t *fastfps, const unsigned char *sha1) {
+    FpCacheEntry e;
+    memset(&e, 0, sizeof(e));
+    e.path = strdup(path);
+    if (!e.path || fpcache_entry_alloc(&e, chunk_count) != 0) {
+        fpcache_entry_free(&e);
+        return -1;
+    }
+    e.size = st->st_size;
+    e.inode = st->st_ino;
+    e.mtime_sec = st->st_mtim.tv_sec;
+    e.mtime_nsec = st->st_mtim.tv_nsec;
+    memcpy(e.sizes, sizes, chunk_count * sizeof(int));
+    memcpy(e.fastfps, fastfps, chunk_count * sizeof(uint64_t));
+    memcpy(e.sha1, sha1, (size_t)chunk_count * SHA_DIGEST_LENGTH);
+
+    int slot = fpcache_find_slot(cache, path);
+    if (slot >= 0 && cache->buckets[slot] >= 0) {
+        FpCacheEntry *old = &cache->entries[cache->buckets[slot]];
+        fpcache_entry_free(old);
+        *old = e;
+    } else if (fpcache_append(cache, &e) != 0) {
+        fpcache_entry_free(&e);
+        return -1;
+    }
+    cache->dirty = 1;
+    return 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+/**
+ * 客户端持久化指纹缓存
+ *
+ * 以 (路径, 大小, mtime, inode) 为键记录上次运行的分块结果（块大小、FastFp、SHA1），
+ * 未修改的文件直接复用，无需重新读取、分块和计算哈希。
+ * 缓存文件记录生成时的分块配置，配置变化后整个缓存作废。
+ */
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include <openssl/sha.h>
+
+#define FPCACHE_MAGIC "FPCACHE2"
+
+typedef struct {
+    char *path;
+    uint64_t size;
+    uint64_t inode;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int chunk_count;
+    int *sizes;
+    uint64_t *fastfps;
+    unsigned char *sha1;      // chunk_count * SHA_DIGEST_LENGTH
+} FpCacheEntry;
+
+typedef struct {
+    FpCacheEntry *entries;
+    int count;
+    int cap;
+    int *buckets;             // 开放寻址表，存 entries 下标，-1 为空
+    int bucket_count;
+    uint32_t config_id;       // 分块配置标识（fastCDC_config_id）
+    int dirty;
+} FpCache;
+
+// 加载缓存文件，文件不存在或分块配置与 config_id 不一致时得到空缓存
+int fpcache_load(FpCache *cache, const char *path, uint32_t config_id);
+int fpcache_save(FpCache *cache, const char *path);
+void fpcache_free(FpCache *cache);
+
+// 按路径查找，不检查文件是否修改
+const FpCacheEntry *fpcache_get(const FpCache *cache, const char *path);
+// 按路径查找，且要求大小/mtime/inode 与 st 一致（即文件未修改）
+const FpCacheEntry *fpcache_lookup(const FpCache *cache, const char *path, const struct stat *st);
+
+// 写入或替换一个文件的分块结果
+int fpcache_put(FpCache *cache, const char *path, const struct stat *st, int chunk_count,
+                const int *sizes, const uint64_t *fastfps, const unsigned char *sha1);
@@ -0,0 +1,169 @@
+// fpfilter.c - FastFp 计数布隆过滤器
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fpfilter.h"
+
+// 由 FastFp 派生两个独立哈希，第 i 个位置为 h1 + i * h2（双重哈希）
+static void fpfilter_hash(uint64_t fastfp, uint32_t *h1, uint32_t *h2) {
+    uint64_t x = fastfp;
+    x ^= x >> 33; x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33; x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    *h1 = (uint32_t)x;
+    *h2 = (uint32_t)(x >> 32) | 1;
+}
+
+static inline unsigned fpfilter_get(const uint8_t *counters, uint32_t idx) {
+    return (counters[idx >> 1] >> ((idx & 1) << 2)) & 0xf;
+}
+
+static inline void fpfilter_set(uint8_t *counters, uint32_t idx, unsigned v) {
+    int shift = (idx & 1) << 2;
+    counters[idx >> 1] = (counters[idx >> 1] & ~(0xf << shift)) | (v << shift);
+}
+
+int fpfilter_init(FpFilter *f, uint64_t expected) {
+    memset(f, 0, sizeof(*f));
+    f->log2_size = FPFILTER_MIN_LOG2;
+    while (((uint64_t)1 << f->log2_size) / 8 < expected && f->log2_size < 31) {
+        f->log2_size++;
+    }
+    f->counters = calloc(((size_t)1 << f->log2_size) / 2, 1);
+    return f->counters ? 0 : -1;
+}
+
+void fpfilter_free(FpFilter *f) {
+    free(f->counters);
+    f->counters = NULL;
+    f->count = 0;
+}
+
+uint64_t fpfilter_capacity(const FpFilter *f) {
+    // 每个元素约 8 个计数器、4 个哈希时误判率约 2.4%
+    return ((uint64_t)1 << f->log2_size) / 8;
+}
+
+void fpfilter_add(FpFilter *f, uint64_t fastfp) {
+    uint32_t h1, h2, mask = (1U << f->log2_size) - 1;
+    fpfilter_hash(fastfp, &h1, &h2);
+    for (int i = 0; i < FPFILTER_HASHES; i++) {
+        uint32_t idx = (h1 + i * h2) & mask;
+        unsigned v = fpfilter_get(f->counters, idx);
+        if (v < 15) fpfilter_set(f->counters, idx, v + 1);  // 饱和后不再变化
+    }
+    f->count++;
+    f->dirty = 1;
+}
+
+void fpfilter_remove(FpFilter *f, uint64_t fastfp) {
+    uint32_t h1, h2, mask = (1U << f->log2_size) - 1;
+    fpfilter_hash(fastfp, &h1, &h2);
+
+    // 任一计数为 0 说明该元素从未加入，直接忽略以免产生假阴性
+    for (int i = 0; i < FPFILTER_HASHES; i++) {
+        if (fpfilter_get(f->counters, (h1 + i * h2) & mask) == 0) return;
+    }
+    for (int i = 0; i < FPFILTER_HASHES; i++) {
+        uint32_t idx = (h1 + i * h2) & mask;
+        unsigned v = fpfilter_get(f->counters, idx);
+        if (v < 15) fpfilter_set(f->counters, idx, v - 1);
+    }
+    if (f->count > 0) f->count--;
+    f->dirty = 1;
+}
+
+int fpfilter_maybe_contains(const FpFilter *f, uint64_t fastfp) {
+    uint32_t h1, h2, mask = (1U << f->log2_size) - 1;
+    fpfilter_hash(fastfp, &h1, &h2);
+    for (int i = 0; i < FPFILTER_HASHES; i++) {
+        if (fpfilter_get(f->counters, (h1 + i * h2) & mask) == 0) return 0;
+    }
+    return 1;
+}
+
+int fpfilter_save(FpFilter *f, const char *path) {
+    char tmp_path[512];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.new", path);
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        return -1;
+    }
+
+    char magic[8] = FPFILTER_MAGIC;
+    size_t bytes = ((size_t)1 << f->log2_size) / 2;
+    int ok = fwrite(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+             fwrite(&f->log2_size, sizeof(uint32_t), 1, file) == 1 &&
+             fwrite(&f->count, sizeof(uint64_t), 1, file) == 1 &&
+             fwrite(f->counters, 1, bytes, file) == bytes;
+    if (fclose(file) != 0) ok = 0;
+
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+    f->dirty = 0;
+    return 0;
+}
+
+int fpfilter_load(FpFilter *f, const char *path) {
+    memset(f, 0, sizeof(*f));
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return -1;
+    }
+
+    char magic[8];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, FPFILTER_MAGIC, sizeof(magic)) != 0 ||
+        fread(&f->log2_size, sizeof(uint32_t), 1, file) != 1 ||
+        fread(&f->count, sizeof(uint64_t), 1, file) != 1 ||
+        f->log2_size < FPFILTER_MIN_LOG2 || f->log2_size > 31) {
+        fclose(file);
+        return -1;
+    }
+
+    size_t bytes = ((size_t)1 << f->log2_size) / 2;
+    f->counters = malloc(bytes);
+    if (!f->counters || fread(f->counters, 1, bytes, file) != bytes) {
+        fclose(file);
+        fpfilter_free(f);
+        return -1;
+    }
+    fclose(file);
+    return 0;
+}
+
+uint32_t fpfilter_bits_bytes(uint32_t log2_size) {
+    return (1U << log2_size) / 8;
+}
+
+int fpfilter_export(const FpFilter *f, FpFilterBits *out) {
+    uint32_t size = 1U << f->log2_size;
+    out->log2_size = f->log2_size;
+    out->bits = calloc(fpfilter_bits_bytes(f->log2_size), 1);
+    if (!out->bits) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < size; i++) {
+        if (fpfilter_get(f->counters, i)) {
+            out->bits[i >> 3] |= 1 << (i & 7);
+        }
+    }
+    return 0;
+}
+
+int fpfilter_bits_maybe_contains(const FpFilterBits *b, uint64_t fastfp) {
+    uint32_t h1, h2, mask = (1U << b->log2_size) - 1;
+    fpfilter_hash(fastfp, &h1, &h2);
+    for (int i = 0; i < FPFILTER_HASHES; i++) {
+        uint32_t idx = (h1 + i * h2) & mask;
+        if (!(b->bits[idx >> 3] & (1 << (idx & 7)))) return 0;
+    }
+    return 1;
+}
+
+void fpfilter_bits_free(FpFilterBits *b) {
+    free(b->bits);
+    b->bits = NULL;
+}
@@ -0,0 +1,49 @@
+#pragma once
+/**
+ * FastFp 计数布隆过滤器
+ *
+ * 服务端为已存储的块维护一个 4 位计数的布隆过滤器，写入时加一、删除时减一，
+ * 未命中（绝大多数首次备份的查询）只需访问几个缓存行即可判定，无需 fopen。
+ * 过滤器可导出为普通位图发给客户端，客户端据此跳过一定不存在的块。
+ */
+
+#include <stdint.h>
+
+#define FPFILTER_HASHES 4
+#define FPFILTER_MIN_LOG2 16      // 最小 64K 个计数器
+#define FPFILTER_MAGIC "FPFILT1"
+
+typedef struct {
+    uint32_t log2_size;           // 计数器个数 = 1 << log2_size
+    uint64_t count;               // 当前元素个数
+    uint8_t *counters;            // 每字节两个 4 位计数器
+    int dirty;                    // 自上次保存以来是否有修改
+} FpFilter;
+
+// 导出给客户端的位图（计数器 > 0 的位置为 1）
+typedef struct {
+    uint32_t log2_size;
+    uint8_t *bits;
+} FpFilterBits;
+
+// 按预期元素个数选择大小并初始化
+int fpfilter_init(FpFilter *f, uint64_t expected);
+void fpfilter_free(FpFilter *f);
+
+// 在不明显增加误判率的前提下可容纳的元素个数，超过后应重建为更大的过滤器
+uint64_t fpfilter_capacity(const FpFilter *f);
+
+void fpfilter_add(FpFilter *f, uint64_t fastfp);
+void fpfilter_remove(FpFilter *f, uint64_t fastfp);
+// 返回 0 表示一定不存在
+int fpfilter_maybe_contains(const FpFilter *f, uint64_t fastfp);
+
+// 持久化
+int fpfilter_save(FpFilter *f, const char *path);
+int fpfilter_load(FpFilter *f, const char *path);
+
+// 导出位图：字节数为 fpfilter_bits_bytes(log2_size)
+uint32_t fpfilter_bits_bytes(uint32_t log2_size);
+int fpfilter_export(const FpFilter *f, FpFilterBits *out);
+int fpfilter_bits_maybe_contains(const FpFilterBits *b, uint64_t fastfp);
+void fpfilter_bits_free(FpFilterBits *b);
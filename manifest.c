@@ -0,0 +1,319 @@
+// manifest.c - 服务端文件清单与块引用计数
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <openssl/sha.h>
+#include "manifest.h"
+
+#define MANIFEST_RECORD_SIZE (8 + SHA_DIGEST_LENGTH)
+
+static int chunk_id_compare(const void *a, const void *b) {
+    const ChunkId *x = a, *y = b;
+    if (x->fastfp != y->fastfp) return x->fastfp < y->fastfp ? -1 : 1;
+    return memcmp(x->sha1, y->sha1, SHA_DIGEST_LENGTH);
+}
+
+static size_t ref_slot(const ManifestStore *ms, const ChunkId *id) {
+    uint64_t h;
+    memcpy(&h, id->sha1, sizeof(h));
+    h ^= id->fastfp;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    size_t i = h & (ms->cap - 1);
+    while (ms->used[i] && chunk_id_compare(&ms->slots[i].id, id) != 0) {
+        i = (i + 1) & (ms->cap - 1);
+    }
+    return i;
+}
+
+// 扩容时丢弃引用数已为 0 的条目
+static int ref_reserve(ManifestStore *ms) {
+    if ((ms->count + 1) * 2 <= ms->cap) {
+        return 0;
+    }
+    size_t live = 0;
+    for (size_t i = 0; i < ms->cap; i++) {
+        if (ms->used[i] && ms->slots[i].refs > 0) live++;
+    }
+    ManifestStore grown = *ms;
+    grown.cap = 1024;
+    while ((live + 1) * 4 > grown.cap) grown.cap *= 2;
+    grown.slots = malloc(grown.cap * sizeof(ManifestRef));
+    grown.used = calloc(grown.cap, 1);
+    grown.count = 0;
+    if (!grown.slots || !grown.used) {
+        free(grown.slots);
+        free(grown.used);
+        return -1;
+    }
+    for (size_t i = 0; i < ms->cap; i++) {
+        if (ms->used[i] && ms->slots[i].refs > 0) {
+            size_t j = ref_slot(&grown, &ms->slots[i].id);
+            grown.slots[j] = ms->slots[i];
+            grown.used[j] = 1;
+            grown.count++;
+        }
+    }
+    free(ms->slots);
+    free(ms->used);
+    *ms = grown;
+    return 0;
+}
+
+// 调整块的引用数，返回调整后的值，内存不足返回 -1
+static int ref_add(ManifestStore *ms, const ChunkId *id, int delta) {
+    if (ref_reserve(ms) != 0) {
+        return -1;
+    }
+    size_t i = ref_slot(ms, id);
+    if (!ms->used[i]) {
+        if (delta < 0) {
+            return 0;
+        }
+        ms->used[i] = 1;
+        ms->slots[i].id = *id;
+        ms->slots[i].refs = 0;
+        ms->count++;
+    }
+    ms->slots[i].refs += delta;
+    return ms->slots[i].refs;
+}
+
+int manifest_refs(const ManifestStore *ms, const ChunkId *id) {
+    if (ms->cap == 0) {
+        return 0;
+    }
+    size_t i = ref_slot(ms, id);
+    return ms->used[i] ? ms->slots[i].refs : 0;
+}
+
+// 清单文件名为文件名的 SHA1，任意文件名都能安全地用作路径
+static void manifest_path(const ManifestStore *ms, const char *name, const char *suffix, char *out, size_t out_len) {
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    char hex[SHA_DIGEST_LENGTH * 2 + 1];
+    SHA1((const unsigned char *)name, strlen(name), digest);
+    for (int i = 0; i < SHA_DIGEST_LENGTH; i++) {
+        sprintf(hex + i * 2, "%02x", digest[i]);
+    }
+    snprintf(out, out_len, "%s/%s%s", ms->dir, hex, suffix);
+}
+
+// 读取清单：magic, uint32 name_len, name, uint32 count, count 条 { fastfp, sha1 }
+// 成功返回 0，文件不存在返回 1，格式错误返回 -1
+static int manifest_read(const char *path, ChunkId **ids, int *count) {
+    *ids = NULL;
+    *count = 0;
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return errno == ENOENT ? 1 : -1;
+    }
+    char magic[8];
+    uint32_t name_len = 0, n = 0;
+    int ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+             memcmp(magic, MANIFEST_MAGIC, sizeof(magic)) == 0 &&
+             fread(&name_len, sizeof(name_len), 1, file) == 1 && name_len <= 4096 &&
+             fseek(file, name_len, SEEK_CUR) == 0 &&
+             fread(&n, sizeof(n), 1, file) == 1 && n <= (1U << 24);
+    ChunkId *out = ok ? malloc((n > 0 ? n : 1) * sizeof(ChunkId)) : NULL;
+    unsigned char rec[MANIFEST_RECORD_SIZE];
+    for (uint32_t i = 0; out && i < n; i++) {
+        if (fread(rec, 1, sizeof(rec), file) != sizeof(rec)) {
+            free(out);
+            out = NULL;
+            break;
+        }
+        memcpy(&out[i].fastfp, rec, sizeof(uint64_t));
+        memcpy(out[i].sha1, rec + sizeof(uint64_t), SHA_DIGEST_LENGTH);
+    }
+    fclose(file);
+    if (!out) {
+        return -1;
+    }
+    *ids = out;
+    *count = (int)n;
+    return 0;
+}
+
+static int manifest_write(const char *tmp_path, const char *path, const char *dir,
+                          const char *name, const ChunkId *ids, int count) {
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        return -1;
+    }
+    uint32_t name_len = (uint32_t)strlen(name), n = (uint32_t)count;
+    int ok = fwrite(MANIFEST_MAGIC, 1, 8, file) == 8 &&
+             fwrite(&name_len, sizeof(name_len), 1, file) == 1 &&
+             fwrite(name, 1, name_len, file) == name_len &&
+             fwrite(&n, sizeof(n), 1, file) == 1;
+    unsigned char rec[MANIFEST_RECORD_SIZE];
+    for (int i = 0; ok && i < count; i++) {
+        memcpy(rec, &ids[i].fastfp, sizeof(uint64_t));
+        memcpy(rec + sizeof(uint64_t), ids[i].sha1, SHA_DIGEST_LENGTH);
+        ok = fwrite(rec, 1, sizeof(rec), file) == sizeof(rec);
+    }
+    ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+    int dir_fd = open(dir, O_RDONLY | O_DIRECTORY);
+    ok = dir_fd >= 0 && fsync(dir_fd) == 0;
+    if (dir_fd >= 0) close(dir_fd);
+    return ok ? 0 : -1;
+}
+
+int manifest_open(ManifestStore *ms, const char *store_dir, int *created) {
+    memset(ms, 0, sizeof(*ms));
+    snprintf(ms->dir, sizeof(ms->dir), "%s/%s", store_dir, MANIFEST_DIR);
+    *created = 0;
+    if (mkdir(ms->dir, 0755) == 0) {
+        *created = 1;
+    } else if (errno != EEXIST) {
+        return -1;
+    }
+
+    DIR *d = opendir(ms->dir);
+    if (!d) {
+        return -1;
+    }
+    int ret = 0;
+    struct dirent *entry;
+    char path[1024];
+    while (ret == 0 && (entry = readdir(d)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        snprintf(path, sizeof(path), "%s/%s", ms->dir, entry->d_name);
+        // 替换中途崩溃留下的临时文件，对应的旧清单仍然有效
+        if (len > 4 && strcmp(entry->d_name + len - 4, ".tmp") == 0) {
+            remove(path);
+            continue;
+        }
+        if (len <= 3 || strcmp(entry->d_name + len - 3, ".mf") != 0) {
+            continue;
+        }
+        ChunkId *ids = NULL;
+        int count = 0;
+        if (manifest_read(path, &ids, &count) != 0) {
+            ret = -1;
+            break;
+        }
+        for (int i = 0; i < count && ret == 0; i++) {
+            if (ref_add(ms, &ids[i], 1) < 0) ret = -1;
+        }
+        free(ids);
+        ms->files++;
+    }
+    closedir(d);
+    if (ret != 0) {
+        manifest_close(ms);
+    }
+    return ret;
+}
+
+void manifest_close(ManifestStore *ms) {
+    free(ms->slots);
+    free(ms->used);
+    memset(ms, 0, sizeof(*ms));
+}
+
+int manifest_replace(ManifestStore *ms, const char *name, const ChunkId *ids, int count,
+                     ChunkId **released, int *released_count) {
+    if (released) {
+        *released = NULL;
+        *released_count = 0;
+    }
+    // 同一文件中重复出现的块只记一次引用
+    ChunkId *unique = malloc((count > 0 ? count : 1) * sizeof(ChunkId));
+    if (!unique) {
+        return -1;
+    }
+    memcpy(unique, ids, count * sizeof(ChunkId));
+    qsort(unique, count, sizeof(ChunkId), chunk_id_compare);
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        if (n == 0 || chunk_id_compare(&unique[n - 1], &unique[i]) != 0) {
+            unique[n++] = unique[i];
+        }
+    }
+
+    char path[1024], tmp_path[1024];
+    manifest_path(ms, name, ".mf", path, sizeof(path));
+    manifest_path(ms, name, ".mf.tmp", tmp_path, sizeof(tmp_path));
+    ChunkId *old = NULL;
+    int old_count = 0;
+    int old_state = manifest_read(path, &old, &old_count);
+    if (old_state < 0 || manifest_write(tmp_path, path, ms->dir, name, unique, n) != 0) {
+        free(unique);
+        free(old);
+        return -1;
+    }
+    if (old_state == 1) {
+        ms->files++;
+    }
+
+    // 先加后减，新旧清单都引用的块不会降到 0
+    int ret = 0;
+    for (int i = 0; i < n; i++) {
+        if (ref_add(ms, &unique[i], 1) < 0) ret = -1;
+    }
+    ChunkId *out = NULL;
+    if (released && old_count > 0) {
+        out = malloc(old_count * sizeof(ChunkId));
+        if (!out) ret = -1;
+    }
+    int out_count = 0;
+    for (int i = 0; i < old_count; i++) {
+        if (ref_add(ms, &old[i], -1) == 0 && out) {
+            out[out_count++] = old[i];
+        }
+    }
+    free(unique);
+    free(old);
+    if (released) {
+        *released = out;
+        *released_count = out_count;
+    }
+    return ret;
+}
+
+int manifest_update(ManifestStore *ms, const char *name, const ChunkId *add, int add_count,
+                    const ChunkId *drop, int drop_count, ChunkId **released, int *released_count) {
+    char path[1024];
+    manifest_path(ms, name, ".mf", path, sizeof(path));
+    ChunkId *old = NULL;
+    int old_count = 0;
+    if (manifest_read(path, &old, &old_count) < 0) {
+        return -1;
+    }
+    ChunkId *sorted_drop = malloc((drop_count > 0 ? drop_count : 1) * sizeof(ChunkId));
+    ChunkId *ids = malloc((old_count + add_count > 0 ? old_count + add_count : 1) * sizeof(ChunkId));
+    if (!sorted_drop || !ids) {
+        free(old);
+        free(sorted_drop);
+        free(ids);
+        return -1;
+    }
+    memcpy(sorted_drop, drop, drop_count * sizeof(ChunkId));
+    qsort(sorted_drop, drop_count, sizeof(ChunkId), chunk_id_compare);
+    int count = 0;
+    for (int i = 0; i < old_count; i++) {
+        if (!bsearch(&old[i], sorted_drop, drop_count, sizeof(ChunkId), chunk_id_compare)) {
+            ids[count++] = old[i];
+        }
+    }
+    memcpy(ids + count, add, add_count * sizeof(ChunkId));
+    count += add_count;
+    int ret = manifest_replace(ms, name, ids, count, released, released_count);
+    free(old);
+    free(sorted_drop);
+    free(ids);
+    return ret;
+}
@@ -0,0 +1,50 @@
+#pragma once
+/**
+ * 服务端文件清单与块引用计数
+ *
+ * 每个文件名一个清单，记录该文件在本节点上用到的块（去重后的 ChunkId），保存在存储目录下的
+ * "manifests/<文件名的 SHA1>.mf"：先写临时文件并 fsync，再 rename 替换旧清单。
+ * 打开时重放全部清单，在内存中得到每个块被多少个清单引用；替换清单时新块加引用、旧块减引用，
+ * 引用数降为 0 的块交给调用者回收。从未被任何清单引用的块（清单出现之前写入、或只经
+ * CMD_PUT_* 写入而没有清单的块）不会被回收。
+ * 非线程安全，服务端在清单锁下使用。
+ */
+
+#include <stddef.h>
+#include "chunkstore.h"
+
+#define MANIFEST_DIR "manifests"
+#define MANIFEST_MAGIC "DDMANIF1"
+// 启用清单之前已存储的块记在文件名为空串的清单中，会话的文件名不能为空，不会与之冲突
+#define MANIFEST_LEGACY_NAME ""
+
+typedef struct {
+    ChunkId id;
+    int refs;                 // 0 表示没有清单引用（包括空槽以外已降为 0 的条目）
+} ManifestRef;
+
+typedef struct {
+    char dir[512];            // 清单目录
+    ManifestRef *slots;       // 开放寻址表，装载因子不超过 1/2
+    unsigned char *used;
+    size_t cap;
+    size_t count;             // 已使用的槽数（含引用数为 0 的条目）
+    int files;                // 清单个数
+} ManifestStore;
+
+// 打开存储目录下的清单目录并重放所有清单；目录原本不存在时创建，并把 *created 置 1。
+// 清单损坏时返回 -1（此时无法判断哪些块仍被引用）
+int manifest_open(ManifestStore *ms, const char *store_dir, int *created);
+void manifest_close(ManifestStore *ms);
+
+// 块当前被多少个清单引用
+int manifest_refs(const ManifestStore *ms, const ChunkId *id);
+
+// 用 ids（可重复、无序）替换文件 name 的清单。新清单落盘后才调整引用数；
+// released 非 NULL 时返回引用数降为 0 的块（malloc，调用者释放）。失败返回 -1，旧清单不变
+int manifest_replace(ManifestStore *ms, const char *name, const ChunkId *ids, int count,
+                     ChunkId **released, int *released_count);
+
+// 在文件 name 现有的清单上加入 add 中的块、去掉 drop 中的块（清单不存在时视为空），其余同 manifest_replace
+int manifest_update(ManifestStore *ms, const char *name, const ChunkId *add, int add_count,
+                    const ChunkId *drop, int drop_count, ChunkId **released, int *released_count);
@@ -0,0 +1,153 @@
+// metrics.c - 服务端运行指标
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include "metrics.h"
+
+uint64_t g_metric_counters[METRIC_COUNTERS];
+int64_t g_metric_gauges[METRIC_GAUGES];
+
+// 每个阶段 METRIC_BUCKETS 个有限桶加一个 +Inf 桶（不累计），以及耗时总和
+static uint64_t g_phase_buckets[METRIC_PHASES][METRIC_BUCKETS + 1];
+static uint64_t g_phase_sum_us[METRIC_PHASES];
+
+typedef struct {
+    const char *name;
+    const char *help;
+} MetricInfo;
+
+static const MetricInfo g_counter_info[METRIC_COUNTERS] = {
+    [METRIC_SESSIONS] = {"dedup_sessions_total", "Completed deduplication sessions"},
+    [METRIC_COMMANDS] = {"dedup_commands_total", "Protocol commands handled"},
+    [METRIC_LOOKUPS] = {"dedup_lookups_total", "Matched FastFps the client asked to verify"},
+    [METRIC_LOOKUP_HITS] = {"dedup_lookup_hits_total", "Verified FastFps found in the local store"},
+    [METRIC_CHUNKS_RECEIVED] = {"dedup_chunks_received_total", "Uploaded chunks that passed SHA1 verification"},
+    [METRIC_CHUNKS_REJECTED] = {"dedup_chunks_rejected_total", "Uploaded chunks discarded for a SHA1 mismatch"},
+    [METRIC_CHUNKS_STORED] = {"dedup_chunks_stored_total", "Chunks written to the store"},
+    [METRIC_CHUNKS_SERVED] = {"dedup_chunks_served_total", "Chunks returned by GET requests"},
+    [METRIC_BYTES_IN] = {"dedup_bytes_received_total", "Bytes received from clients"},
+    [METRIC_BYTES_OUT] = {"dedup_bytes_sent_total", "Bytes sent to clients"},
+    [METRIC_GC_RUNS] = {"dedup_gc_runs_total", "Garbage collections run"},
+    [METRIC_GC_CHUNKS_SCANNED] = {"dedup_gc_chunks_scanned_total", "Unreferenced chunk candidates checked by garbage collection"},
+    [METRIC_GC_CHUNKS_DELETED] = {"dedup_gc_chunks_deleted_total", "Chunks deleted by garbage collection"},
+    [METRIC_GC_BYTES_RECLAIMED] = {"dedup_gc_pack_bytes_reclaimed_total", "Pack file bytes reclaimed by compaction"},
+};
+
+static const MetricInfo g_gauge_info[METRIC_GAUGES] = {
+    [GAUGE_CONNECTIONS] = {"dedup_connections", "Open client connections"},
+    [GAUGE_STREAMS] = {"dedup_active_streams", "Sessions or command sequences being handled"},
+    [GAUGE_GC_PENDING] = {"dedup_gc_pending_chunks", "Candidates left to check in the running garbage collection"},
+};
+
+static const char *g_phase_names[METRIC_PHASES] = {
+    [PHASE_SESSION] = "session",
+    [PHASE_SHA1_LOOKUP] = "sha1_lookup",
+    [PHASE_UPLOAD] = "upload",
+    [PHASE_COMMIT] = "commit",
+    [PHASE_CLEANUP] = "cleanup",
+    [PHASE_GET_CHUNK] = "get_chunk",
+};
+
+uint64_t metrics_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 第 i 个桶的上界为 2^i 微秒
+static int bucket_index(uint64_t us) {
+    int i = 0;
+    while (i < METRIC_BUCKETS && (1ULL << i) < us) {
+        i++;
+    }
+    return i;
+}
+
+void metrics_observe(MetricPhase phase, uint64_t start_us) {
+    uint64_t us = metrics_now_us() - start_us;
+    __atomic_fetch_add(&g_phase_buckets[phase][bucket_index(us)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_phase_sum_us[phase], us, __ATOMIC_RELAXED);
+}
+
+static void text_append(MetricsText *text, const char *fmt, ...) {
+    if (text->failed) {
+        return;
+    }
+    for (;;) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(text->data ? text->data + text->len : NULL,
+                          text->data ? text->cap - text->len : 0, fmt, ap);
+        va_end(ap);
+        if (n < 0) {
+            text->failed = 1;
+            return;
+        }
+        if (text->data && text->len + n < text->cap) {
+            text->len += n;
+            return;
+        }
+        size_t cap = text->cap ? text->cap : 4096;
+        while (cap <= text->len + n) {
+            cap *= 2;
+        }
+        char *data = realloc(text->data, cap);
+        if (!data) {
+            text->failed = 1;
+            return;
+        }
+        text->data = data;
+        text->cap = cap;
+    }
+}
+
+static void append_header(MetricsText *text, const char *name, const char *type, const char *help) {
+    text_append(text, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void metrics_text_sample(MetricsText *text, int server_id, const char *name, const char *type,
+                         const char *help, double value) {
+    append_header(text, name, type, help);
+    text_append(text, "%s{server=\"%d\"} %.17g\n", name, server_id, value);
+}
+
+void metrics_render(MetricsText *text, int server_id) {
+    for (int i = 0; i < METRIC_COUNTERS; i++) {
+        append_header(text, g_counter_info[i].name, "counter", g_counter_info[i].help);
+        text_append(text, "%s{server=\"%d\"} %llu\n", g_counter_info[i].name, server_id,
+                    (unsigned long long)__atomic_load_n(&g_metric_counters[i], __ATOMIC_RELAXED));
+    }
+    for (int i = 0; i < METRIC_GAUGES; i++) {
+        append_header(text, g_gauge_info[i].name, "gauge", g_gauge_info[i].help);
+        text_append(text, "%s{server=\"%d\"} %lld\n", g_gauge_info[i].name, server_id,
+                    (long long)__atomic_load_n(&g_metric_gauges[i], __ATOMIC_RELAXED));
+    }
+
+    const char *name = "dedup_phase_duration_seconds";
+    append_header(text, name, "histogram", "Time spent in each server phase");
+    for (int p = 0; p < METRIC_PHASES; p++) {
+        uint64_t count = 0;
+        for (int i = 0; i <= METRIC_BUCKETS; i++) {
+            count += __atomic_load_n(&g_phase_buckets[p][i], __ATOMIC_RELAXED);
+            if (i < METRIC_BUCKETS) {
+                text_append(text, "%s_bucket{server=\"%d\",phase=\"%s\",le=\"%g\"} %llu\n", name, server_id,
+                            g_phase_names[p], (double)(1ULL << i) / 1e6, (unsigned long long)count);
+            } else {
+                text_append(text, "%s_bucket{server=\"%d\",phase=\"%s\",le=\"+Inf\"} %llu\n", name, server_id,
+                            g_phase_names[p], (unsigned long long)count);
+            }
+        }
+        text_append(text, "%s_sum{server=\"%d\",phase=\"%s\"} %.6f\n", name, server_id, g_phase_names[p],
+                    __atomic_load_n(&g_phase_sum_us[p], __ATOMIC_RELAXED) / 1e6);
+        text_append(text, "%s_count{server=\"%d\",phase=\"%s\"} %llu\n", name, server_id, g_phase_names[p],
+                    (unsigned long long)count);
+    }
+}
+
+void metrics_text_free(MetricsText *text) {
+    free(text->data);
+    memset(text, 0, sizeof(*text));
+}
@@ -0,0 +1,83 @@
+#pragma once
+/**
+ * 服务端运行指标
+ *
+ * 计数器、仪表和各阶段耗时直方图都是进程内的全局数组，用宽松原子操作更新，
+ * 热路径上每次只是一条原子加法，不加锁。CMD_STATS 时按 Prometheus 文本格式导出
+ * （见 dedup_proto.h），由服务端补充块缓存、缓冲区池、写入队列等按需采样的数值。
+ * 耗时直方图以微秒为单位，第 i 个桶的上界为 2^i 微秒，导出时换算为秒。
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    METRIC_SESSIONS,              // 完成的去重会话
+    METRIC_COMMANDS,              // 处理的协议命令
+    METRIC_LOOKUPS,               // 客户端请求 SHA1 校验的 FastFp
+    METRIC_LOOKUP_HITS,           // 其中本地存在的
+    METRIC_CHUNKS_RECEIVED,       // 通过 SHA1 校验的上传块
+    METRIC_CHUNKS_REJECTED,       // SHA1 不符被丢弃的上传块
+    METRIC_CHUNKS_STORED,         // 写入存储的块
+    METRIC_CHUNKS_SERVED,         // CMD_GET_CHUNK 返回的块
+    METRIC_BYTES_IN,              // 从客户端接收的字节
+    METRIC_BYTES_OUT,             // 发送给客户端的字节
+    METRIC_GC_RUNS,               // 回收次数
+    METRIC_GC_CHUNKS_SCANNED,
+    METRIC_GC_CHUNKS_DELETED,
+    METRIC_GC_BYTES_RECLAIMED,    // pack 搬迁回收的字节
+    METRIC_COUNTERS
+} MetricCounter;
+
+typedef enum {
+    GAUGE_CONNECTIONS,            // 当前连接数（多路复用连接算一个）
+    GAUGE_STREAMS,                // 当前正在处理的会话或命令序列
+    GAUGE_GC_PENDING,             // 本轮回收中尚未检查的候选块数
+    METRIC_GAUGES
+} MetricGauge;
+
+typedef enum {
+    PHASE_SESSION,                // 整个去重会话
+    PHASE_SHA1_LOOKUP,            // 查找并发送匹配块的 SHA1
+    PHASE_UPLOAD,                 // 接收并写入上传块
+    PHASE_COMMIT,                 // 批量提交（等待写入、fsync、rename）
+    PHASE_CLEANUP,                // 回收不再被任何清单引用的块
+    PHASE_GET_CHUNK,              // 处理一次 CMD_GET_CHUNK
+    METRIC_PHASES
+} MetricPhase;
+
+#define METRIC_BUCKETS 24         // 最大的有限桶约 8 秒，更长的计入 +Inf
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int failed;                   // 内存分配失败后不再追加
+} MetricsText;
+
+extern uint64_t g_metric_counters[METRIC_COUNTERS];
+extern int64_t g_metric_gauges[METRIC_GAUGES];
+
+static inline void metrics_add(MetricCounter counter, uint64_t n) {
+    __atomic_fetch_add(&g_metric_counters[counter], n, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_gauge_add(MetricGauge gauge, int64_t delta) {
+    __atomic_fetch_add(&g_metric_gauges[gauge], delta, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_gauge_set(MetricGauge gauge, int64_t value) {
+    __atomic_store_n(&g_metric_gauges[gauge], value, __ATOMIC_RELAXED);
+}
+
+// 单调时钟，微秒
+uint64_t metrics_now_us(void);
+// 记录从 start_us 到现在的耗时
+void metrics_observe(MetricPhase phase, uint64_t start_us);
+
+// 追加全部计数器、仪表和直方图，每个样本带 server="<server_id>" 标签
+void metrics_render(MetricsText *text, int server_id);
+// 追加一个服务端采样的样本；type 为 "counter" 或 "gauge"
+void metrics_text_sample(MetricsText *text, int server_id, const char *name, const char *type,
+                         const char *help, double value);
+void metrics_text_free(MetricsText *text);
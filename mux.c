@@ -0,0 +1,503 @@
+// mux.c - 单连接多路复用
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/time.h>
+#include <time.h>
+#include "mux.h"
+#include "dedup_proto.h"
+
+// 已收到、尚未交给应用的一帧数据
+typedef struct MuxChunk {
+    struct MuxChunk *next;
+    int length;
+    unsigned char data[];
+} MuxChunk;
+
+struct MuxStream {
+    uint32_t id;
+    int fd;                       // 复用层一端
+    int app_fd;                   // 应用一端（服务端交给处理线程）
+    MuxConn *conn;
+    pthread_t pump;
+    pthread_t deliver;
+    pthread_t handler;
+    int has_handler;
+    int send_credit;              // 对端还能接收的字节数，为 0 时本流暂停发送
+    MuxChunk *queue_head;         // 接收队列，总长不超过 MUX_STREAM_WINDOW
+    MuxChunk *queue_tail;
+    int queued;
+    pthread_cond_t queue_ready;   // 接收队列非空或对端关闭
+    int remote_closed;            // 对端已关闭写方向
+    int delivered;                // 接收队列已全部交给应用，应用一端已读到 EOF
+    int done;                     // 应用一端已关闭写方向，关闭帧已发出
+    MuxStream *next;
+};
+
+typedef struct {
+    uint32_t id;
+    int32_t length;
+} MuxFrameHeader;
+
+static int write_full(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// 读满 len 字节返回 1，在边界处遇到 EOF 返回 0，其他情况返回 -1
+static int read_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = recv(fd, p + got, len - got, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            return got == 0 ? 0 : -1;
+        }
+        got += n;
+    }
+    return 1;
+}
+
+// 帧头与数据用一次 sendmsg 发出，避免小帧被拆成两个报文
+static int write_frame(int sock, MuxFrameHeader *hdr, const void *data, int length) {
+    struct iovec iov[2] = {
+        { hdr, sizeof(*hdr) },
+        { (void *)data, (size_t)length }
+    };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = length > 0 ? 2 : 1;
+    while (msg.msg_iovlen > 0) {
+        ssize_t n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        while (n > 0) {
+            if ((size_t)n >= msg.msg_iov->iov_len) {
+                n -= msg.msg_iov->iov_len;
+                msg.msg_iov++;
+                msg.msg_iovlen--;
+            } else {
+                msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + n;
+                msg.msg_iov->iov_len -= n;
+                n = 0;
+            }
+        }
+    }
+    return 0;
+}
+
+// length 为 0 时发送关闭帧，小于 0 时为归还 -length 字节的额度；写连接失败时断开连接，由接收循环收尾
+static int send_frame(MuxConn *conn, uint32_t id, const void *data, int length) {
+    MuxFrameHeader hdr = { id, length };
+    pthread_mutex_lock(&conn->write_lock);
+    int ret = write_frame(conn->sock, &hdr, data, length);
+    pthread_mutex_unlock(&conn->write_lock);
+    if (ret != 0) {
+        shutdown(conn->sock, SHUT_RDWR);
+    }
+    return ret;
+}
+
+// 把应用写入的数据切成帧发往连接，应用关闭写方向后发送关闭帧。
+// 每帧不超过对端归还的额度，额度用完时只有本流等待，其他流照常发送
+static void *pump_main(void *arg) {
+    MuxStream *s = arg;
+    MuxConn *conn = s->conn;
+    unsigned char *buf = malloc(MUX_MAX_FRAME);
+    while (buf) {
+        pthread_mutex_lock(&conn->lock);
+        while (s->send_credit <= 0 && !conn->failed) {
+            pthread_cond_wait(&conn->credit, &conn->lock);
+        }
+        int credit = s->send_credit;
+        int failed = conn->failed;
+        pthread_mutex_unlock(&conn->lock);
+        if (failed) {
+            break;
+        }
+
+        ssize_t n = recv(s->fd, buf, credit < MUX_MAX_FRAME ? credit : MUX_MAX_FRAME, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        pthread_mutex_lock(&conn->lock);
+        s->send_credit -= n;
+        pthread_mutex_unlock(&conn->lock);
+        if (send_frame(conn, s->id, buf, n) != 0) {
+            break;
+        }
+    }
+    free(buf);
+    send_frame(conn, s->id, NULL, 0);
+
+    pthread_mutex_lock(&conn->lock);
+    s->done = 1;
+    pthread_cond_broadcast(&conn->idle);
+    pthread_mutex_unlock(&conn->lock);
+    return NULL;
+}
+
+// 把接收队列中的数据写给应用，写完后向对端归还额度。应用不读时只阻塞本线程，
+// 接收循环继续为其他流分发数据。对端关闭且队列清空后关闭应用一端的读方向
+static void *deliver_main(void *arg) {
+    MuxStream *s = arg;
+    MuxConn *conn = s->conn;
+    int discard = 0;              // 应用一端已关闭，数据直接丢弃，额度照常归还
+    int returned = 0;             // 已交付、尚未归还的字节数
+    for (;;) {
+        pthread_mutex_lock(&conn->lock);
+        while (!s->queue_head && !s->remote_closed && !conn->failed) {
+            pthread_cond_wait(&s->queue_ready, &conn->lock);
+        }
+        MuxChunk *c = s->queue_head;
+        if (c) {
+            s->queue_head = c->next;
+            if (!s->queue_head) s->queue_tail = NULL;
+            s->queued -= c->length;
+        }
+        int idle = !s->queue_head;
+        int failed = conn->failed;
+        pthread_mutex_unlock(&conn->lock);
+        if (!c) {
+            break;
+        }
+
+        if (!discard && !failed && write_full(s->fd, c->data, c->length) != 0) {
+            discard = 1;
+        }
+        returned += c->length;
+        free(c);
+        // 攒够四分之一窗口或队列已空时归还一次，避免每帧都回一个额度帧
+        if (!failed && (idle || returned >= MUX_STREAM_WINDOW / 4)) {
+            send_frame(conn, s->id, NULL, -returned);
+            returned = 0;
+        }
+    }
+    shutdown(s->fd, SHUT_WR);
+
+    pthread_mutex_lock(&conn->lock);
+    s->delivered = 1;
+    pthread_mutex_unlock(&conn->lock);
+    return NULL;
+}
+
+static void *handler_main(void *arg) {
+    MuxStream *s = arg;
+    s->conn->handler(s->app_fd, s->conn->arg);
+    close(s->app_fd);
+    return NULL;
+}
+
+// 等流的各个线程退出后释放；调用前连接已断开或流的两个方向都已关闭
+static void stream_stop(MuxStream *s) {
+    MuxConn *conn = s->conn;
+    pthread_mutex_lock(&conn->lock);
+    s->remote_closed = 1;
+    pthread_cond_signal(&s->queue_ready);
+    pthread_cond_broadcast(&conn->credit);
+    pthread_mutex_unlock(&conn->lock);
+    pthread_join(s->pump, NULL);
+    pthread_join(s->deliver, NULL);
+    if (s->has_handler) {
+        pthread_join(s->handler, NULL);
+    }
+    while (s->queue_head) {
+        MuxChunk *c = s->queue_head;
+        s->queue_head = c->next;
+        free(c);
+    }
+    pthread_cond_destroy(&s->queue_ready);
+    close(s->fd);
+    free(s);
+}
+
+static MuxStream *stream_create(MuxConn *conn, uint32_t id) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        return NULL;
+    }
+    int bufsize = MUX_STREAM_BUFFER;
+    for (int i = 0; i < 2; i++) {
+        setsockopt(sv[i], SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+        setsockopt(sv[i], SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+    }
+
+    MuxStream *s = calloc(1, sizeof(MuxStream));
+    if (!s) {
+        close(sv[0]);
+        close(sv[1]);
+        return NULL;
+    }
+    s->id = id;
+    s->app_fd = sv[0];
+    s->fd = sv[1];
+    s->conn = conn;
+    s->send_credit = MUX_STREAM_WINDOW;
+    pthread_cond_init(&s->queue_ready, NULL);
+    if (pthread_create(&s->pump, NULL, pump_main, s) != 0) {
+        pthread_cond_destroy(&s->queue_ready);
+        close(sv[0]);
+        close(sv[1]);
+        free(s);
+        return NULL;
+    }
+    if (pthread_create(&s->deliver, NULL, deliver_main, s) != 0) {
+        // 关闭应用一端，泵线程读到 EOF 后退出
+        close(s->app_fd);
+        pthread_join(s->pump, NULL);
+        pthread_cond_destroy(&s->queue_ready);
+        close(s->fd);
+        free(s);
+        return NULL;
+    }
+
+    // 连接已断开时不再加入流表，接收循环不会再回收它
+    pthread_mutex_lock(&conn->lock);
+    int failed = conn->failed;
+    if (!failed) {
+        s->next = conn->streams;
+        conn->streams = s;
+    }
+    pthread_mutex_unlock(&conn->lock);
+    if (failed) {
+        close(s->app_fd);
+        stream_stop(s);
+        return NULL;
+    }
+    return s;
+}
+
+static MuxStream *stream_find(MuxConn *conn, uint32_t id) {
+    pthread_mutex_lock(&conn->lock);
+    MuxStream *s = conn->streams;
+    while (s && s->id != id) {
+        s = s->next;
+    }
+    pthread_mutex_unlock(&conn->lock);
+    return s;
+}
+
+// 回收两个方向都已关闭的流；all 时回收全部（连接已断开）。只在接收线程或其退出后调用
+static void reap_streams(MuxConn *conn, int all) {
+    MuxStream *dead = NULL;
+    pthread_mutex_lock(&conn->lock);
+    MuxStream **link = &conn->streams;
+    while (*link) {
+        MuxStream *s = *link;
+        if (all || (s->done && s->delivered)) {
+            *link = s->next;
+            s->next = dead;
+            dead = s;
+        } else {
+            link = &s->next;
+        }
+    }
+    pthread_mutex_unlock(&conn->lock);
+
+    while (dead) {
+        MuxStream *s = dead;
+        dead = s->next;
+        stream_stop(s);
+    }
+}
+
+// 按帧把数据放入各个流的接收队列，直到连接断开；从不阻塞在某个流上。
+// 断开后所有流的应用一端读到 EOF
+static void reader_loop(MuxConn *conn) {
+    MuxFrameHeader hdr;
+    while (read_full(conn->sock, &hdr, sizeof(hdr)) == 1) {
+        if (hdr.length > MUX_MAX_FRAME || hdr.length < -MUX_STREAM_WINDOW) {
+            break;
+        }
+        MuxChunk *c = NULL;
+        if (hdr.length > 0) {
+            c = malloc(sizeof(MuxChunk) + hdr.length);
+            if (!c || read_full(conn->sock, c->data, hdr.length) != 1) {
+                free(c);
+                break;
+            }
+            c->next = NULL;
+            c->length = hdr.length;
+        }
+
+        MuxStream *s = stream_find(conn, hdr.id);
+        if (!s && hdr.length > 0 && conn->handler) {
+            // 服务端：新的流 ID，启动处理线程
+            s = stream_create(conn, hdr.id);
+            if (s && pthread_create(&s->handler, NULL, handler_main, s) == 0) {
+                s->has_handler = 1;
+            } else if (s) {
+                close(s->app_fd);
+            }
+        }
+        if (!s) {
+            // 已回收的流：丢弃数据与额度帧
+            free(c);
+            continue;
+        }
+
+        int overflow = 0;
+        pthread_mutex_lock(&conn->lock);
+        if (hdr.length < 0) {
+            s->send_credit -= hdr.length;
+            pthread_cond_broadcast(&conn->credit);
+        } else if (hdr.length == 0) {
+            s->remote_closed = 1;
+            pthread_cond_signal(&s->queue_ready);
+        } else if (!s->remote_closed) {
+            // 对端不会超出归还的额度发送，超出说明协议出错
+            overflow = s->queued + c->length > MUX_STREAM_WINDOW;
+            if (!overflow) {
+                if (s->queue_tail) s->queue_tail->next = c; else s->queue_head = c;
+                s->queue_tail = c;
+                s->queued += c->length;
+                c = NULL;
+                pthread_cond_signal(&s->queue_ready);
+            }
+        }
+        pthread_mutex_unlock(&conn->lock);
+        free(c);
+        if (overflow) {
+            break;
+        }
+        if (hdr.length == 0) {
+            reap_streams(conn, 0);
+        }
+    }
+
+    pthread_mutex_lock(&conn->lock);
+    conn->failed = 1;
+    for (MuxStream *s = conn->streams; s; s = s->next) {
+        shutdown(s->fd, SHUT_RDWR);
+        pthread_cond_signal(&s->queue_ready);
+    }
+    pthread_cond_broadcast(&conn->credit);
+    pthread_cond_broadcast(&conn->idle);
+    pthread_mutex_unlock(&conn->lock);
+}
+
+static void *reader_main(void *arg) {
+    reader_loop(arg);
+    return NULL;
+}
+
+static void conn_init(MuxConn *conn, int sock) {
+    memset(conn, 0, sizeof(*conn));
+    conn->sock = sock;
+    // 请求/响应都是小帧，关闭 Nagle 算法，否则每个来回都要等待延迟确认
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    pthread_mutex_init(&conn->lock, NULL);
+    pthread_mutex_init(&conn->write_lock, NULL);
+    pthread_cond_init(&conn->idle, NULL);
+    pthread_cond_init(&conn->credit, NULL);
+}
+
+static void conn_destroy(MuxConn *conn) {
+    pthread_mutex_destroy(&conn->lock);
+    pthread_mutex_destroy(&conn->write_lock);
+    pthread_cond_destroy(&conn->idle);
+    pthread_cond_destroy(&conn->credit);
+}
+
+void mux_serve(int sock, MuxHandler handler, void *arg) {
+    MuxConn conn;
+    conn_init(&conn, sock);
+    conn.handler = handler;
+    conn.arg = arg;
+    reader_loop(&conn);
+    reap_streams(&conn, 1);
+    conn_destroy(&conn);
+}
+
+MuxConn *mux_open(int sock) {
+    int cmd = CMD_MUX;
+    if (write_full(sock, &cmd, sizeof(cmd)) != 0) {
+        return NULL;
+    }
+    // 长连接空闲时接收线程一直阻塞等待，不能有接收超时
+    struct timeval tv = {0, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    MuxConn *conn = malloc(sizeof(MuxConn));
+    if (!conn) {
+        return NULL;
+    }
+    conn_init(conn, sock);
+    if (pthread_create(&conn->reader, NULL, reader_main, conn) != 0) {
+        conn_destroy(conn);
+        free(conn);
+        return NULL;
+    }
+    return conn;
+}
+
+int mux_stream(MuxConn *conn) {
+    pthread_mutex_lock(&conn->lock);
+    int failed = conn->failed;
+    uint32_t id = ++conn->next_id;
+    pthread_mutex_unlock(&conn->lock);
+    if (failed) {
+        return -1;
+    }
+    MuxStream *s = stream_create(conn, id);
+    return s ? s->app_fd : -1;
+}
+
+void mux_close(MuxConn *conn) {
+    // 等已关闭的流把剩余数据和关闭帧发完，再关闭写方向；对端处理完所有流后断开连接。
+    // 应用遗留未关闭的流时最多等待 MUX_CLOSE_TIMEOUT 秒
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += MUX_CLOSE_TIMEOUT;
+    pthread_mutex_lock(&conn->lock);
+    for (;;) {
+        int busy = 0;
+        for (MuxStream *s = conn->streams; s; s = s->next) {
+            busy |= !s->done;
+        }
+        if (!busy || conn->failed ||
+            pthread_cond_timedwait(&conn->idle, &conn->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&conn->lock);
+
+    shutdown(conn->sock, SHUT_WR);
+    pthread_join(conn->reader, NULL);
+    reap_streams(conn, 1);
+    close(conn->sock);
+    conn_destroy(conn);
+    free(conn);
+}
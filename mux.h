@@ -0,0 +1,54 @@
+#pragma once
+/**
+ * 单连接多路复用
+ *
+ * 客户端以 CMD_MUX 开始一条连接后，该连接上只传输帧：
+ *   uint32_t stream_id, int32_t length, length 字节数据
+ * length 为 0 表示发送方关闭该流的写方向，小于 0 表示归还额度（见下）。对端第一次出现的流 ID 即新建一个逻辑流，
+ * 流 ID 由客户端分配、单调递增。
+ *
+ * 每个逻辑流在本地对应一对 AF_UNIX socketpair：应用拿到其中一端，像普通 socket 一样
+ * 收发、close；复用层在另一端与 TCP 连接之间搬运数据。原有的阻塞式协议代码不用改动
+ * 就能跑在逻辑流上，多个会话可以并发共享同一条长连接。
+ *
+ * 每个流单独流控：发送方最多发出 MUX_STREAM_WINDOW 字节未确认的数据，接收方把数据交给应用后
+ * 用 length < 0 的帧归还 -length 字节的额度。接收线程只把数据放入流的接收队列，由每个流自己的
+ * 线程写给应用，某个流的应用长时间不读只会停住这个流，不会阻塞整条连接上的其他流。
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define MUX_MAX_FRAME (64 * 1024)            // 单帧数据上限，大块数据拆成多帧交错发送
+#define MUX_STREAM_BUFFER (1024 * 1024)
+#define MUX_STREAM_WINDOW (1024 * 1024)      // 每个流未确认数据的上限
+#define MUX_CLOSE_TIMEOUT 5                  // 关闭连接时等待各流发完数据的秒数
+
+typedef struct MuxStream MuxStream;
+
+// 服务端处理一个逻辑流，fd 在返回后由复用层关闭
+typedef void (*MuxHandler)(int fd, void *arg);
+
+typedef struct {
+    int sock;
+    pthread_mutex_t lock;        // 保护流表、failed 以及各流的额度与接收队列
+    pthread_mutex_t write_lock;  // 多个流的帧串行写入连接
+    pthread_cond_t idle;         // 有流发完关闭帧或连接断开
+    pthread_cond_t credit;       // 有流得到归还的额度或连接断开
+    MuxStream *streams;
+    uint32_t next_id;
+    int failed;                  // 连接已断开
+    MuxHandler handler;          // 服务端：对端新建流时在新线程中调用；客户端为 NULL
+    void *arg;
+    pthread_t reader;
+} MuxConn;
+
+// 服务端：已读取 CMD_MUX 后调用，在当前线程中处理连接直到断开，返回前等待所有流结束
+void mux_serve(int sock, MuxHandler handler, void *arg);
+
+// 客户端：在已连接的 socket 上发送 CMD_MUX 并启动接收线程，失败返回 NULL（sock 仍由调用者关闭）
+MuxConn *mux_open(int sock);
+// 新建逻辑流，返回应用使用的一端，用完 close 即结束该流；连接已断开时返回 -1
+int mux_stream(MuxConn *conn);
+// 等各流发完剩余数据后关闭连接（包括 sock）并释放；调用前应用应已关闭全部流
+void mux_close(MuxConn *conn);
@@ -0,0 +1,696 @@
+// packstore.c - 小块打包存储
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "packstore.h"
+
+#define PACKSTORE_MIN_BUCKETS 1024
+#define PACKSTORE_RECORD_SIZE (8 + SHA_DIGEST_LENGTH + 4 + 4 + 4)
+
+static uint64_t packstore_hash(const ChunkId *id) {
+    uint64_t h;
+    memcpy(&h, id->sha1, sizeof(h));
+    h ^= id->fastfp;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static int chunk_id_equal(const ChunkId *a, const ChunkId *b) {
+    return a->fastfp == b->fastfp && memcmp(a->sha1, b->sha1, SHA_DIGEST_LENGTH) == 0;
+}
+
+static void pack_path(const PackStore *ps, uint32_t pack, char *out, size_t out_len) {
+    snprintf(out, out_len, "%s/pack-%06u.pack", ps->dir, pack);
+}
+
+// 索引记录：fastfp(8) sha1(20) pack(4) offset(4) size(4)，size 为 -1 表示删除
+static void record_encode(unsigned char *rec, const ChunkId *id, uint32_t pack, uint32_t offset, int size) {
+    memcpy(rec, &id->fastfp, 8);
+    memcpy(rec + 8, id->sha1, SHA_DIGEST_LENGTH);
+    memcpy(rec + 28, &pack, 4);
+    memcpy(rec + 32, &offset, 4);
+    memcpy(rec + 36, &size, 4);
+}
+
+static void record_decode(const unsigned char *rec, ChunkId *id, uint32_t *pack, uint32_t *offset, int *size) {
+    memcpy(&id->fastfp, rec, 8);
+    memcpy(id->sha1, rec + 8, SHA_DIGEST_LENGTH);
+    memcpy(pack, rec + 28, 4);
+    memcpy(offset, rec + 32, 4);
+    memcpy(size, rec + 36, 4);
+}
+
+static int find_entry(const PackStore *ps, const ChunkId *id) {
+    for (int i = ps->buckets[packstore_hash(id) & ps->bucket_mask]; i >= 0; i = ps->entries[i].next) {
+        if (chunk_id_equal(&ps->entries[i].id, id)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int grow_buckets(PackStore *ps) {
+    int count = (ps->bucket_mask + 1) * 2;
+    int *buckets = malloc(count * sizeof(int));
+    if (!buckets) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        buckets[i] = -1;
+    }
+    for (int i = 0; i < ps->entry_count; i++) {
+        if (ps->entries[i].size > 0) {
+            int b = packstore_hash(&ps->entries[i].id) & (count - 1);
+            ps->entries[i].next = buckets[b];
+            buckets[b] = i;
+        }
+    }
+    free(ps->buckets);
+    ps->buckets = buckets;
+    ps->bucket_mask = count - 1;
+    return 0;
+}
+
+// 插入新条目，返回下标，内存不足返回 -1
+static int insert_entry(PackStore *ps, const ChunkId *id, uint32_t pack, uint32_t offset, int size) {
+    int idx = ps->free_head;
+    if (idx >= 0) {
+        ps->free_head = ps->entries[idx].next;
+    } else {
+        if (ps->entry_count == ps->entry_cap) {
+            int cap = ps->entry_cap ? ps->entry_cap * 2 : 1024;
+            PackEntry *entries = realloc(ps->entries, cap * sizeof(PackEntry));
+            if (!entries) {
+                return -1;
+            }
+            ps->entries = entries;
+            ps->entry_cap = cap;
+        }
+        idx = ps->entry_count++;
+    }
+    PackEntry *e = &ps->entries[idx];
+    e->id = *id;
+    e->pack = pack;
+    e->offset = offset;
+    e->size = size;
+    e->syncing = 0;
+    int b = packstore_hash(id) & ps->bucket_mask;
+    e->next = ps->buckets[b];
+    ps->buckets[b] = idx;
+    if (ps->entry_count > 2 * (ps->bucket_mask + 1)) {
+        grow_buckets(ps);
+    }
+    return idx;
+}
+
+// 从哈希链摘下条目并放回空槽链表
+static void release_entry(PackStore *ps, int idx) {
+    PackEntry *e = &ps->entries[idx];
+    int *link = &ps->buckets[packstore_hash(&e->id) & ps->bucket_mask];
+    while (*link != idx) {
+        link = &ps->entries[*link].next;
+    }
+    *link = e->next;
+    e->size = 0;
+    e->next = ps->free_head;
+    ps->free_head = idx;
+}
+
+static int ensure_packs(PackStore *ps, uint32_t count) {
+    if (count <= ps->pack_count) {
+        return 0;
+    }
+    PackInfo *packs = realloc(ps->packs, count * sizeof(PackInfo));
+    if (!packs) {
+        return -1;
+    }
+    memset(packs + ps->pack_count, 0, (count - ps->pack_count) * sizeof(PackInfo));
+    ps->packs = packs;
+    ps->pack_count = count;
+    return 0;
+}
+
+// 重放索引日志，返回读到的记录数，文件不存在返回 0，格式错误返回 -1
+static long replay_index(PackStore *ps, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+    char magic[8];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, PACKSTORE_INDEX_MAGIC, sizeof(magic)) != 0) {
+        fclose(file);
+        return -1;
+    }
+
+    long records = 0;
+    unsigned char rec[PACKSTORE_RECORD_SIZE];
+    // 末尾不完整的记录（写入中途崩溃）直接忽略
+    while (fread(rec, 1, sizeof(rec), file) == sizeof(rec)) {
+        ChunkId id;
+        uint32_t pack, offset;
+        int size;
+        record_decode(rec, &id, &pack, &offset, &size);
+        records++;
+        int idx = find_entry(ps, &id);
+        if (size <= 0) {
+            if (idx >= 0) release_entry(ps, idx);
+            continue;
+        }
+        if (pack == PACKSTORE_PENDING || ensure_packs(ps, pack + 1) != 0) {
+            continue;
+        }
+        if (idx >= 0) {
+            ps->entries[idx].pack = pack;
+            ps->entries[idx].offset = offset;
+            ps->entries[idx].size = size;
+        } else if (insert_entry(ps, &id, pack, offset, size) < 0) {
+            fclose(file);
+            return -1;
+        }
+    }
+    fclose(file);
+    return records;
+}
+
+// 把存活的条目写成新的索引文件，替换原有的日志
+static int rewrite_index(PackStore *ps) {
+    char path[512], tmp_path[512];
+    snprintf(path, sizeof(path), "%s/%s", ps->dir, PACKSTORE_INDEX_FILE);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/%s.tmp", ps->dir, PACKSTORE_INDEX_FILE);
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        return -1;
+    }
+    int ok = fwrite(PACKSTORE_INDEX_MAGIC, 1, 8, file) == 8;
+    unsigned char rec[PACKSTORE_RECORD_SIZE];
+    for (int i = 0; i < ps->entry_count && ok; i++) {
+        const PackEntry *e = &ps->entries[i];
+        if (e->size > 0 && e->pack != PACKSTORE_PENDING && !e->syncing) {
+            record_encode(rec, &e->id, e->pack, e->offset, e->size);
+            ok = fwrite(rec, 1, sizeof(rec), file) == sizeof(rec);
+        }
+    }
+    ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+    ps->index_records = ps->live_count;
+    return 0;
+}
+
+static int sync_dir(const char *dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return -1;
+    }
+    int ret = fsync(fd);
+    close(fd);
+    return ret;
+}
+
+static int open_index_fd(PackStore *ps) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", ps->dir, PACKSTORE_INDEX_FILE);
+    if (ps->index_fd >= 0) {
+        close(ps->index_fd);
+    }
+    ps->index_fd = open(path, O_WRONLY | O_APPEND);
+    return ps->index_fd >= 0 ? 0 : -1;
+}
+
+int packstore_open(PackStore *ps, const char *dir, int max_object) {
+    memset(ps, 0, sizeof(*ps));
+    if (max_object < 0 || max_object > PACKSTORE_MAX_OBJECT) {
+        return -1;
+    }
+    snprintf(ps->dir, sizeof(ps->dir), "%s", dir);
+    ps->max_object = max_object;
+    ps->index_fd = -1;
+    ps->free_head = -1;
+    ps->buckets = malloc(PACKSTORE_MIN_BUCKETS * sizeof(int));
+    if (!ps->buckets) {
+        return -1;
+    }
+    for (int i = 0; i < PACKSTORE_MIN_BUCKETS; i++) {
+        ps->buckets[i] = -1;
+    }
+    ps->bucket_mask = PACKSTORE_MIN_BUCKETS - 1;
+
+    // 目录中的 pack 文件决定编号范围，没有被索引引用的 pack 在压缩时删除
+    DIR *d = opendir(dir);
+    if (d) {
+        struct dirent *entry;
+        while ((entry = readdir(d)) != NULL) {
+            unsigned int pack;
+            char tail;
+            if (sscanf(entry->d_name, "pack-%6u.pac%c", &pack, &tail) == 2 && tail == 'k' &&
+                strlen(entry->d_name) == 16 && ensure_packs(ps, pack + 1) != 0) {
+                closedir(d);
+                packstore_close(ps);
+                return -1;
+            }
+        }
+        closedir(d);
+    }
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, PACKSTORE_INDEX_FILE);
+    long records = replay_index(ps, path);
+    if (records < 0 || ensure_packs(ps, 1) != 0) {
+        packstore_close(ps);
+        return -1;
+    }
+    ps->index_records = records;
+
+    // 以文件实际长度为准，丢弃引用了缺失数据的条目
+    int dropped = 0;
+    for (uint32_t p = 0; p < ps->pack_count; p++) {
+        struct stat st;
+        char pack_file[512];
+        pack_path(ps, p, pack_file, sizeof(pack_file));
+        ps->packs[p].bytes = stat(pack_file, &st) == 0 ? (uint64_t)st.st_size : 0;
+    }
+    for (int i = 0; i < ps->entry_count; i++) {
+        PackEntry *e = &ps->entries[i];
+        if (e->size <= 0) continue;
+        if ((uint64_t)e->offset + e->size > ps->packs[e->pack].bytes) {
+            release_entry(ps, i);
+            dropped++;
+            continue;
+        }
+        ps->packs[e->pack].live += e->size;
+        ps->live_count++;
+    }
+    ps->current = ps->pack_count - 1;
+
+    // 索引不存在、有条目被丢弃或删除记录过多时重写索引
+    if (records == 0 || dropped > 0 || ps->index_records > 2 * (uint64_t)ps->live_count + 1024) {
+        if (rewrite_index(ps) != 0) {
+            packstore_close(ps);
+            return -1;
+        }
+    }
+    if (open_index_fd(ps) != 0) {
+        packstore_close(ps);
+        return -1;
+    }
+    return 0;
+}
+
+void packstore_close(PackStore *ps) {
+    if (ps->index_fd >= 0) {
+        fsync(ps->index_fd);
+        close(ps->index_fd);
+    }
+    free(ps->entries);
+    free(ps->buckets);
+    free(ps->packs);
+    free(ps->buf);
+    free(ps->pending);
+    memset(ps, 0, sizeof(*ps));
+    ps->index_fd = -1;
+}
+
+const PackEntry *packstore_lookup(const PackStore *ps, const ChunkId *id) {
+    if (!ps->buckets) {
+        return NULL;
+    }
+    int idx = find_entry(ps, id);
+    return idx >= 0 ? &ps->entries[idx] : NULL;
+}
+
+static int read_at(const PackStore *ps, uint32_t pack, uint32_t offset, unsigned char *out, int size) {
+    char path[512];
+    pack_path(ps, pack, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t n = pread(fd, out, size, offset);
+    close(fd);
+    return n == size ? 0 : -1;
+}
+
+unsigned char *packstore_read(const PackStore *ps, const ChunkId *id, long *size) {
+    *size = 0;
+    const PackEntry *e = packstore_lookup(ps, id);
+    if (!e) {
+        return NULL;
+    }
+    unsigned char *data = malloc(e->size);
+    if (!data) {
+        return NULL;
+    }
+    if (e->pack == PACKSTORE_PENDING) {
+        memcpy(data, ps->buf + e->offset, e->size);
+    } else if (read_at(ps, e->pack, e->offset, data, e->size) != 0) {
+        free(data);
+        return NULL;
+    }
+    *size = e->size;
+    return data;
+}
+
+// 把条目的数据放入待写缓冲；entry 为 -1 时新建条目
+static int stage(PackStore *ps, int entry, const ChunkId *id, const unsigned char *data, int size) {
+    if (ps->buf_len + size > ps->buf_cap) {
+        size_t cap = ps->buf_cap ? ps->buf_cap : PACKSTORE_FLUSH_BYTES;
+        while (cap < ps->buf_len + size) cap *= 2;
+        unsigned char *buf = realloc(ps->buf, cap);
+        if (!buf) {
+            return -1;
+        }
+        ps->buf = buf;
+        ps->buf_cap = cap;
+    }
+    if (ps->pending_count == ps->pending_cap) {
+        int cap = ps->pending_cap ? ps->pending_cap * 2 : 256;
+        PackPending *pending = realloc(ps->pending, cap * sizeof(PackPending));
+        if (!pending) {
+            return -1;
+        }
+        ps->pending = pending;
+        ps->pending_cap = cap;
+    }
+
+    PackPending *p = &ps->pending[ps->pending_count];
+    if (entry < 0) {
+        entry = insert_entry(ps, id, PACKSTORE_PENDING, (uint32_t)ps->buf_len, size);
+        if (entry < 0) {
+            return -1;
+        }
+        p->old_pack = PACKSTORE_PENDING;
+        p->old_offset = 0;
+    } else {
+        p->old_pack = ps->entries[entry].pack;
+        p->old_offset = ps->entries[entry].offset;
+        ps->entries[entry].pack = PACKSTORE_PENDING;
+        ps->entries[entry].offset = (uint32_t)ps->buf_len;
+    }
+    p->entry = entry;
+    ps->pending_count++;
+    memcpy(ps->buf + ps->buf_len, data, size);
+    ps->buf_len += size;
+    return 0;
+}
+
+int packstore_add(PackStore *ps, const ChunkId *id, const unsigned char *data, int size) {
+    if (size <= 0 || size > ps->max_object) {
+        return -1;
+    }
+    if (find_entry(ps, id) >= 0) {
+        return 0;
+    }
+    return stage(ps, -1, id, data, size);
+}
+
+// 丢弃未持久化的条目：新块移出索引，搬迁中的块恢复原位置
+static void drop_entries(PackStore *ps, const PackPending *pending, int count) {
+    for (int i = count - 1; i >= 0; i--) {
+        const PackPending *p = &pending[i];
+        ps->entries[p->entry].syncing = 0;
+        if (p->old_pack == PACKSTORE_PENDING) {
+            release_entry(ps, p->entry);
+        } else {
+            ps->entries[p->entry].pack = p->old_pack;
+            ps->entries[p->entry].offset = p->old_offset;
+        }
+    }
+}
+
+// 丢弃待写缓冲
+static void discard_pending(PackStore *ps) {
+    drop_entries(ps, ps->pending, ps->pending_count);
+    ps->pending_count = 0;
+    ps->buf_len = 0;
+}
+
+int packstore_flush_begin(PackStore *ps, PackFlush *flush) {
+    memset(flush, 0, sizeof(*flush));
+    flush->pack_fd = -1;
+    flush->index_fd = -1;
+    snprintf(flush->dir, sizeof(flush->dir), "%s", ps->dir);
+    // 索引日志在 end 时 fsync；描述符独立于 ps，压缩重写索引后也不受影响
+    flush->index_fd = dup(ps->index_fd);
+    if (flush->index_fd < 0) {
+        discard_pending(ps);
+        return -1;
+    }
+    if (ps->pending_count == 0) {
+        return 0;
+    }
+    // 当前 pack 写满后换到新编号
+    if (ps->packs[ps->current].bytes > 0 &&
+        ps->packs[ps->current].bytes + ps->buf_len > PACKSTORE_PACK_BYTES) {
+        if (ensure_packs(ps, ps->pack_count + 1) != 0) {
+            discard_pending(ps);
+            return -1;
+        }
+        ps->current = ps->pack_count - 1;
+    }
+    uint32_t pack = ps->current;
+    uint64_t base = ps->packs[pack].bytes;
+
+    // 写到预留的区域，并发的下一次 flush 从其后开始
+    char path[512];
+    pack_path(ps, pack, path, sizeof(path));
+    int fd = open(path, O_WRONLY | O_CREAT, 0644);
+    int ok = fd >= 0;
+    size_t written = 0;
+    while (ok && written < ps->buf_len) {
+        ssize_t n = pwrite(fd, ps->buf + written, ps->buf_len - written, base + written);
+        if (n <= 0) ok = 0;
+        else written += n;
+    }
+    flush->pending = ok ? malloc((size_t)ps->pending_count * sizeof(PackPending)) : NULL;
+    if (!flush->pending) {
+        if (fd >= 0) close(fd);
+        discard_pending(ps);
+        return -1;
+    }
+
+    // 条目改指向 pack 中的位置：读取从页缓存即可得到，索引记录等 fsync 之后再追加
+    memcpy(flush->pending, ps->pending, (size_t)ps->pending_count * sizeof(PackPending));
+    flush->pending_count = ps->pending_count;
+    for (int i = 0; i < ps->pending_count; i++) {
+        PackEntry *e = &ps->entries[ps->pending[i].entry];
+        e->pack = pack;
+        e->offset = (uint32_t)(base + e->offset);
+        e->syncing = 1;
+    }
+    ps->packs[pack].bytes += ps->buf_len;
+    ps->pending_count = 0;
+    ps->buf_len = 0;
+    ps->flushing++;
+    flush->pack = pack;
+    flush->pack_fd = fd;
+    flush->new_pack = base == 0;
+    return 0;
+}
+
+int packstore_flush_sync(PackFlush *flush) {
+    if (flush->pack_fd < 0) {
+        return 0;
+    }
+    int ok = fsync(flush->pack_fd) == 0;
+    if (ok && flush->new_pack) {
+        ok = sync_dir(flush->dir) == 0;
+    }
+    return ok ? 0 : -1;
+}
+
+int packstore_flush_finish(PackStore *ps, PackFlush *flush, int ok, FpFilter *filter) {
+    if (flush->pack_fd < 0) {
+        return 0;
+    }
+    close(flush->pack_fd);
+    flush->pack_fd = -1;
+    ps->flushing--;
+
+    // 数据落盘后再追加索引记录
+    size_t rec_bytes = (size_t)flush->pending_count * PACKSTORE_RECORD_SIZE;
+    unsigned char *records = ok ? malloc(rec_bytes) : NULL;
+    ok = records != NULL;
+    for (int i = 0; ok && i < flush->pending_count; i++) {
+        const PackEntry *e = &ps->entries[flush->pending[i].entry];
+        record_encode(records + (size_t)i * PACKSTORE_RECORD_SIZE, &e->id, e->pack, e->offset, e->size);
+    }
+    ok = ok && write(ps->index_fd, records, rec_bytes) == (ssize_t)rec_bytes;
+    free(records);
+    if (!ok) {
+        drop_entries(ps, flush->pending, flush->pending_count);
+    }
+
+    for (int i = 0; ok && i < flush->pending_count; i++) {
+        PackPending *p = &flush->pending[i];
+        PackEntry *e = &ps->entries[p->entry];
+        e->syncing = 0;
+        if (p->old_pack == PACKSTORE_PENDING) {
+            ps->live_count++;
+            if (filter) fpfilter_add(filter, e->id.fastfp);
+        } else {
+            ps->packs[p->old_pack].live -= e->size;
+        }
+        ps->packs[flush->pack].live += e->size;
+    }
+    if (ok) {
+        ps->index_records += flush->pending_count;
+    }
+    free(flush->pending);
+    flush->pending = NULL;
+    flush->pending_count = 0;
+    return ok ? 0 : -1;
+}
+
+int packstore_flush_end(PackFlush *flush) {
+    if (flush->index_fd < 0) {
+        return 0;
+    }
+    int ret = fsync(flush->index_fd);
+    close(flush->index_fd);
+    flush->index_fd = -1;
+    return ret == 0 ? 0 : -1;
+}
+
+int packstore_flush(PackStore *ps, FpFilter *filter) {
+    if (ps->pending_count == 0) {
+        return 0;
+    }
+    PackFlush flush;
+    int ret = packstore_flush_begin(ps, &flush);
+    int synced = packstore_flush_sync(&flush);
+    if (packstore_flush_finish(ps, &flush, synced == 0, filter) != 0) {
+        ret = -1;
+    }
+    if (packstore_flush_end(&flush) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+int packstore_remove(PackStore *ps, const ChunkId *id) {
+    int idx = find_entry(ps, id);
+    if (idx < 0) {
+        return 1;
+    }
+    PackEntry *e = &ps->entries[idx];
+    if (e->pack == PACKSTORE_PENDING || e->syncing) {
+        return -1;
+    }
+    // 删除记录不单独 fsync，随下一次 flush 落盘；丢失时该块只会在重启后重新出现
+    unsigned char rec[PACKSTORE_RECORD_SIZE];
+    record_encode(rec, id, e->pack, e->offset, -1);
+    if (write(ps->index_fd, rec, sizeof(rec)) != (ssize_t)sizeof(rec)) {
+        return -1;
+    }
+    ps->index_records++;
+    ps->packs[e->pack].live -= e->size;
+    ps->live_count--;
+    release_entry(ps, idx);
+    return 0;
+}
+
+int packstore_list(const PackStore *ps, ChunkId *out) {
+    int n = 0;
+    for (int i = 0; i < ps->entry_count; i++) {
+        const PackEntry *e = &ps->entries[i];
+        if (e->size > 0 && e->pack != PACKSTORE_PENDING && !e->syncing) {
+            out[n++] = e->id;
+        }
+    }
+    return n;
+}
+
+long packstore_compact(PackStore *ps) {
+    // 在途的 flush 已预留了 pack 空间但还没计入存活数据
+    if (ps->flushing > 0) {
+        return 0;
+    }
+    if (ps->pending_count > 0 && packstore_flush(ps, NULL) != 0) {
+        return -1;
+    }
+
+    // 失效数据过半的 pack 需要搬迁；当前写入的 pack 也需要时先换到新编号
+    uint32_t candidates = ps->pack_count;
+    unsigned char *relocate = calloc(candidates, 1);
+    if (!relocate) {
+        return -1;
+    }
+    int any = 0;
+    for (uint32_t p = 0; p < candidates; p++) {
+        if (ps->packs[p].live > 0 && ps->packs[p].live * 2 < ps->packs[p].bytes) {
+            relocate[p] = 1;
+            any = 1;
+        }
+    }
+    if (relocate[ps->current]) {
+        if (ensure_packs(ps, ps->pack_count + 1) != 0) {
+            free(relocate);
+            return -1;
+        }
+        ps->current = ps->pack_count - 1;
+    }
+
+    // 打包阈值可能调整过，已打包的块不一定不超过当前的 max_object，缓冲区按需扩大
+    unsigned char *data = NULL;
+    int data_cap = 0;
+    for (int i = 0; any && i < ps->entry_count; i++) {
+        PackEntry *e = &ps->entries[i];
+        if (e->size <= 0 || e->pack == PACKSTORE_PENDING || e->pack >= candidates || !relocate[e->pack]) {
+            continue;
+        }
+        if (e->size > data_cap) {
+            unsigned char *grown = realloc(data, e->size);
+            if (!grown) {
+                discard_pending(ps);
+                free(data);
+                free(relocate);
+                return -1;
+            }
+            data = grown;
+            data_cap = e->size;
+        }
+        if (read_at(ps, e->pack, e->offset, data, e->size) != 0 || stage(ps, i, &e->id, data, e->size) != 0 ||
+            (ps->buf_len >= PACKSTORE_FLUSH_BYTES && packstore_flush(ps, NULL) != 0)) {
+            discard_pending(ps);
+            free(data);
+            free(relocate);
+            return -1;
+        }
+    }
+    free(data);
+    free(relocate);
+    if (packstore_flush(ps, NULL) != 0 || fsync(ps->index_fd) != 0) {
+        return -1;
+    }
+
+    // 删除不再被引用的 pack；当前 pack 为空时截断
+    long reclaimed = 0;
+    for (uint32_t p = 0; p < ps->pack_count; p++) {
+        if (ps->packs[p].live > 0 || ps->packs[p].bytes == 0) {
+            continue;
+        }
+        char path[512];
+        pack_path(ps, p, path, sizeof(path));
+        if (p == ps->current ? truncate(path, 0) == 0 : remove(path) == 0) {
+            reclaimed += ps->packs[p].bytes;
+            ps->packs[p].bytes = 0;
+        }
+    }
+    if (ps->index_records > 2 * (uint64_t)ps->live_count + 1024 &&
+        (rewrite_index(ps) != 0 || open_index_fd(ps) != 0)) {
+        return -1;
+    }
+    return reclaimed;
+}
@@ -0,0 +1,107 @@
+#pragma once
+/**
+ * 小块打包存储
+ *
+ * 不超过 max_object 字节的块（小文件整体就是一个块，其 SHA1 即整文件摘要）
+ * 不再各占一个块文件，而是追加到共享的 "pack-<n>.pack" 中，位置记录在追加写的索引日志
+ * "packs.idx" 里，启动时重放到内存哈希表。
+ * 写入先缓存在内存中，flush 时一次写入 pack 并 fsync，再追加索引记录并 fsync：
+ * 索引只引用已持久化的数据，崩溃后 pack 尾部多出的数据不会被引用。
+ * 删除只追加一条删除记录，失效数据过半的 pack 由 packstore_compact 搬迁存活的块后删除。
+ * 非线程安全，服务端在存储锁下使用；flush 可拆成 begin/sync/finish/end 四步，
+ * 其中 sync 与 end 只做 fsync，不访问 PackStore，调用者可以在这两步释放存储锁。
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "chunkstore.h"
+#include "fpfilter.h"
+
+#define PACKSTORE_MAX_OBJECT (64 * 1024)          // 打包阈值 max_object 的上限
+#define PACKSTORE_PACK_BYTES (64 * 1024 * 1024)   // 单个 pack 文件上限
+#define PACKSTORE_FLUSH_BYTES (4 * 1024 * 1024)   // 待写缓冲达到该大小时应提交
+#define PACKSTORE_INDEX_FILE "packs.idx"
+#define PACKSTORE_INDEX_MAGIC "PACKIDX1"
+#define PACKSTORE_PENDING UINT32_MAX              // 条目仍在待写缓冲中
+
+typedef struct {
+    ChunkId id;
+    uint32_t pack;                // pack 编号，PACKSTORE_PENDING 时 offset 为缓冲区内偏移
+    uint32_t offset;
+    int size;                     // 0 表示空槽
+    int next;                     // 哈希链 / 空槽链中的下一个条目，-1 结束
+    int syncing;                  // 数据已写入 pack、尚未 fsync 和记入索引（flush 在途）
+} PackEntry;
+
+typedef struct {
+    uint64_t bytes;               // pack 文件中已写入的字节数（含失效数据）
+    uint64_t live;                // 仍被索引引用的字节数
+} PackInfo;
+
+typedef struct PackPending {
+    int entry;
+    uint32_t old_pack;            // 搬迁前的位置，新块为 PACKSTORE_PENDING
+    uint32_t old_offset;
+} PackPending;
+
+struct PackStore {
+    char dir[256];
+    int max_object;               // 不超过该大小的块打包存储，0 表示不打包
+    int index_fd;
+    PackEntry *entries;
+    int entry_count;              // 已使用过的条目数（含空槽）
+    int entry_cap;
+    int free_head;
+    int *buckets;
+    int bucket_mask;
+    int live_count;               // 已持久化的块数
+    PackInfo *packs;              // 按 pack 编号
+    uint32_t pack_count;
+    uint32_t current;             // 追加写入的 pack
+    unsigned char *buf;           // 待写缓冲
+    size_t buf_len;
+    size_t buf_cap;
+    PackPending *pending;
+    int pending_count;
+    int pending_cap;
+    uint64_t index_records;       // 索引日志中的记录数，过多时重写
+    int flushing;                 // 已 begin 尚未 finish 的 flush 数，非 0 时不压缩
+};
+
+// 打开存储目录中的打包存储，重放索引日志；目录中没有 pack 时得到空的存储。
+// max_object（0~PACKSTORE_MAX_OBJECT）只影响之后写入的块，已打包的块不论大小照常读取和搬迁
+int packstore_open(PackStore *ps, const char *dir, int max_object);
+void packstore_close(PackStore *ps);
+
+// 查找块（含待写缓冲中的块），不存在返回 NULL
+const PackEntry *packstore_lookup(const PackStore *ps, const ChunkId *id);
+// 读取块，返回 malloc 的缓冲区（调用者释放），不存在或读取失败返回 NULL
+unsigned char *packstore_read(const PackStore *ps, const ChunkId *id, long *size);
+
+// 加入待写缓冲，块已存在时直接返回 0；超过 max_object 的块返回 -1
+int packstore_add(PackStore *ps, const ChunkId *id, const unsigned char *data, int size);
+// 持久化待写缓冲，新块加入 filter（可为 NULL）；失败时丢弃待写的块并返回 -1。
+// 依次执行下面四步，整个过程需要独占 PackStore
+int packstore_flush(PackStore *ps, FpFilter *filter);
+
+// 分步 flush（PackFlush 见 chunkstore.h）：
+//   begin  取走待写缓冲，在当前 pack 末尾预留空间并写入（只到页缓存），条目标记为 syncing；
+//          读取照常可见，列举、删除和压缩在 finish 之前跳过这些条目
+//   sync   fsync pack 文件，新建的 pack 同时同步目录；不访问 PackStore
+//   finish 按 ok 追加索引记录并发布条目，新块加入 filter；ok 为 0 或追加失败时丢弃条目
+//   end    fsync 索引日志并关闭描述符；不访问 PackStore
+// begin 失败时 flush 为空，仍可以（也需要）调用后三步
+int packstore_flush_begin(PackStore *ps, PackFlush *flush);
+int packstore_flush_sync(PackFlush *flush);
+int packstore_flush_finish(PackStore *ps, PackFlush *flush, int ok, FpFilter *filter);
+int packstore_flush_end(PackFlush *flush);
+
+// 删除已持久化的块，成功返回 0，块不存在返回 1，其他错误返回 -1
+int packstore_remove(PackStore *ps, const ChunkId *id);
+
+// 把已持久化的块追加到 out（容量至少 live_count），返回个数
+int packstore_list(const PackStore *ps, ChunkId *out);
+
+// 搬迁失效数据过半的 pack 中存活的块，删除不再被引用的 pack，返回回收的字节数，失败返回 -1。
+// 有 flush 在途时不做任何事，返回 0
+long packstore_compact(PackStore *ps);
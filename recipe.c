@@ -0,0 +1,174 @@
+// recipe.c - 文件配方与按字节范围读取
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "recipe.h"
+
+int recipe_save(const char *path, const Recipe *recipe) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return -1;
+    }
+
+    char magic[8] = RECIPE_MAGIC;
+    int ok = fwrite(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+             fwrite(&recipe->file_size, sizeof(uint64_t), 1, file) == 1 &&
+             fwrite(&recipe->count, sizeof(int), 1, file) == 1;
+    if (ok && recipe->count > 0) {
+        ok = fwrite(recipe->entries, sizeof(RecipeEntry), recipe->count, file) == (size_t)recipe->count;
+    }
+
+    if (fclose(file) != 0) ok = 0;
+    return ok ? 0 : -1;
+}
+
+int recipe_load(const char *path, Recipe *recipe) {
+    memset(recipe, 0, sizeof(*recipe));
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return -1;
+    }
+
+    char magic[8];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, RECIPE_MAGIC, sizeof(magic)) != 0 ||
+        fread(&recipe->file_size, sizeof(uint64_t), 1, file) != 1 ||
+        fread(&recipe->count, sizeof(int), 1, file) != 1 ||
+        recipe->count < 0) {
+        fclose(file);
+        return -1;
+    }
+
+    if (recipe->count > 0) {
+        recipe->entries = malloc(recipe->count * sizeof(RecipeEntry));
+        if (!recipe->entries ||
+            fread(recipe->entries, sizeof(RecipeEntry), recipe->count, file) != (size_t)recipe->count) {
+            fclose(file);
+            recipe_free(recipe);
+            return -1;
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+void recipe_free(Recipe *recipe) {
+    free(recipe->entries);
+    recipe->entries = NULL;
+    recipe->count = 0;
+    recipe->file_size = 0;
+}
+
+int recipe_find_chunk(const Recipe *recipe, uint64_t off) {
+    if (off >= recipe->file_size || recipe->count <= 0) {
+        return -1;
+    }
+
+    // 找到最后一个 offset <= off 的块
+    int lo = 0, hi = recipe->count - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (recipe->entries[mid].offset <= off) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+int range_reader_init(RangeReader *rr, const Recipe *recipe, int cache_slots,
+                      recipe_fetch_fn fetch, void *fetch_ctx) {
+    memset(rr, 0, sizeof(*rr));
+    if (cache_slots < 1) cache_slots = 1;
+
+    rr->slots = calloc(cache_slots, sizeof(RangeCacheSlot));
+    if (!rr->slots) {
+        return -1;
+    }
+    rr->slot_count = cache_slots;
+    rr->recipe = recipe;
+    rr->fetch = fetch;
+    rr->fetch_ctx = fetch_ctx;
+    return 0;
+}
+
+void range_reader_free(RangeReader *rr) {
+    for (int i = 0; i < rr->slot_count; i++) {
+        free(rr->slots[i].data);
+    }
+    free(rr->slots);
+    rr->slots = NULL;
+    rr->slot_count = 0;
+}
+
+// 从缓存取块，未命中时取回并替换最久未使用的槽位
+static const unsigned char *range_reader_get_chunk(RangeReader *rr, const RecipeEntry *entry) {
+    RangeCacheSlot *victim = &rr->slots[0];
+    rr->tick++;
+
+    for (int i = 0; i < rr->slot_count; i++) {
+        RangeCacheSlot *slot = &rr->slots[i];
+        if (slot->data && slot->fastfp == entry->fastfp && slot->size == entry->size &&
+            memcmp(slot->sha1, entry->sha1, SHA_DIGEST_LENGTH) == 0) {
+            slot->last_used = rr->tick;
+            rr->cache_hits++;
+            return slot->data;
+        }
+        if (!slot->data || (victim->data && slot->last_used < victim->last_used)) {
+            victim = slot;
+        }
+    }
+
+    unsigned char *data = malloc(entry->size);
+    if (!data) {
+        return NULL;
+    }
+    rr->fetches++;
+    if (rr->fetch(rr->fetch_ctx, entry, data) != 0) {
+        free(data);
+        return NULL;
+    }
+
+    free(victim->data);
+    victim->data = data;
+    victim->fastfp = entry->fastfp;
+    victim->size = entry->size;
+    memcpy(victim->sha1, entry->sha1, SHA_DIGEST_LENGTH);
+    victim->last_used = rr->tick;
+    return data;
+}
+
+long range_read(RangeReader *rr, uint64_t off, size_t len, unsigned char *out) {
+    const Recipe *recipe = rr->recipe;
+    if (off >= recipe->file_size) {
+        return 0;
+    }
+    if (len > recipe->file_size - off) {
+        len = recipe->file_size - off;
+    }
+
+    int idx = recipe_find_chunk(recipe, off);
+    if (idx < 0) {
+        return -1;
+    }
+
+    size_t copied = 0;
+    while (copied < len && idx < recipe->count) {
+        const RecipeEntry *entry = &recipe->entries[idx];
+        const unsigned char *data = range_reader_get_chunk(rr, entry);
+        if (!data) {
+            return -1;
+        }
+
+        uint64_t in_chunk = off + copied - entry->offset;
+        size_t n = entry->size - in_chunk;
+        if (n > len - copied) n = len - copied;
+        memcpy(out + copied, data + in_chunk, n);
+        copied += n;
+        idx++;
+    }
+    return (long)copied;
+}
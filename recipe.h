@@ -0,0 +1,66 @@
+#pragma once
+/**
+ * 文件配方（recipe）与按字节范围读取
+ *
+ * 配方按文件顺序记录每个块的偏移、大小、FastFp、所在服务器和 SHA1，
+ * 读取 [off, off+len) 时只需二分查找累计偏移并取回覆盖该范围的块。
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <openssl/sha.h>
+
+#define RECIPE_MAGIC "CDCRCP1"
+
+typedef struct {
+    uint64_t offset;     // 块在原文件中的起始偏移
+    uint64_t fastfp;
+    uint32_t size;
+    int32_t server_id;   // 保存该块的服务器ID (1-based)
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+} RecipeEntry;
+
+typedef struct {
+    uint64_t file_size;
+    int count;
+    RecipeEntry *entries;
+} Recipe;
+
+// 配方文件读写
+int recipe_save(const char *path, const Recipe *recipe);
+int recipe_load(const char *path, Recipe *recipe);
+void recipe_free(Recipe *recipe);
+
+// 返回包含偏移 off 的块下标，越界返回 -1
+int recipe_find_chunk(const Recipe *recipe, uint64_t off);
+
+// 取回一个块的数据到 out（容量至少 entry->size），成功返回 0
+typedef int (*recipe_fetch_fn)(void *ctx, const RecipeEntry *entry, unsigned char *out);
+
+// 缓存按 (FastFp, SHA1, 大小) 匹配：FastFp 只取决于块尾部的字节，尾部相同的不同块
+// （如镜像中大量以零结尾的块）FastFp 与大小都可能相同
+typedef struct {
+    uint64_t fastfp;
+    uint32_t size;
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    unsigned char *data;
+    unsigned long last_used;
+} RangeCacheSlot;
+
+typedef struct {
+    const Recipe *recipe;
+    recipe_fetch_fn fetch;
+    void *fetch_ctx;
+    RangeCacheSlot *slots;
+    int slot_count;
+    unsigned long tick;
+    long fetches;        // 实际取回块的次数
+    long cache_hits;
+} RangeReader;
+
+int range_reader_init(RangeReader *rr, const Recipe *recipe, int cache_slots,
+                      recipe_fetch_fn fetch, void *fetch_ctx);
+void range_reader_free(RangeReader *rr);
+
+// 读取 [off, off+len)，返回实际读取的字节数（到文件末尾截断），失败返回 -1
+long range_read(RangeReader *rr, uint64_t off, size_t len, unsigned char *out);
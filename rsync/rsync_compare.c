@@ -0,0 +1,242 @@
+// rsync_compare.c - 本地使用 rsync 滚动校验和计算两个文件的冗余率（rsync.py 的 C 实现）
+// 用法:
+//   ./rsync_compare <new_file> <basis_file> [block_size ...]
+// 说明:
+//   basis 按固定块长切块并建立弱校验和索引，在 new 上逐字节滑动滚动校验和，
+//   弱校验和命中后与 basis 块逐字节比较确认（本地两份数据都在内存中，等价于强校验且无碰撞）。
+//   命中则跳过一个块长，否则滑动 1 字节。冗余率 = Matched / new 文件大小。
+//   多个块长在同一遍扫描中完成：输入按窗口推进，每个窗口内依次推进各块长的扫描器，
+//   各扫描器访问的数据都在同一窗口附近，大文件只需从内存读一遍。
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define MAX_SIZES 16
+#define SCAN_WINDOW (1 << 20)   // 每轮推进的窗口大小
+#define TAG_BITS 16             // 弱校验和快速过滤位图：2^16 位
+
+static const int default_sizes[] = {512, 1024, 2048, 4096, 8192};
+
+static char *read_file_fully(const char *path, size_t *out_size) {
+    struct stat st;
+    if (stat(path, &st) != 0) return NULL;
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    size_t sz = (size_t)st.st_size;
+    char *buf = (char *)malloc(sz ? sz : 1);
+    if (!buf) { fclose(fp); return NULL; }
+    size_t rd = fread(buf, 1, sz, fp);
+    fclose(fp);
+    if (rd != sz) { free(buf); return NULL; }
+    *out_size = sz;
+    return buf;
+}
+
+// ------------------ rsync 滚动校验和 ------------------
+// s1 = sum(b[i]), s2 = sum((n - i) * b[i])，弱校验和取两者低 16 位拼成 32 位
+typedef struct { uint32_t s1, s2; } Rolling;
+
+static inline uint32_t rolling_weak(const Rolling *r) {
+    return (r->s1 & 0xffff) | (r->s2 << 16);
+}
+
+// 整块计算：两个独立的累加，循环体没有跨迭代依赖，编译器可向量化
+static void rolling_reset(Rolling *r, const unsigned char *p, int n) {
+    uint32_t s1 = 0, s2 = 0;
+    for (int i = 0; i < n; i++) {
+        s1 += p[i];
+        s2 += (uint32_t)(n - i) * p[i];
+    }
+    r->s1 = s1; r->s2 = s2;
+}
+
+static inline void rolling_roll(Rolling *r, unsigned char out, unsigned char in, uint32_t n) {
+    r->s1 += in - out;
+    r->s2 += r->s1 - n * out;
+}
+
+// ------------------ basis 块索引 ------------------
+// 开放寻址表：weak -> 块号，同一 weak 的多个块各占一个槽位；
+// 另有 2^TAG_BITS 位的位图按 weak 的哈希快速排除不存在的校验和
+typedef struct {
+    uint32_t weak;
+    int32_t block;          // -1 表示空槽
+} BlockSlot;
+
+typedef struct {
+    BlockSlot *slots;
+    uint32_t mask;
+    uint64_t *tags;
+} BlockIndex;
+
+static inline uint32_t weak_hash(uint32_t w) {
+    w ^= w >> 16; w *= 0x7feb352dU;
+    w ^= w >> 15; w *= 0x846ca68bU;
+    w ^= w >> 16; return w;
+}
+
+static int block_index_build(BlockIndex *ix, const unsigned char *basis, size_t basis_sz, int bs) {
+    size_t blocks = basis_sz / bs;
+    uint32_t cap = 16;
+    while (cap < blocks * 2) cap <<= 1;
+    ix->mask = cap - 1;
+    ix->slots = (BlockSlot *)malloc(cap * sizeof(BlockSlot));
+    ix->tags = (uint64_t *)calloc((1u << TAG_BITS) / 64, sizeof(uint64_t));
+    if (!ix->slots || !ix->tags) return -1;
+    for (uint32_t i = 0; i < cap; i++) ix->slots[i].block = -1;
+
+    for (size_t b = 0; b < blocks; b++) {
+        Rolling r;
+        rolling_reset(&r, basis + b * bs, bs);
+        uint32_t w = rolling_weak(&r), h = weak_hash(w);
+        uint32_t tag = h >> (32 - TAG_BITS);
+        ix->tags[tag >> 6] |= 1ULL << (tag & 63);
+        uint32_t s = h & ix->mask;
+        while (ix->slots[s].block >= 0) s = (s + 1) & ix->mask;
+        ix->slots[s].weak = w;
+        ix->slots[s].block = (int32_t)b;
+    }
+    return 0;
+}
+
+static void block_index_free(BlockIndex *ix) {
+    free(ix->slots); free(ix->tags);
+    ix->slots = NULL; ix->tags = NULL;
+}
+
+// 在索引中查找与 p 开始的块内容相同的 basis 块，弱校验和相同但内容不同时累加 false_hits
+static inline int block_index_match(const BlockIndex *ix, uint32_t w, const unsigned char *p,
+                                    const unsigned char *basis, int bs, long long *false_hits) {
+    uint32_t h = weak_hash(w), tag = h >> (32 - TAG_BITS);
+    if (!(ix->tags[tag >> 6] & (1ULL << (tag & 63)))) return 0;
+    for (uint32_t s = h & ix->mask; ix->slots[s].block >= 0; s = (s + 1) & ix->mask) {
+        if (ix->slots[s].weak == w) {
+            if (memcmp(p, basis + (size_t)ix->slots[s].block * bs, bs) == 0) return 1;
+            (*false_hits)++;
+        }
+    }
+    return 0;
+}
+
+// ------------------ 单个块长的扫描器 ------------------
+typedef struct {
+    int bs;
+    BlockIndex ix;
+    Rolling r;
+    size_t pos;             // 当前窗口起点
+    int valid;              // r 是否对应 pos 处的窗口
+    long long matched;
+    long long weak_hits;    // 弱校验和命中但内容不同的次数
+} Scanner;
+
+// 推进扫描器直到 pos 达到 limit 或剩余数据不足一个块
+static void scanner_advance(Scanner *sc, const unsigned char *data, size_t n,
+                            const unsigned char *basis, size_t limit) {
+    int bs = sc->bs;
+    if (sc->ix.slots == NULL) {
+        // basis 不足一个块：不可能匹配
+        sc->pos = limit;
+        return;
+    }
+    while (sc->pos < limit && sc->pos + bs <= n) {
+        if (!sc->valid) {
+            rolling_reset(&sc->r, data + sc->pos, bs);
+            sc->valid = 1;
+        }
+        uint32_t w = rolling_weak(&sc->r);
+        if (block_index_match(&sc->ix, w, data + sc->pos, basis, bs, &sc->weak_hits)) {
+            sc->matched += bs;
+            sc->pos += bs;
+            sc->valid = 0;
+            continue;
+        }
+        if (sc->pos + bs < n) {
+            rolling_roll(&sc->r, data[sc->pos], data[sc->pos + bs], (uint32_t)bs);
+        }
+        sc->pos++;
+    }
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    const char *new_path = (argc >= 2) ? argv[1] : "50M1.txt";
+    const char *basis_path = (argc >= 3) ? argv[2] : "50M.txt";
+
+    int sizes[MAX_SIZES], nsizes = 0;
+    for (int i = 3; i < argc && nsizes < MAX_SIZES; i++) {
+        int bs = atoi(argv[i]);
+        if (bs > 0) sizes[nsizes++] = bs;
+    }
+    if (nsizes == 0) {
+        nsizes = (int)(sizeof(default_sizes) / sizeof(default_sizes[0]));
+        memcpy(sizes, default_sizes, sizeof(default_sizes));
+    }
+
+    size_t new_sz = 0, basis_sz = 0;
+    unsigned char *new_buf = (unsigned char *)read_file_fully(new_path, &new_sz);
+    unsigned char *basis_buf = (unsigned char *)read_file_fully(basis_path, &basis_sz);
+    if (!new_buf) { fprintf(stderr, "[错误] 无法读取源文件: %s\n", new_path); return 1; }
+    if (!basis_buf) { fprintf(stderr, "[警告] 无法读取目标文件: %s (将视为完全不同)\n", basis_path); basis_sz = 0; }
+
+    double t0 = now_seconds();
+    Scanner sc[MAX_SIZES];
+    memset(sc, 0, sizeof(sc));
+    for (int i = 0; i < nsizes; i++) {
+        sc[i].bs = sizes[i];
+        if (basis_sz >= (size_t)sizes[i] && block_index_build(&sc[i].ix, basis_buf, basis_sz, sizes[i]) != 0) {
+            fprintf(stderr, "[错误] 构建块索引失败 (块长 %d)\n", sizes[i]);
+            return 1;
+        }
+    }
+    double t1 = now_seconds();
+
+    // 同一遍扫描：按窗口推进所有块长的扫描器
+    for (size_t limit = SCAN_WINDOW; ; limit += SCAN_WINDOW) {
+        if (limit > new_sz) limit = new_sz;
+        for (int i = 0; i < nsizes; i++) {
+            scanner_advance(&sc[i], new_buf, new_sz, basis_buf, limit);
+        }
+        if (limit == new_sz) break;
+    }
+    double t2 = now_seconds();
+
+    int best = 0;
+    for (int i = 1; i < nsizes; i++) {
+        if (sc[i].matched > sc[best].matched ||
+            (sc[i].matched == sc[best].matched && sc[i].bs < sc[best].bs)) best = i;
+    }
+
+    long long total = (long long)new_sz;
+    printf("========== rsync-风格滑动窗口冗余率（多块大小, C） ==========\n");
+    printf("源文件: %s\n", new_path);
+    printf("目标文件: %s\n", basis_path);
+    printf("候选块大小:");
+    for (int i = 0; i < nsizes; i++) printf("%s %d", i ? "," : "", sizes[i]);
+    printf("\n\n逐块大小结果：\n");
+    for (int i = 0; i < nsizes; i++) {
+        double redundancy = total > 0 ? sc[i].matched * 100.0 / total : 0.0;
+        printf("  - 块: %5d | Matched: %10lld | Literal: %10lld | Total: %10lld | 弱校验误命中: %8lld | 冗余率: %6.2f%%\n",
+               sc[i].bs, sc[i].matched, total - sc[i].matched, total, sc[i].weak_hits, redundancy);
+    }
+    printf("\n最佳选择：\n");
+    printf("  块大小: %d bytes\n", sc[best].bs);
+    printf("  冗余率: %.2f%% (Matched %lld / Total %lld)\n",
+           total > 0 ? sc[best].matched * 100.0 / total : 0.0, sc[best].matched, total);
+    printf("\n耗时: 建索引 %.3f s, 扫描 %.3f s (%.1f MB/s，%d 个块长)\n",
+           t1 - t0, t2 - t1, t2 > t1 ? new_sz / (t2 - t1) / (1024 * 1024) : 0.0, nsizes);
+    printf("============================================================\n");
+
+    for (int i = 0; i < nsizes; i++) block_index_free(&sc[i].ix);
+    free(new_buf); free(basis_buf);
+    return 0;
+}
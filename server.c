@@ -0,0 +1,93 @@
+// server.c - 存储节点入口，节点编号、端口和存储目录在运行时指定
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include "dlog.h"
+#include "dedupstore.h"
+#include "packstore.h"
+
+#define MAX_SERVER_ID 4
+
+static void print_usage(const char *program_name) {
+    printf("Usage: %s -i <server_id> [-d <storage_dir>] [-p <bytes>] [port]\n", program_name);
+    printf("  -i  node number 1-%d, default port 8080+id and storage dir ./server<id>file\n", MAX_SERVER_ID);
+    printf("  -d  storage directory\n");
+    printf("  -p  pack chunks up to this size, 0-%d (0 disables packing); default is the minimum chunk size\n"
+           "      at the default average chunk size, so only small files and file tails are packed\n",
+           PACKSTORE_MAX_OBJECT);
+    printf("Invoked as server1..server%d (make creates these links), the node number comes from the name\n",
+           MAX_SERVER_ID);
+}
+
+// 以 server1~server4 的名字启动时（make 生成的链接，兼容旧的启动脚本）从程序名取节点编号
+static int server_id_from_name(const char *program_name) {
+    const char *base = strrchr(program_name, '/');
+    base = base ? base + 1 : program_name;
+    int id;
+    char extra;
+    if (sscanf(base, "server%d%c", &id, &extra) == 1 && id >= 1 && id <= MAX_SERVER_ID) {
+        return id;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int server_id = server_id_from_name(argv[0]);
+    const char *storage_dir = NULL;
+    const char *port = NULL;
+    const char *pack_max = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            server_id = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            storage_dir = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            pack_max = argv[++i];
+        } else if (argv[i][0] != '-' && !port) {
+            port = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (server_id < 1 || server_id > MAX_SERVER_ID) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    DedupStoreConfig config;
+    dedupstore_default_config(&config, server_id);
+    if (port) {
+        config.port = atoi(port);
+    }
+    if (storage_dir) {
+        if (strlen(storage_dir) >= sizeof(config.storage_dir)) {
+            printf("Storage directory path too long: %s\n", storage_dir);
+            return 1;
+        }
+        strcpy(config.storage_dir, storage_dir);
+    }
+    if (pack_max) {
+        char *end;
+        long value = strtol(pack_max, &end, 10);
+        if (*pack_max == '\0' || *end != '\0' || value < 0 || value > PACKSTORE_MAX_OBJECT) {
+            printf("Pack threshold must be 0-%d bytes: %s\n", PACKSTORE_MAX_OBJECT, pack_max);
+            return 1;
+        }
+        config.pack_max = (int)value;
+    }
+
+    // 日志由后台线程批量写出，逐块明细只在 DEDUP_LOG_LEVEL=debug 时输出
+    dlog_init(DLOG_SERVICE);
+    dlog_info("Starting server%d on port %d\n", config.server_id, config.port);
+    // 客户端中途断开时 send 返回错误，不终止进程
+    signal(SIGPIPE, SIG_IGN);
+
+    if (dedupstore_open(&config) != 0 || dedupstore_serve() != 0) {
+        dlog_flush();
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
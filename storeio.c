@@ -0,0 +1,410 @@
+// storeio.c - 服务端异步块写入
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
+#include "storeio.h"
+
+typedef struct {
+    int fd;
+    unsigned char *buf;           // 固定缓冲区，或超过 STOREIO_SLOT_SIZE 时单独分配
+    size_t len;
+    size_t done;                  // 已写入的字节数，短写时从这里续写
+    off_t offset;
+    int *error;
+    int next;                     // 空闲链表 / 线程池待处理队列
+} StoreIoSlot;
+
+#ifdef __linux__
+typedef struct {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    int fixed;                    // 固定缓冲区已注册
+    unsigned unsubmitted;         // 已填入提交队列、尚未 io_uring_enter 的请求数
+} StoreIoRing;
+#endif
+
+struct StoreIo {
+    int uring;
+#ifdef __linux__
+    StoreIoRing ring;
+#endif
+    unsigned char *arena;         // STOREIO_DEPTH 个固定缓冲区
+    StoreIoSlot slots[STOREIO_DEPTH];
+    int free_head;
+    int inflight;
+    // 线程池后端，free_head/inflight 也由 lock 保护
+    pthread_mutex_t lock;
+    pthread_cond_t work;          // 有新请求或正在退出
+    pthread_cond_t done;          // 有请求完成
+    int queue_head, queue_tail;
+    int stopping;
+    pthread_t threads[STOREIO_THREADS];
+    int thread_count;
+};
+
+static unsigned char *slot_arena(StoreIo *io, int i) {
+    return io->arena + (size_t)i * STOREIO_SLOT_SIZE;
+}
+
+// 写入结束：关闭文件、记录错误并归还槽位
+static void slot_finish(StoreIo *io, int i, int failed) {
+    StoreIoSlot *slot = &io->slots[i];
+    if (close(slot->fd) != 0) {
+        failed = 1;
+    }
+    if (failed) {
+        *slot->error = -1;
+    }
+    if (slot->buf != slot_arena(io, i)) {
+        free(slot->buf);
+    }
+    slot->buf = NULL;
+    slot->next = io->free_head;
+    io->free_head = i;
+    io->inflight--;
+}
+
+#ifdef __linux__
+static int ring_enter(StoreIo *io, unsigned min_complete) {
+    StoreIoRing *r = &io->ring;
+    unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    for (;;) {
+        int n = syscall(__NR_io_uring_enter, r->fd, r->unsubmitted, min_complete, flags, NULL, 0);
+        if (n >= 0) {
+            r->unsubmitted -= n;
+            return 0;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            return -1;
+        }
+    }
+}
+
+static void ring_prep(StoreIo *io, int i) {
+    StoreIoRing *r = &io->ring;
+    StoreIoSlot *slot = &io->slots[i];
+    unsigned tail = *r->sq_tail;
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    int fixed = r->fixed && slot->buf == slot_arena(io, i);
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = slot->fd;
+    sqe->addr = (unsigned long)(slot->buf + slot->done);
+    sqe->len = slot->len - slot->done;
+    sqe->off = slot->offset + slot->done;
+    sqe->buf_index = fixed ? i : 0;
+    sqe->user_data = i;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->unsubmitted++;
+}
+
+// 处理完成队列中的所有事件，短写的请求重新提交剩余部分
+static void ring_reap(StoreIo *io) {
+    StoreIoRing *r = &io->ring;
+    unsigned head = *r->cq_head;
+    while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        int i = (int)cqe->user_data;
+        int res = cqe->res;
+        __atomic_store_n(r->cq_head, ++head, __ATOMIC_RELEASE);
+
+        StoreIoSlot *slot = &io->slots[i];
+        if (res > 0) {
+            slot->done += res;
+            if (slot->done < slot->len) {
+                ring_prep(io, i);
+                continue;
+            }
+        }
+        slot_finish(io, i, slot->done < slot->len);
+    }
+}
+
+static void ring_close(StoreIo *io) {
+    StoreIoRing *r = &io->ring;
+    if (r->sqes && r->sqes != MAP_FAILED) {
+        munmap(r->sqes, r->sqes_size);
+    }
+    if (r->cq_ring && r->cq_ring != MAP_FAILED && r->cq_ring != r->sq_ring) {
+        munmap(r->cq_ring, r->cq_ring_size);
+    }
+    if (r->sq_ring && r->sq_ring != MAP_FAILED) {
+        munmap(r->sq_ring, r->sq_ring_size);
+    }
+    close(r->fd);
+}
+
+// 建立 io_uring 并注册固定缓冲区；内核不支持写操作时返回 -1
+static int ring_open(StoreIo *io) {
+    StoreIoRing *r = &io->ring;
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    r->fd = syscall(__NR_io_uring_setup, STOREIO_DEPTH, &p);
+    if (r->fd < 0) {
+        return -1;
+    }
+
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_ring_size > r->sq_ring_size) {
+            r->sq_ring_size = r->cq_ring_size;
+        }
+        r->cq_ring_size = r->sq_ring_size;
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      r->fd, IORING_OFF_SQ_RING);
+    r->cq_ring = (p.features & IORING_FEAT_SINGLE_MMAP) ? r->sq_ring :
+                 mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      r->fd, IORING_OFF_CQ_RING);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->fd, IORING_OFF_SQES);
+    if (r->sq_ring == MAP_FAILED || r->cq_ring == MAP_FAILED || r->sqes == MAP_FAILED) {
+        ring_close(io);
+        return -1;
+    }
+
+    char *sq = r->sq_ring, *cq = r->cq_ring;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    // IORING_OP_WRITE 需要 5.6 以上的内核
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_size);
+    int supported = probe &&
+        syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PROBE, probe, 256) >= 0 &&
+        probe->last_op >= IORING_OP_WRITE &&
+        (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED) &&
+        (probe->ops[IORING_OP_WRITE_FIXED].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    if (!supported) {
+        ring_close(io);
+        return -1;
+    }
+
+    // 注册失败（如超过 RLIMIT_MEMLOCK）时仍可用普通写入
+    struct iovec iov[STOREIO_DEPTH];
+    for (int i = 0; i < STOREIO_DEPTH; i++) {
+        iov[i].iov_base = slot_arena(io, i);
+        iov[i].iov_len = STOREIO_SLOT_SIZE;
+    }
+    r->fixed = syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS, iov, STOREIO_DEPTH) == 0;
+    return 0;
+}
+#endif
+
+static void *pool_worker(void *arg) {
+    StoreIo *io = arg;
+    pthread_mutex_lock(&io->lock);
+    for (;;) {
+        while (!io->stopping && io->queue_head < 0) {
+            pthread_cond_wait(&io->work, &io->lock);
+        }
+        if (io->queue_head < 0) {
+            break;
+        }
+        int i = io->queue_head;
+        StoreIoSlot *slot = &io->slots[i];
+        io->queue_head = slot->next;
+        if (io->queue_head < 0) {
+            io->queue_tail = -1;
+        }
+        pthread_mutex_unlock(&io->lock);
+
+        while (slot->done < slot->len) {
+            ssize_t n = pwrite(slot->fd, slot->buf + slot->done, slot->len - slot->done,
+                               slot->offset + slot->done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            slot->done += n;
+        }
+
+        pthread_mutex_lock(&io->lock);
+        slot_finish(io, i, slot->done < slot->len);
+        pthread_cond_broadcast(&io->done);
+    }
+    pthread_mutex_unlock(&io->lock);
+    return NULL;
+}
+
+StoreIo *storeio_open(StoreIoBackend backend) {
+    StoreIo *io = calloc(1, sizeof(StoreIo));
+    if (!io) {
+        return NULL;
+    }
+    if (posix_memalign((void **)&io->arena, 4096, (size_t)STOREIO_DEPTH * STOREIO_SLOT_SIZE) != 0) {
+        free(io);
+        return NULL;
+    }
+    io->free_head = -1;
+    for (int i = STOREIO_DEPTH - 1; i >= 0; i--) {
+        io->slots[i].next = io->free_head;
+        io->free_head = i;
+    }
+    io->queue_head = io->queue_tail = -1;
+    pthread_mutex_init(&io->lock, NULL);
+    pthread_cond_init(&io->work, NULL);
+    pthread_cond_init(&io->done, NULL);
+
+#ifdef __linux__
+    if (backend == STOREIO_AUTO && ring_open(io) == 0) {
+        io->uring = 1;
+        return io;
+    }
+#endif
+    for (int t = 0; t < STOREIO_THREADS; t++) {
+        if (pthread_create(&io->threads[t], NULL, pool_worker, io) != 0) {
+            break;
+        }
+        io->thread_count++;
+    }
+    if (io->thread_count == 0) {
+        storeio_close(io);
+        return NULL;
+    }
+    return io;
+}
+
+void storeio_close(StoreIo *io) {
+    storeio_wait(io);
+#ifdef __linux__
+    if (io->uring) {
+        ring_close(io);
+    }
+#endif
+    pthread_mutex_lock(&io->lock);
+    io->stopping = 1;
+    pthread_cond_broadcast(&io->work);
+    pthread_mutex_unlock(&io->lock);
+    for (int t = 0; t < io->thread_count; t++) {
+        pthread_join(io->threads[t], NULL);
+    }
+    pthread_mutex_destroy(&io->lock);
+    pthread_cond_destroy(&io->work);
+    pthread_cond_destroy(&io->done);
+    free(io->arena);
+    free(io);
+}
+
+const char *storeio_backend_name(const StoreIo *io) {
+    return io->uring ? "io_uring" : "threads";
+}
+
+int storeio_write(StoreIo *io, int fd, const void *data, size_t len, off_t offset, int *error) {
+    // 取一个空闲槽位，没有时等待在途的写入完成
+    int i;
+#ifdef __linux__
+    if (io->uring) {
+        while (io->free_head < 0) {
+            if (ring_enter(io, 1) != 0) {
+                return -1;
+            }
+            ring_reap(io);
+        }
+    }
+#endif
+    pthread_mutex_lock(&io->lock);
+    while (io->free_head < 0) {
+        pthread_cond_wait(&io->done, &io->lock);
+    }
+    i = io->free_head;
+    io->free_head = io->slots[i].next;
+    pthread_mutex_unlock(&io->lock);
+
+    StoreIoSlot *slot = &io->slots[i];
+    unsigned char *buf = len <= STOREIO_SLOT_SIZE ? slot_arena(io, i) : malloc(len);
+    if (!buf) {
+        pthread_mutex_lock(&io->lock);
+        slot->next = io->free_head;
+        io->free_head = i;
+        pthread_mutex_unlock(&io->lock);
+        return -1;
+    }
+    memcpy(buf, data, len);
+    slot->fd = fd;
+    slot->buf = buf;
+    slot->len = len;
+    slot->done = 0;
+    slot->offset = offset;
+    slot->error = error;
+
+#ifdef __linux__
+    if (io->uring) {
+        io->inflight++;
+        ring_prep(io, i);
+        if (io->ring.unsubmitted >= STOREIO_SUBMIT_BATCH) {
+            ring_enter(io, 0);
+        }
+        return 0;
+    }
+#endif
+    pthread_mutex_lock(&io->lock);
+    io->inflight++;
+    slot->next = -1;
+    if (io->queue_tail >= 0) {
+        io->slots[io->queue_tail].next = i;
+    } else {
+        io->queue_head = i;
+    }
+    io->queue_tail = i;
+    pthread_cond_signal(&io->work);
+    pthread_mutex_unlock(&io->lock);
+    return 0;
+}
+
+void storeio_wait(StoreIo *io) {
+#ifdef __linux__
+    if (io->uring) {
+        while (io->inflight > 0 || io->ring.unsubmitted > 0) {
+            if (ring_enter(io, io->inflight > 0 ? 1 : 0) != 0) {
+                break;
+            }
+            ring_reap(io);
+        }
+        return;
+    }
+#endif
+    pthread_mutex_lock(&io->lock);
+    while (io->inflight > 0) {
+        pthread_cond_wait(&io->done, &io->lock);
+    }
+    pthread_mutex_unlock(&io->lock);
+}
+
+int storeio_in_flight(StoreIo *io) {
+    if (io->uring) {
+        return io->inflight;
+    }
+    pthread_mutex_lock(&io->lock);
+    int inflight = io->inflight;
+    pthread_mutex_unlock(&io->lock);
+    return inflight;
+}
@@ -0,0 +1,41 @@
+#pragma once
+/**
+ * 服务端异步块写入
+ *
+ * 接收上传块的线程只负责把数据交给写入队列，不再等待每个块的 write 完成：
+ * 优先使用 io_uring（直接通过系统调用，不依赖 liburing），数据复制到启动时注册的固定缓冲区，
+ * 用 IORING_OP_WRITE_FIXED 写入，提交请求攒够 STOREIO_SUBMIT_BATCH 个或需要等待时
+ * 一次 io_uring_enter 提交；内核不支持或禁用 io_uring 时退回 STOREIO_THREADS 个线程执行 pwrite。
+ * 写入完成后由队列关闭文件；批量提交前用 storeio_wait 等待全部写入落到页缓存，
+ * 之后的 syncfs/rename 流程不变（见 chunkstore.h）。
+ * 非线程安全，服务端在存储锁下使用。
+ */
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define STOREIO_DEPTH 64                    // 同时在途的写入数，与 CHUNKSTORE_BATCH 一致
+#define STOREIO_SLOT_SIZE (64 * 1024)       // 固定缓冲区大小，更大的块单独分配
+#define STOREIO_SUBMIT_BATCH 8
+#define STOREIO_THREADS 4
+
+typedef enum {
+    STOREIO_AUTO,                           // 优先 io_uring，不可用时使用线程池
+    STOREIO_THREADPOOL
+} StoreIoBackend;
+
+typedef struct StoreIo StoreIo;
+
+// 失败返回 NULL
+StoreIo *storeio_open(StoreIoBackend backend);
+void storeio_close(StoreIo *io);
+// 实际使用的后端名称："io_uring" 或 "threads"
+const char *storeio_backend_name(const StoreIo *io);
+
+// 把 data 的副本异步写入 fd 的 offset 处，完成后关闭 fd；写入或关闭失败时把 *error 置为 -1。
+// 队列已满时先等待一个写入完成。提交失败返回 -1，此时 fd 仍由调用者关闭
+int storeio_write(StoreIo *io, int fd, const void *data, size_t len, off_t offset, int *error);
+// 提交并等待所有在途的写入完成
+void storeio_wait(StoreIo *io);
+// 当前在途（已提交未完成）的写入数
+int storeio_in_flight(StoreIo *io);
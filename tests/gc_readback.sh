@@ -0,0 +1,86 @@
+#!/bin/bash
+# 端到端测试：新上传的文件（包括批量备份）不能让旧文件的配方失效，同名文件重新上传后不再引用的块被回收
+# 用法：tests/gc_readback.sh（在仓库根目录 make 之后运行；GC_TEST_PORT 指定起始端口，默认 18081）
+set -u
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+PORT=${GC_TEST_PORT:-18081}
+WORK=$(mktemp -d)
+PIDS=()
+
+cleanup() {
+    for pid in "${PIDS[@]}"; do kill "$pid" 2>/dev/null; done
+    wait 2>/dev/null
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+fail=0
+check() {
+    if "$@"; then echo "ok   - ${DESC}"; else echo "FAIL - ${DESC}"; fail=1; fi
+}
+
+# 按配方读回整个文件并与 expected 比较
+read_back() {
+    local name=$1 expected=$2
+    local size
+    size=$(stat -c %s "$expected")
+    "$ROOT/client" --read "$name" 0 "$size" out.bin > read.log 2>&1 && cmp -s out.bin "$expected"
+}
+
+upload() {
+    "$ROOT/client" "$1" > "upload-$1.log" 2>&1
+}
+
+cd "$WORK"
+for i in 1 2 3 4; do
+    "$ROOT/server" -i "$i" -d "$WORK/store$i" $((PORT + i - 1)) > "server$i.log" 2>&1 &
+    PIDS+=($!)
+    echo "server${i}_ip=127.0.0.1" >> client.conf
+    echo "server${i}_port=$((PORT + i - 1))" >> client.conf
+done
+sleep 0.5
+
+# 旧文件 A.bin 之后上传修改过的 A2.bin，A.bin 仍可按范围读回
+head -c 3000000 /dev/urandom > A.bin
+python3 "$ROOT/modify.py" A.bin A2.bin > /dev/null
+DESC="upload A.bin and A2.bin"; check upload A.bin && upload A2.bin
+dd if=A.bin of=expected.bin bs=1 skip=140000 count=20000 status=none
+DESC="range read of A.bin after uploading A2.bin"
+check bash -c "'$ROOT/client' --read A.bin 140000 20000 out.bin > read.log 2>&1 && cmp -s out.bin expected.bin"
+DESC="full read of A.bin"; check read_back A.bin A.bin
+DESC="full read of A2.bin"; check read_back A2.bin A2.bin
+
+# 同名文件修改后重新上传：其他文件不受影响，新内容可读回，旧内容独有的块被回收
+head -c 2000000 /dev/urandom > C.bin
+DESC="upload C.bin"; check upload C.bin
+python3 "$ROOT/modify.py" C.bin C.new > /dev/null
+head -c 500000 /dev/urandom >> C.new
+mv C.new C.bin
+DESC="re-upload modified C.bin"; check upload C.bin
+DESC="full read of modified C.bin"; check read_back C.bin C.bin
+DESC="full read of A.bin after re-uploading C.bin"; check read_back A.bin A.bin
+DESC="full read of A2.bin after re-uploading C.bin"; check read_back A2.bin A2.bin
+# 批量备份的文件同样受清单保护：会话上传内容相同的文件后再修改重传，批量备份的文件仍可读回
+mkdir -p batch
+head -c 1500000 /dev/urandom > batch/D.bin
+head -c 3000 /dev/urandom > batch/small.bin
+DESC="batch backup"; check bash -c "'$ROOT/client' --batch batch > batch.log 2>&1"
+cp batch/D.bin E.bin
+DESC="upload E.bin with the content of batch/D.bin"; check upload E.bin
+python3 "$ROOT/modify.py" E.bin E.new > /dev/null
+mv E.new E.bin
+DESC="re-upload modified E.bin"; check upload E.bin
+DESC="full read of batch/D.bin after re-uploading E.bin"; check read_back batch/D.bin batch/D.bin
+DESC="full read of batch/small.bin"; check read_back batch/small.bin batch/small.bin
+DESC="full read of modified E.bin"; check read_back E.bin E.bin
+
+"$ROOT/client" --stats stats.txt > /dev/null 2>&1
+deleted=$(awk '/^dedup_gc_chunks_deleted_total/ { n += $2 } END { print n + 0 }' stats.txt)
+DESC="chunks only used by the old C.bin were collected ($deleted deleted)"; check test "$deleted" -gt 0
+
+if [ $fail -ne 0 ]; then
+    echo "server logs kept in $WORK"
+    trap - EXIT
+    for pid in "${PIDS[@]}"; do kill "$pid" 2>/dev/null; done
+fi
+exit $fail
@@ -0,0 +1,139 @@
+// mux_flow.c - 多路复用流控测试：一个流的接收方不读时，同一连接上的其他流照常收发
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include "../mux.h"
+#include "../dedup_proto.h"
+
+#define STALL_BYTES (8 * 1024 * 1024)   // 远大于流的窗口与 socketpair 缓冲区
+#define STALL_SECONDS 3
+
+static int failures = 0;
+
+static void check(int ok, const char *what) {
+    printf("%s - %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) failures++;
+}
+
+static int read_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// 服务端流：第一个 int 为 1 时先停 STALL_SECONDS 秒再读完全部数据并回复总字节数；为 2 时回显 ping
+static void handler(int fd, void *arg) {
+    (void)arg;
+    int kind = 0;
+    if (read_full(fd, &kind, sizeof(kind)) != 0) return;
+    if (kind == 1) {
+        sleep(STALL_SECONDS);
+        static char buf[65536];
+        long total = 0;
+        ssize_t n;
+        while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) total += n;
+        write_full(fd, &total, sizeof(total));
+    } else {
+        int ping = 0;
+        while (read_full(fd, &ping, sizeof(ping)) == 0) {
+            write_full(fd, &ping, sizeof(ping));
+        }
+    }
+}
+
+static void *serve_main(void *arg) {
+    int sock = *(int *)arg;
+    int cmd = 0;
+    if (read_full(sock, &cmd, sizeof(cmd)) == 0 && cmd == CMD_MUX) {
+        mux_serve(sock, handler, NULL);
+    }
+    close(sock);
+    return NULL;
+}
+
+static void *stall_writer(void *arg) {
+    int fd = *(int *)arg;
+    int kind = 1;
+    char *data = calloc(1, STALL_BYTES);
+    if (data && write_full(fd, &kind, sizeof(kind)) == 0 && write_full(fd, data, STALL_BYTES) == 0) {
+        shutdown(fd, SHUT_WR);
+    }
+    free(data);
+    return NULL;
+}
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int main(void) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        perror("socketpair");
+        return 1;
+    }
+    pthread_t server;
+    pthread_create(&server, NULL, serve_main, &sv[1]);
+    MuxConn *conn = mux_open(sv[0]);
+    if (!conn) {
+        printf("FAIL - mux_open\n");
+        return 1;
+    }
+
+    // 流 A 持续写入，服务端暂不读取
+    int stalled = mux_stream(conn);
+    pthread_t writer;
+    pthread_create(&writer, NULL, stall_writer, &stalled);
+    struct timespec settle = {0, 200 * 1000 * 1000};
+    nanosleep(&settle, NULL);
+
+    // 流 B 在流 A 停住期间完成 100 次往返
+    int fd = mux_stream(conn);
+    struct timeval tv = {STALL_SECONDS - 1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    double start = now();
+    int ok = 1;
+    for (int i = 0; i < 100 && ok; i++) {
+        int kind = 2, reply = -1;
+        ok = (i > 0 || write_full(fd, &kind, sizeof(kind)) == 0) &&
+             write_full(fd, &i, sizeof(i)) == 0 &&
+             read_full(fd, &reply, sizeof(reply)) == 0 && reply == i;
+    }
+    check(ok && now() - start < STALL_SECONDS - 1, "other streams progress while one receiver stalls");
+    close(fd);
+
+    // 流 A 的数据在服务端恢复读取后全部送达
+    pthread_join(writer, NULL);
+    long total = 0;
+    check(read_full(stalled, &total, sizeof(total)) == 0 && total == STALL_BYTES,
+          "stalled stream delivers all data once the receiver reads");
+    close(stalled);
+
+    mux_close(conn);
+    pthread_join(server, NULL);
+    return failures ? 1 : 0;
+}
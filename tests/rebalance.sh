@@ -0,0 +1,83 @@
+#!/bin/bash
+# 端到端测试：启用清单之前留在非归属服务器上的副本（记在遗留清单中）经 --rebalance 迁移后被删除，文件仍可读回
+# 用法：tests/rebalance.sh（在仓库根目录 make 之后运行；REBALANCE_TEST_PORT 指定起始端口，默认 18091）
+set -u
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+PORT=${REBALANCE_TEST_PORT:-18091}
+WORK=$(mktemp -d)
+PIDS=()
+
+cleanup() {
+    for pid in "${PIDS[@]}"; do kill "$pid" 2>/dev/null; done
+    wait 2>/dev/null
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+fail=0
+check() {
+    if "$@"; then echo "ok   - ${DESC}"; else echo "FAIL - ${DESC}"; fail=1; fi
+}
+
+read_back() {
+    local name=$1 expected=$2
+    local size
+    size=$(stat -c %s "$expected")
+    "$ROOT/client" --read "$name" 0 "$size" out.bin > read.log 2>&1 && cmp -s out.bin "$expected"
+}
+
+# 不打包小块，每个块都是单独的块文件，便于在存储目录之间搬动
+start_servers() {
+    PIDS=()
+    for i in 1 2 3 4; do
+        "$ROOT/server" -i "$i" -d "$WORK/store$i" -p 0 $((PORT + i - 1)) >> "server$i.log" 2>&1 &
+        PIDS+=($!)
+    done
+    sleep 0.5
+}
+
+stop_servers() {
+    for pid in "${PIDS[@]}"; do kill "$pid" 2>/dev/null; done
+    wait 2>/dev/null
+}
+
+chunk_count() {
+    find "$WORK/$1" -maxdepth 1 -name '*.chunk' | wc -l
+}
+
+cd "$WORK"
+for i in 1 2 3 4; do
+    echo "server${i}_ip=127.0.0.1" >> client.conf
+    echo "server${i}_port=$((PORT + i - 1))" >> client.conf
+done
+start_servers
+head -c 3000000 /dev/urandom > F.bin
+DESC="upload F.bin"; check bash -c "'$ROOT/client' F.bin > upload.log 2>&1"
+stop_servers
+
+# 模拟按归属路由之前的存储：server2 的块全部搬到 server1，server3 的块在 server1 上再存一份；
+# server1 没有清单目录，重启时现有的块都记入遗留清单
+own=$(chunk_count store1)
+moved=$(chunk_count store2)
+mv store2/*.chunk store1/
+cp store3/*.chunk store1/
+rm -rf store1/manifests
+start_servers
+DESC="read F.bin while server2's chunks are only on server1"; check read_back F.bin F.bin
+
+DESC="rebalance without failures"; check bash -c "'$ROOT/client' --rebalance > rebalance.log 2>&1"
+DESC="server1 keeps only the chunks it owns ($(chunk_count store1) of $own)"; check test "$(chunk_count store1)" -eq "$own"
+DESC="server2 got its $moved chunks back"; check test "$(chunk_count store2)" -eq "$moved"
+DESC="full read of F.bin after rebalance"; check read_back F.bin F.bin
+
+# 接管的遗留引用持久化在归属服务器上，重启后块仍受保护
+stop_servers
+start_servers
+DESC="full read of F.bin after restarting the servers"; check read_back F.bin F.bin
+
+if [ $fail -ne 0 ]; then
+    echo "server logs kept in $WORK"
+    trap - EXIT
+    stop_servers
+fi
+exit $fail
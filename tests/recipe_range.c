@@ -0,0 +1,63 @@
+// recipe_range.c - 按范围读取的块缓存测试：FastFp 与大小相同、SHA1 不同的块不能互相命中
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../recipe.h"
+
+#define CHUNK_SIZE 4096
+
+static int failures = 0;
+
+static void check(int ok, const char *what) {
+    printf("%s - %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) failures++;
+}
+
+// 块内容由 SHA1 的第一个字节决定，尾部 64 字节都为 0（FastFp 相同的典型情形）
+static void fill_chunk(const RecipeEntry *entry, unsigned char *out) {
+    memset(out, entry->sha1[0], entry->size);
+    memset(out + entry->size - 64, 0, 64);
+}
+
+static int fetch_chunk(void *ctx, const RecipeEntry *entry, unsigned char *out) {
+    (void)ctx;
+    fill_chunk(entry, out);
+    return 0;
+}
+
+int main(void) {
+    // A、B 的 FastFp 与大小相同而内容不同，第三块与 A 完全相同
+    RecipeEntry entries[3];
+    memset(entries, 0, sizeof(entries));
+    for (int i = 0; i < 3; i++) {
+        entries[i].offset = (uint64_t)i * CHUNK_SIZE;
+        entries[i].fastfp = 0x1234567890abcdefULL;
+        entries[i].size = CHUNK_SIZE;
+        entries[i].server_id = 1;
+        memset(entries[i].sha1, i == 1 ? 0xbb : 0xaa, SHA_DIGEST_LENGTH);
+    }
+    Recipe recipe = { 3 * CHUNK_SIZE, 3, entries };
+
+    unsigned char expected[3 * CHUNK_SIZE];
+    for (int i = 0; i < 3; i++) {
+        fill_chunk(&entries[i], expected + (size_t)i * CHUNK_SIZE);
+    }
+
+    RangeReader rr;
+    if (range_reader_init(&rr, &recipe, 4, fetch_chunk, NULL) != 0) {
+        printf("FAIL - range_reader_init\n");
+        return 1;
+    }
+    unsigned char out[3 * CHUNK_SIZE];
+    long n = range_read(&rr, 0, sizeof(out), out);
+    check(n == (long)sizeof(out) && memcmp(out, expected, sizeof(out)) == 0,
+          "chunks with the same FastFp and size read back their own data");
+    check(rr.fetches == 2 && rr.cache_hits == 1, "identical chunk is served from the cache");
+
+    // 单独读取 B 的范围，缓存中已有 A 也不能命中
+    n = range_read(&rr, CHUNK_SIZE + 100, 200, out);
+    check(n == 200 && memcmp(out, expected + CHUNK_SIZE + 100, 200) == 0,
+          "range inside the colliding chunk returns its bytes");
+    range_reader_free(&rr);
+    return failures ? 1 : 0;
+}